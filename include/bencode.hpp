@@ -2,16 +2,26 @@
 #define INC_BENCODE_HPP
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
 #include <cassert>
 #include <cctype>
+#include <cerrno>
 #include <charconv>
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <iostream>
 #include <iterator>
 #include <limits>
+#include <list>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
 #include <ranges>
 #include <span>
 #include <sstream>
@@ -19,6 +29,10 @@
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <system_error>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
 #include <variant>
 #include <vector>
 
@@ -27,6 +41,18 @@
 #  define BENCODE_HAS_BOOST
 #endif
 
+#if __has_include(<unistd.h>)
+#  include <fcntl.h>
+#  include <poll.h>
+#  include <unistd.h>
+#  define BENCODE_HAS_POSIX
+#endif
+
+#if __has_include(<coroutine>) && defined(__cpp_impl_coroutine)
+#  include <coroutine>
+#  define BENCODE_HAS_COROUTINES
+#endif
+
 namespace bencode {
 
   // Some useful concepts/traits for managing types.
@@ -38,12 +64,38 @@ namespace bencode {
       std::end(t);
     };
 
+    // Character types other than `char` that hold raw bytes, e.g. from a
+    // network buffer.
+    template<typename T>
+    concept byte_like = std::same_as<T, std::byte> ||
+                        std::same_as<T, unsigned char> ||
+                        std::same_as<T, signed char> ||
+                        std::same_as<T, char8_t>;
+
+    // An iterator over contiguous bytes, which we can safely read as `char`s.
+    template<typename Iter>
+    concept byte_iterator = std::contiguous_iterator<Iter> &&
+                            byte_like<std::iter_value_t<Iter>>;
+
     template<typename T>
     concept stringish = iterable<T> && requires(T &t) {
       std::size(t);
-      requires std::same_as<std::iter_value_t<decltype(std::begin(t))>, char>;
+      requires std::same_as<std::iter_value_t<decltype(std::begin(t))>, char> ||
+               std::same_as<std::iter_value_t<decltype(std::begin(t))>,
+                            std::byte>;
     };
 
+    // An output iterator that we can write `char`s to.
+    template<typename Iter>
+    concept char_output = std::input_or_output_iterator<Iter> &&
+                          std::indirectly_writable<Iter, char>;
+
+    // An output iterator that only accepts `std::byte`s.
+    template<typename Iter>
+    concept byte_output = std::input_or_output_iterator<Iter> &&
+                          !std::indirectly_writable<Iter, char> &&
+                          std::indirectly_writable<Iter, std::byte>;
+
     template<typename T>
     concept mapping = iterable<T> && requires {
       typename T::key_type;
@@ -59,13 +111,13 @@ namespace bencode {
 #define BENCODE_MAP_PROXY_FN_1(name, specs)                                   \
   template<typename T>                                                        \
   decltype(auto) name(T &&t) specs {                                          \
-    return proxy_->name(std::forward<T>(t));                                  \
+    return (*this)->name(std::forward<T>(t));                                 \
   }
 
 #define BENCODE_MAP_PROXY_FN_N(name, specs)                                   \
   template<typename ...T>                                                     \
   decltype(auto) name(T &&...t) specs {                                       \
-    return proxy_->name(std::forward<T>(t)...);                               \
+    return (*this)->name(std::forward<T>(t)...);                              \
   }
 
   // A proxy of std::map, since the standard doesn't require that map support
@@ -84,17 +136,20 @@ namespace bencode {
     map_proxy(map_proxy &&rhs) noexcept : proxy_(std::move(rhs.proxy_)) {}
     map_proxy(std::initializer_list<value_type> i) : proxy_(new map_type(i)) {}
 
-    map_proxy operator =(const map_proxy &rhs) {
-      *proxy_ = *rhs.proxy_;
+    map_proxy & operator =(const map_proxy &rhs) {
+      if(proxy_)
+        *proxy_ = *rhs.proxy_;
+      else
+        proxy_.reset(new map_type(*rhs.proxy_));
       return *this;
     }
 
-    map_proxy operator =(map_proxy &&rhs) {
-      *proxy_ = std::move(*rhs.proxy_);
+    map_proxy & operator =(map_proxy &&rhs) noexcept {
+      proxy_.swap(rhs.proxy_);
       return *this;
     }
 
-    void swap(map_proxy &rhs) { proxy_->swap(*rhs.proxy_); }
+    void swap(map_proxy &rhs) noexcept { proxy_.swap(rhs.proxy_); }
 
     operator map_type &() { return *proxy_; };
     operator const map_type &() const { return *proxy_; };
@@ -116,16 +171,16 @@ namespace bencode {
 
     // Iterators
     auto begin() noexcept { return proxy_->begin(); }
-    auto begin() const noexcept { return proxy_->begin(); }
+    auto begin() const noexcept { return (*this)->begin(); }
     auto cbegin() const noexcept { return proxy_->cbegin(); }
     auto end() noexcept { return proxy_->end(); }
-    auto end() const noexcept { return proxy_->end(); }
+    auto end() const noexcept { return (*this)->end(); }
     auto cend() const noexcept { return proxy_->cend(); }
     auto rbegin() noexcept { return proxy_->rbegin(); }
-    auto rbegin() const noexcept { return proxy_->rbegin(); }
+    auto rbegin() const noexcept { return (*this)->rbegin(); }
     auto crbegin() const noexcept { return proxy_->crbegin(); }
     auto rend() noexcept { return proxy_->rend(); }
-    auto rend() const noexcept { return proxy_->rend(); }
+    auto rend() const noexcept { return (*this)->rend(); }
     auto crend() const noexcept { return proxy_->crend(); }
 
     // Capacity
@@ -141,6 +196,7 @@ namespace bencode {
     BENCODE_MAP_PROXY_FN_N(emplace_hint,)
     BENCODE_MAP_PROXY_FN_N(try_emplace,)
     BENCODE_MAP_PROXY_FN_N(erase,)
+    BENCODE_MAP_PROXY_FN_1(extract,)
 
     // Lookup
     BENCODE_MAP_PROXY_FN_1(count, const)
@@ -166,518 +222,5285 @@ namespace bencode {
     std::unique_ptr<map_type> proxy_;
   };
 
-#define BENCODE_DATA_GETTER(func, impl, arg_type, container_type)             \
-  basic_data & func(const arg_type &key) & {                                  \
-    return impl<container_type>(*this, key);                                  \
-  }                                                                           \
-  basic_data && func(const arg_type &key) && {                                \
-    return std::move(impl<container_type>(std::move(*this), key));            \
-  }                                                                           \
-  const basic_data & func(const arg_type &key) const & {                      \
-    return impl<container_type>(*this, key);                                  \
-  }                                                                           \
-  const basic_data && func(const arg_type &key) const && {                    \
-    return std::move(impl<container_type>(std::move(*this), key));            \
-  }
-
-  template<template<typename ...> typename Variant, typename I, typename S,
-           template<typename ...> typename L, template<typename ...> typename D>
-  class basic_data : public Variant<I, S, L<basic_data<Variant, I, S, L, D>>,
-                                    D<S, basic_data<Variant, I, S, L, D>>> {
-  public:
-    using integer = I;
-    using string = S;
-    using list = L<basic_data>;
-    using dict = D<S, basic_data>;
+  namespace detail {
+    // A hash for string-like keys that also accepts anything convertible to
+    // `std::string_view`, so that lookups don't need to build a key.
+    struct string_hash {
+      using is_transparent = void;
 
-    using base_type = Variant<integer, string, list, dict>;
-    using base_type::base_type;
+      template<typename T>
+      requires std::convertible_to<const T &, std::string_view>
+      std::size_t operator ()(const T &s) const noexcept {
+        return std::hash<std::string_view>{}(std::string_view(s));
+      }
+    };
+  } // namespace detail
 
-    base_type & base() & { return *this; }
-    base_type && base() && { return std::move(*this); }
-    const base_type & base() const & { return *this; }
-    const base_type && base() const && { return std::move(*this); }
+  // A proxy of std::unordered_map, for dicts that are mostly used for random
+  // lookups. When encoding, the keys are sorted so that the result is still
+  // canonical bencode.
+  template<typename Key, typename Value>
+  class unordered_map_proxy {
+  public:
+    using map_type = std::unordered_map<Key, Value, detail::string_hash,
+                                        std::equal_to<>>;
+    using key_type = Key;
+    using mapped_type = Value;
+    using value_type = std::pair<const Key, Value>;
+    using hasher = typename map_type::hasher;
 
-    // The below wouldn't need macros if we had "deducing `this`"...
-    BENCODE_DATA_GETTER(at,          at_impl,    integer, list)
-    BENCODE_DATA_GETTER(at,          at_impl,    string,  dict)
-    BENCODE_DATA_GETTER(operator [], index_impl, integer, list)
-    BENCODE_DATA_GETTER(operator [], index_impl, string,  dict)
+    // Construction/assignment
+    unordered_map_proxy() : proxy_(new map_type()) {}
+    unordered_map_proxy(const unordered_map_proxy &rhs)
+      : proxy_(new map_type(*rhs.proxy_)) {}
+    unordered_map_proxy(unordered_map_proxy &&rhs) noexcept
+      : proxy_(std::move(rhs.proxy_)) {}
+    unordered_map_proxy(std::initializer_list<value_type> i)
+      : proxy_(new map_type(i)) {}
 
-  private:
-    template<typename Type, typename Self, typename Key>
-    static inline decltype(auto) at_impl(Self &&self, Key &&key) {
-      return variant_traits<Variant>::template get<Type>(
-        std::forward<Self>(self)
-      ).at(std::forward<Key>(key));
+    unordered_map_proxy & operator =(const unordered_map_proxy &rhs) {
+      if(proxy_)
+        *proxy_ = *rhs.proxy_;
+      else
+        proxy_.reset(new map_type(*rhs.proxy_));
+      return *this;
     }
 
-    template<typename Type, typename Self, typename Key>
-    static inline decltype(auto) index_impl(Self &&self, Key &&key) {
-      return variant_traits<Variant>::template get<Type>(
-        std::forward<Self>(self)
-      )[std::forward<Key>(key)];
+    unordered_map_proxy & operator =(unordered_map_proxy &&rhs) noexcept {
+      proxy_.swap(rhs.proxy_);
+      return *this;
     }
-  };
 
-  template<typename T>
-  struct variant_traits_for;
+    void swap(unordered_map_proxy &rhs) noexcept { proxy_.swap(rhs.proxy_); }
 
-  template<template<typename ...> typename Variant,
-           typename I, typename S, template<typename ...> typename L,
-           template<typename ...> typename D>
-  struct variant_traits_for<basic_data<Variant, I, S, L, D>>
-    : variant_traits<Variant> {};
+    operator map_type &() { return *proxy_; };
+    operator const map_type &() const { return *proxy_; };
 
-  template<>
-  struct variant_traits<std::variant> {
-    template<typename Visitor, typename ...Variants>
-    inline static decltype(auto)
-    visit(Visitor &&visitor, Variants &&...variants) {
-      return std::visit(std::forward<Visitor>(visitor),
-                        std::forward<Variants>(variants).base()...);
-    }
+    // Pointer access
+    map_type & operator *() { return *proxy_; }
+    const map_type & operator *() const { return *proxy_; }
+    map_type * operator ->() { return proxy_.get(); }
+    const map_type * operator ->() const { return proxy_.get(); }
 
-    template<typename Type, typename Variant>
-    inline static decltype(auto) get(Variant &&variant) {
-      return std::get<Type>(std::forward<Variant>(variant).base());
-    }
+    // Element access
+    template<typename K>
+    mapped_type & at(K &&k) { return find_or_throw(*this, k); }
+    template<typename K>
+    const mapped_type & at(K &&k) const { return find_or_throw(*this, k); }
+    template<typename K>
+    mapped_type & operator [](K &&k) { return (*proxy_)[std::forward<K>(k)]; }
 
-    template<typename Type, typename Variant>
-    inline static decltype(auto) get_if(Variant *variant) {
-      return std::get_if<Type>(&variant->base());
-    }
+    // Iterators
+    auto begin() noexcept { return proxy_->begin(); }
+    auto begin() const noexcept { return (*this)->begin(); }
+    auto cbegin() const noexcept { return proxy_->cbegin(); }
+    auto end() noexcept { return proxy_->end(); }
+    auto end() const noexcept { return (*this)->end(); }
+    auto cend() const noexcept { return proxy_->cend(); }
 
-    template<typename Variant>
-    inline static auto index(const Variant &variant) {
-      return variant.index();
+    // Capacity
+    bool empty() const noexcept { return proxy_->empty(); }
+    auto size() const noexcept { return proxy_->size(); }
+    auto max_size() const noexcept { return proxy_->max_size(); }
+
+    // Modifiers
+    void clear() noexcept { proxy_->clear(); }
+    BENCODE_MAP_PROXY_FN_N(insert,)
+    BENCODE_MAP_PROXY_FN_N(insert_or_assign,)
+    BENCODE_MAP_PROXY_FN_N(emplace,)
+    BENCODE_MAP_PROXY_FN_N(emplace_hint,)
+    BENCODE_MAP_PROXY_FN_N(try_emplace,)
+    BENCODE_MAP_PROXY_FN_N(erase,)
+    BENCODE_MAP_PROXY_FN_1(extract,)
+
+    // Lookup
+    BENCODE_MAP_PROXY_FN_1(count, const)
+    BENCODE_MAP_PROXY_FN_1(contains, const)
+    BENCODE_MAP_PROXY_FN_1(find,)
+    BENCODE_MAP_PROXY_FN_1(find, const)
+    BENCODE_MAP_PROXY_FN_1(equal_range,)
+    BENCODE_MAP_PROXY_FN_1(equal_range, const)
+
+    // Hash policy
+    void reserve(std::size_t n) { proxy_->reserve(n); }
+    void rehash(std::size_t n) { proxy_->rehash(n); }
+    auto hash_function() const { return proxy_->hash_function(); }
+
+    friend bool operator ==(const unordered_map_proxy &lhs,
+                            const unordered_map_proxy &rhs) {
+      return *lhs == *rhs;
+    }
+  private:
+    // `std::unordered_map::at` doesn't support heterogeneous lookup, so do it
+    // ourselves.
+    template<typename Self, typename K>
+    static auto & find_or_throw(Self &self, const K &k) {
+      auto i = self->find(k);
+      if(i == self->end())
+        throw std::out_of_range("key not found");
+      return i->second;
     }
+
+    std::unique_ptr<map_type> proxy_;
   };
 
-  using data = basic_data<std::variant, long long, std::string, std::vector,
-                          map_proxy>;
-  using data_view = basic_data<std::variant, long long, std::string_view,
-                               std::vector, map_proxy>;
+  // A proxy of std::vector. Unlike std::vector itself, this is only
+  // pointer-sized, which lets list handles fit inside a `compact_data` node.
+  template<typename Value>
+  class list_proxy {
+  public:
+    using list_type = std::vector<Value>;
+    using value_type = Value;
+    using size_type = std::size_t;
 
-#ifdef BENCODE_HAS_BOOST
-  template<>
-  struct variant_traits<boost::variant> {
-    template<typename Visitor, typename ...Variants>
-    static decltype(auto)
-    visit(Visitor &&visitor, Variants &&...variants) {
-      return boost::apply_visitor(std::forward<Visitor>(visitor),
-                                  std::forward<Variants>(variants).base()...);
-    }
+    // Construction/assignment
+    list_proxy() : proxy_(new list_type()) {}
+    list_proxy(const list_proxy &rhs) : proxy_(new list_type(*rhs.proxy_)) {}
+    list_proxy(list_proxy &&rhs) noexcept : proxy_(std::move(rhs.proxy_)) {}
+    list_proxy(std::initializer_list<value_type> i)
+      : proxy_(new list_type(i)) {}
 
-    template<typename Type, typename Variant>
-    inline static decltype(auto) get(Variant &&variant) {
-      return boost::get<Type>(std::forward<Variant>(variant));
+    list_proxy & operator =(const list_proxy &rhs) {
+      if(proxy_)
+        *proxy_ = *rhs.proxy_;
+      else
+        proxy_.reset(new list_type(*rhs.proxy_));
+      return *this;
     }
 
-    template<typename Type, typename Variant>
-    inline static decltype(auto) get_if(Variant *variant) {
-      return boost::get<Type>(variant);
+    list_proxy & operator =(list_proxy &&rhs) noexcept {
+      proxy_.swap(rhs.proxy_);
+      return *this;
     }
 
-    template<typename Variant>
-    inline static auto index(const Variant &variant) {
-      return variant.which();
-    }
-  };
+    void swap(list_proxy &rhs) noexcept { proxy_.swap(rhs.proxy_); }
 
-  using boost_data = basic_data<boost::variant, long long, std::string,
-                                std::vector, map_proxy>;
-  using boost_data_view = basic_data<boost::variant, long long,
-                                     std::string_view, std::vector, map_proxy>;
-#endif
+    operator list_type &() { return *proxy_; };
+    operator const list_type &() const { return *proxy_; };
 
-  using integer = data::integer;
-  using string = data::string;
-  using list = data::list;
-  using dict = data::dict;
+    // Pointer access
+    list_type & operator *() { return *proxy_; }
+    const list_type & operator *() const { return *proxy_; }
+    list_type * operator ->() { return proxy_.get(); }
+    const list_type * operator ->() const { return proxy_.get(); }
 
-  using integer_view = data_view::integer;
-  using string_view = data_view::string;
-  using list_view = data_view::list;
-  using dict_view = data_view::dict;
+    // Element access
+    value_type & at(size_type i) { return proxy_->at(i); }
+    const value_type & at(size_type i) const { return proxy_->at(i); }
+    value_type & operator [](size_type i) { return (*proxy_)[i]; }
+    const value_type & operator [](size_type i) const { return (*proxy_)[i]; }
+    value_type & front() { return proxy_->front(); }
+    const value_type & front() const { return proxy_->front(); }
+    value_type & back() { return proxy_->back(); }
+    const value_type & back() const { return proxy_->back(); }
 
-  enum eof_behavior {
-    check_eof,
-    no_check_eof
-  };
+    // Iterators
+    auto begin() noexcept { return proxy_->begin(); }
+    auto begin() const noexcept { return (*this)->begin(); }
+    auto cbegin() const noexcept { return proxy_->cbegin(); }
+    auto end() noexcept { return proxy_->end(); }
+    auto end() const noexcept { return (*this)->end(); }
+    auto cend() const noexcept { return proxy_->cend(); }
+    auto rbegin() noexcept { return proxy_->rbegin(); }
+    auto rbegin() const noexcept { return (*this)->rbegin(); }
+    auto crbegin() const noexcept { return proxy_->crbegin(); }
+    auto rend() noexcept { return proxy_->rend(); }
+    auto rend() const noexcept { return (*this)->rend(); }
+    auto crend() const noexcept { return proxy_->crend(); }
 
-  struct syntax_error : std::runtime_error {
-    using std::runtime_error::runtime_error;
-  };
+    // Capacity
+    bool empty() const noexcept { return proxy_->empty(); }
+    auto size() const noexcept { return proxy_->size(); }
+    auto max_size() const noexcept { return proxy_->max_size(); }
+    auto capacity() const noexcept { return proxy_->capacity(); }
+    void reserve(size_type n) { proxy_->reserve(n); }
+    void shrink_to_fit() { proxy_->shrink_to_fit(); }
 
-  struct end_of_input_error : syntax_error {
-    end_of_input_error() : syntax_error("unexpected end of input") {}
+    // Modifiers
+    void clear() noexcept { proxy_->clear(); }
+    BENCODE_MAP_PROXY_FN_N(insert,)
+    BENCODE_MAP_PROXY_FN_N(emplace,)
+    BENCODE_MAP_PROXY_FN_N(erase,)
+    BENCODE_MAP_PROXY_FN_N(push_back,)
+    BENCODE_MAP_PROXY_FN_N(emplace_back,)
+    BENCODE_MAP_PROXY_FN_N(resize,)
+    void pop_back() { proxy_->pop_back(); }
+
+    friend bool operator ==(const list_proxy &lhs, const list_proxy &rhs) {
+      return *lhs == *rhs;
+    }
+    friend auto operator <=>(const list_proxy &lhs, const list_proxy &rhs) {
+      return *lhs <=> *rhs;
+    }
+  private:
+    std::unique_ptr<list_type> proxy_;
   };
 
-  class decode_error : public std::runtime_error {
+  // A string that fits in 15 bytes. Strings of up to 14 characters are stored
+  // inline; longer ones are stored on the heap, prefixed by their length.
+  class compact_string {
   public:
-    decode_error(std::string message, std::size_t offset,
-                 std::exception_ptr e = {})
-      : runtime_error(message + ", at offset " + std::to_string(offset)),
-        offset_(offset), nested_(e) {}
+    using value_type = char;
+    using size_type = std::size_t;
+    using iterator = char *;
+    using const_iterator = const char *;
 
-    [[noreturn]] void rethrow_nested() const {
-      if(nested_)
-        std::rethrow_exception(nested_);
-      std::terminate();
+    static constexpr size_type inline_capacity = 14;
+
+    // Construction/assignment
+    compact_string() noexcept { set_inline_size(0); }
+    compact_string(const char *s) : compact_string(std::string_view(s)) {}
+    compact_string(const std::string &s)
+      : compact_string(std::string_view(s)) {}
+    compact_string(std::string_view s) {
+      std::memcpy(allocate(s.size()), s.data(), s.size());
+    }
+    compact_string(size_type n, char c) {
+      std::memset(allocate(n), c, n);
     }
 
-    std::exception_ptr nested_ptr() const noexcept {
-      return nested_;
+    template<std::forward_iterator Iter>
+    compact_string(Iter begin, Iter end) {
+      std::copy(begin, end, allocate(std::distance(begin, end)));
     }
 
-    std::size_t offset() const noexcept {
-      return offset_;
+    compact_string(const compact_string &rhs)
+      : compact_string(std::string_view(rhs)) {}
+    compact_string(compact_string &&rhs) noexcept {
+      std::memcpy(bytes_, rhs.bytes_, sizeof(bytes_));
+      rhs.set_inline_size(0);
     }
-  private:
-    std::size_t offset_;
-    std::exception_ptr nested_;
-  };
 
-  namespace detail {
+    ~compact_string() { deallocate(); }
 
-    template<std::integral Integer>
-    inline void check_overflow(Integer value, Integer digit) {
-      using limits = std::numeric_limits<Integer>;
-      // Wrap `max` in parentheses to work around <windows.h> #defining `max`.
-      if((value > (limits::max)() / 10) ||
-         (value == (limits::max)() / 10 && digit > (limits::max)() % 10))
-        throw std::overflow_error("integer overflow");
+    compact_string & operator =(const compact_string &rhs) {
+      if(this != &rhs)
+        *this = compact_string(rhs);
+      return *this;
     }
 
-    template<std::integral Integer>
-    inline void check_underflow(Integer value, Integer digit) {
-      using limits = std::numeric_limits<Integer>;
-      // As above, work around <windows.h> #defining `min`.
-      if((value < (limits::min)() / 10) ||
-         (value == (limits::min)() / 10 && digit < (limits::min)() % 10))
-        throw std::underflow_error("integer underflow");
+    compact_string & operator =(compact_string &&rhs) noexcept {
+      swap(rhs);
+      return *this;
     }
 
-    template<std::integral Integer>
-    inline void
-    check_over_underflow(Integer value, Integer digit, Integer sgn) {
-      if(sgn == 1)
-        check_overflow(value, digit);
-      else
-        check_underflow(value, digit);
+    void swap(compact_string &rhs) noexcept {
+      unsigned char tmp[sizeof(bytes_)];
+      std::memcpy(tmp, bytes_, sizeof(bytes_));
+      std::memcpy(bytes_, rhs.bytes_, sizeof(bytes_));
+      std::memcpy(rhs.bytes_, tmp, sizeof(bytes_));
     }
 
-    template<std::integral Integer, std::input_iterator Iter>
-    inline Integer
-    decode_digits(Iter &begin, Iter end, [[maybe_unused]] Integer sgn = 1) {
-      assert(sgn == 1 || (std::is_signed_v<Integer> &&
-                          std::make_signed_t<Integer>(sgn) == -1));
+    operator std::string_view() const noexcept { return {data(), size()}; }
 
-      Integer value = 0;
+    // Element access
+    char * data() noexcept {
+      return is_inline() ? reinterpret_cast<char *>(bytes_) :
+                           heap_ptr() + sizeof(size_type);
+    }
+    const char * data() const noexcept {
+      return const_cast<compact_string*>(this)->data();
+    }
+    char & operator [](size_type i) noexcept { return data()[i]; }
+    const char & operator [](size_type i) const noexcept { return data()[i]; }
+
+    // Iterators
+    iterator begin() noexcept { return data(); }
+    const_iterator begin() const noexcept { return data(); }
+    iterator end() noexcept { return data() + size(); }
+    const_iterator end() const noexcept { return data() + size(); }
+
+    // Capacity
+    bool empty() const noexcept { return size() == 0; }
+    size_type size() const noexcept {
+      if(is_inline())
+        return bytes_[inline_capacity];
+      size_type n;
+      std::memcpy(&n, heap_ptr(), sizeof(n));
+      return n;
+    }
+    size_type length() const noexcept { return size(); }
+
+    friend bool
+    operator ==(const compact_string &lhs, const compact_string &rhs) {
+      return std::string_view(lhs) == std::string_view(rhs);
+    }
+    friend auto
+    operator <=>(const compact_string &lhs, const compact_string &rhs) {
+      return std::string_view(lhs) <=> std::string_view(rhs);
+    }
+
+    template<typename T>
+    requires(std::convertible_to<const T &, std::string_view> &&
+             !std::same_as<T, compact_string>)
+    friend bool operator ==(const compact_string &lhs, const T &rhs) {
+      return std::string_view(lhs) == std::string_view(rhs);
+    }
+    template<typename T>
+    requires(std::convertible_to<const T &, std::string_view> &&
+             !std::same_as<T, compact_string>)
+    friend auto operator <=>(const compact_string &lhs, const T &rhs) {
+      return std::string_view(lhs) <=> std::string_view(rhs);
+    }
+
+    friend std::ostream &
+    operator <<(std::ostream &os, const compact_string &s) {
+      return os << std::string_view(s);
+    }
+  private:
+    static constexpr unsigned char heap_tag = 0xff;
+
+    bool is_inline() const noexcept {
+      return bytes_[inline_capacity] != heap_tag;
+    }
+
+    void set_inline_size(size_type n) noexcept {
+      bytes_[inline_capacity] = static_cast<unsigned char>(n);
+    }
+
+    char * heap_ptr() const noexcept {
+      char *p;
+      std::memcpy(&p, bytes_, sizeof(p));
+      return p;
+    }
+
+    char * allocate(size_type n) {
+      if(n <= inline_capacity) {
+        set_inline_size(n);
+        return reinterpret_cast<char *>(bytes_);
+      }
+
+      char *p = new char[sizeof(size_type) + n];
+      std::memcpy(p, &n, sizeof(n));
+      std::memcpy(bytes_, &p, sizeof(p));
+      bytes_[inline_capacity] = heap_tag;
+      return p + sizeof(size_type);
+    }
+
+    void deallocate() noexcept {
+      if(!is_inline())
+        delete[] heap_ptr();
+    }
+
+    static_assert(sizeof(char *) <= inline_capacity);
+    unsigned char bytes_[inline_capacity + 1];
+  };
+
+  namespace detail {
+    // A pointer-sized, reference-counted, copy-on-write handle to a `T`.
+    // Copying the handle only bumps the reference count; `mutate` copies the
+    // `T` first if anyone else can see it.
+    //
+    // Like the old copy-on-write `std::string`s, once a mutable reference
+    // into the `T` has been handed out (see `leak`), the `T` is unshareable:
+    // otherwise, writing through that reference after copying the handle
+    // would change both copies. Copying an unshareable handle copies the `T`.
+    template<typename T>
+    class cow_ptr {
+    public:
+      cow_ptr() : block_(new block()) {}
+      explicit cow_ptr(T value) : block_(new block(std::move(value))) {}
+      cow_ptr(const cow_ptr &rhs) : block_(rhs.block_) {
+        if(!block_)
+          return;
+        if(block_->shareable)
+          block_->refs.fetch_add(1, std::memory_order_relaxed);
+        else
+          block_ = new block(rhs.block_->value);
+      }
+      cow_ptr(cow_ptr &&rhs) noexcept : block_(rhs.block_) {
+        rhs.block_ = nullptr;
+      }
+
+      ~cow_ptr() { release(); }
+
+      cow_ptr & operator =(cow_ptr rhs) noexcept {
+        swap(rhs);
+        return *this;
+      }
+
+      void swap(cow_ptr &rhs) noexcept { std::swap(block_, rhs.block_); }
+
+      const T & operator *() const noexcept { return block_->value; }
+      const T * operator ->() const noexcept { return &block_->value; }
+
+      // Get a mutable reference to the value, copying it first if it's
+      // shared. The reference must not be used after this handle is copied;
+      // if it might be, use `leak` instead.
+      T & mutate() {
+        if(block_->refs.load(std::memory_order_acquire) != 1)
+          *this = cow_ptr(block_->value);
+        return block_->value;
+      }
+
+      // Like `mutate`, but also mark the value unshareable, so that the
+      // reference stays valid (and private to this handle) across copies.
+      T & leak() {
+        T &value = mutate();
+        block_->shareable = false;
+        return value;
+      }
+
+      bool shares_with(const cow_ptr &rhs) const noexcept {
+        return block_ == rhs.block_;
+      }
+    private:
+      struct block {
+        block() = default;
+        explicit block(T v) : value(std::move(v)) {}
+
+        std::atomic<std::size_t> refs = 1;
+        bool shareable = true;
+        T value;
+      };
+
+      void release() noexcept {
+        if(block_ && block_->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+          delete block_;
+      }
+
+      block *block_;
+    };
+
+    // Gets the container behind a copy-on-write proxy without marking it
+    // unshareable, for library code that builds a container in place and
+    // doesn't let any references into it escape. Other containers are
+    // returned as-is.
+    struct cow_access {
+      template<typename T>
+      static auto & container(T &c) {
+        if constexpr(requires { c.proxy_.mutate(); })
+          return c.proxy_.mutate();
+        else
+          return c;
+      }
+    };
+
+    template<typename T>
+    using cow_container_t = std::remove_reference_t<
+      decltype(cow_access::container(std::declval<T &>()))
+    >;
+  } // namespace detail
+
+  // A copy-on-write proxy of std::map. Copies share the same map until one
+  // of them is modified, so copying a tree of these only copies the root.
+  // Calling any non-const member function (including non-const `begin` and
+  // `find`) on a shared map copies it first. Member functions that return a
+  // mutable reference, pointer, or iterator into the map also make it
+  // unshareable, so the next copy of it is a deep copy; this keeps writes
+  // through those references from showing up in later copies.
+  template<typename Key, typename Value>
+  class shared_map_proxy {
+  public:
+    using map_type = std::map<Key, Value>;
+    using key_type = Key;
+    using mapped_type = Value;
+    using value_type = std::pair<const Key, Value>;
+
+    // Construction/assignment
+    shared_map_proxy() = default;
+    shared_map_proxy(std::initializer_list<value_type> i)
+      : proxy_(map_type(i)) {}
+
+    void swap(shared_map_proxy &rhs) noexcept { proxy_.swap(rhs.proxy_); }
+
+    operator map_type &() { return proxy_.leak(); };
+    operator const map_type &() const { return *proxy_; };
+
+    // Pointer access
+    map_type & operator *() { return proxy_.leak(); }
+    const map_type & operator *() const { return *proxy_; }
+    map_type * operator ->() { return &proxy_.leak(); }
+    const map_type * operator ->() const { return &*proxy_; }
+
+    // Element access
+    template<typename K>
+    mapped_type & at(K &&k) { return (*this)->at(std::forward<K>(k)); }
+    template<typename K>
+    const mapped_type &
+    at(K &&k) const { return proxy_->at(std::forward<K>(k)); }
+    template<typename K>
+    mapped_type & operator [](K &&k) { return (**this)[std::forward<K>(k)]; }
+
+    // Iterators
+    auto begin() { return (*this)->begin(); }
+    auto begin() const noexcept { return proxy_->begin(); }
+    auto cbegin() const noexcept { return proxy_->cbegin(); }
+    auto end() { return (*this)->end(); }
+    auto end() const noexcept { return proxy_->end(); }
+    auto cend() const noexcept { return proxy_->cend(); }
+    auto rbegin() { return (*this)->rbegin(); }
+    auto rbegin() const noexcept { return proxy_->rbegin(); }
+    auto crbegin() const noexcept { return proxy_->crbegin(); }
+    auto rend() { return (*this)->rend(); }
+    auto rend() const noexcept { return proxy_->rend(); }
+    auto crend() const noexcept { return proxy_->crend(); }
+
+    // Capacity
+    bool empty() const noexcept { return proxy_->empty(); }
+    auto size() const noexcept { return proxy_->size(); }
+    auto max_size() const noexcept { return proxy_->max_size(); }
+
+    // Modifiers
+    void clear() { proxy_.mutate().clear(); }
+    BENCODE_MAP_PROXY_FN_N(insert,)
+    BENCODE_MAP_PROXY_FN_N(insert_or_assign,)
+    BENCODE_MAP_PROXY_FN_N(emplace,)
+    BENCODE_MAP_PROXY_FN_N(emplace_hint,)
+    BENCODE_MAP_PROXY_FN_N(try_emplace,)
+    BENCODE_MAP_PROXY_FN_N(erase,)
+    template<typename T>
+    auto extract(T &&t) { return proxy_.mutate().extract(std::forward<T>(t)); }
+
+    // Lookup
+    BENCODE_MAP_PROXY_FN_1(count, const)
+    BENCODE_MAP_PROXY_FN_1(find,)
+    BENCODE_MAP_PROXY_FN_1(find, const)
+    BENCODE_MAP_PROXY_FN_1(equal_range,)
+    BENCODE_MAP_PROXY_FN_1(equal_range, const)
+    BENCODE_MAP_PROXY_FN_1(lower_bound,)
+    BENCODE_MAP_PROXY_FN_1(lower_bound, const)
+    BENCODE_MAP_PROXY_FN_1(upper_bound,)
+    BENCODE_MAP_PROXY_FN_1(upper_bound, const)
+
+    auto key_comp() const { return proxy_->key_comp(); }
+    auto value_comp() const { return proxy_->value_comp(); }
+
+    // Return true if `rhs` shares storage with this map.
+    bool shares_with(const shared_map_proxy &rhs) const noexcept {
+      return proxy_.shares_with(rhs.proxy_);
+    }
+
+    friend bool
+    operator ==(const shared_map_proxy &lhs, const shared_map_proxy &rhs) {
+      return lhs.shares_with(rhs) || *lhs == *rhs;
+    }
+    friend auto
+    operator <=>(const shared_map_proxy &lhs, const shared_map_proxy &rhs) {
+      return *lhs <=> *rhs;
+    }
+  private:
+    friend struct detail::cow_access;
+    detail::cow_ptr<map_type> proxy_;
+  };
+
+  // A copy-on-write proxy of std::vector; see `shared_map_proxy`.
+  template<typename Value>
+  class shared_list_proxy {
+  public:
+    using list_type = std::vector<Value>;
+    using value_type = Value;
+    using size_type = std::size_t;
+
+    // Construction/assignment
+    shared_list_proxy() = default;
+    shared_list_proxy(std::initializer_list<value_type> i)
+      : proxy_(list_type(i)) {}
+
+    void swap(shared_list_proxy &rhs) noexcept { proxy_.swap(rhs.proxy_); }
+
+    operator list_type &() { return proxy_.leak(); };
+    operator const list_type &() const { return *proxy_; };
+
+    // Pointer access
+    list_type & operator *() { return proxy_.leak(); }
+    const list_type & operator *() const { return *proxy_; }
+    list_type * operator ->() { return &proxy_.leak(); }
+    const list_type * operator ->() const { return &*proxy_; }
+
+    // Element access
+    value_type & at(size_type i) { return (*this)->at(i); }
+    const value_type & at(size_type i) const { return proxy_->at(i); }
+    value_type & operator [](size_type i) { return (**this)[i]; }
+    const value_type & operator [](size_type i) const { return (*proxy_)[i]; }
+    value_type & front() { return (*this)->front(); }
+    const value_type & front() const { return proxy_->front(); }
+    value_type & back() { return (*this)->back(); }
+    const value_type & back() const { return proxy_->back(); }
+
+    // Iterators
+    auto begin() { return (*this)->begin(); }
+    auto begin() const noexcept { return proxy_->begin(); }
+    auto cbegin() const noexcept { return proxy_->cbegin(); }
+    auto end() { return (*this)->end(); }
+    auto end() const noexcept { return proxy_->end(); }
+    auto cend() const noexcept { return proxy_->cend(); }
+    auto rbegin() { return (*this)->rbegin(); }
+    auto rbegin() const noexcept { return proxy_->rbegin(); }
+    auto crbegin() const noexcept { return proxy_->crbegin(); }
+    auto rend() { return (*this)->rend(); }
+    auto rend() const noexcept { return proxy_->rend(); }
+    auto crend() const noexcept { return proxy_->crend(); }
+
+    // Capacity
+    bool empty() const noexcept { return proxy_->empty(); }
+    auto size() const noexcept { return proxy_->size(); }
+    auto max_size() const noexcept { return proxy_->max_size(); }
+    auto capacity() const noexcept { return proxy_->capacity(); }
+    void reserve(size_type n) { proxy_.mutate().reserve(n); }
+    void shrink_to_fit() { proxy_.mutate().shrink_to_fit(); }
+
+    // Modifiers
+    void clear() { proxy_.mutate().clear(); }
+    BENCODE_MAP_PROXY_FN_N(insert,)
+    BENCODE_MAP_PROXY_FN_N(emplace,)
+    BENCODE_MAP_PROXY_FN_N(erase,)
+    BENCODE_MAP_PROXY_FN_N(emplace_back,)
+    template<typename ...T>
+    void push_back(T &&...t) {
+      proxy_.mutate().push_back(std::forward<T>(t)...);
+    }
+    template<typename ...T>
+    void resize(T &&...t) { proxy_.mutate().resize(std::forward<T>(t)...); }
+    void pop_back() { proxy_.mutate().pop_back(); }
+
+    // Return true if `rhs` shares storage with this list.
+    bool shares_with(const shared_list_proxy &rhs) const noexcept {
+      return proxy_.shares_with(rhs.proxy_);
+    }
+
+    friend bool
+    operator ==(const shared_list_proxy &lhs, const shared_list_proxy &rhs) {
+      return lhs.shares_with(rhs) || *lhs == *rhs;
+    }
+    friend auto
+    operator <=>(const shared_list_proxy &lhs, const shared_list_proxy &rhs) {
+      return *lhs <=> *rhs;
+    }
+  private:
+    friend struct detail::cow_access;
+    detail::cow_ptr<list_type> proxy_;
+  };
+
+  // An immutable string that fits in 15 bytes. Like `compact_string`, strings
+  // of up to 14 characters are stored inline; longer ones are stored on the
+  // heap with a reference count, so copying them is O(1).
+  class shared_string {
+  public:
+    using value_type = char;
+    using size_type = std::size_t;
+    using iterator = const char *;
+    using const_iterator = const char *;
+
+    static constexpr size_type inline_capacity = 14;
+
+    // Construction/assignment
+    shared_string() noexcept { set_inline_size(0); }
+    shared_string(const char *s) : shared_string(std::string_view(s)) {}
+    shared_string(const std::string &s) : shared_string(std::string_view(s)) {}
+    shared_string(std::string_view s) {
+      std::memcpy(allocate(s.size()), s.data(), s.size());
+    }
+    shared_string(size_type n, char c) {
+      std::memset(allocate(n), c, n);
+    }
+
+    template<std::forward_iterator Iter>
+    shared_string(Iter begin, Iter end) {
+      std::copy(begin, end, allocate(std::distance(begin, end)));
+    }
+
+    shared_string(const shared_string &rhs) noexcept {
+      std::memcpy(bytes_, rhs.bytes_, sizeof(bytes_));
+      if(!is_inline())
+        heap_ptr()->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    shared_string(shared_string &&rhs) noexcept {
+      std::memcpy(bytes_, rhs.bytes_, sizeof(bytes_));
+      rhs.set_inline_size(0);
+    }
+
+    ~shared_string() { deallocate(); }
+
+    shared_string & operator =(shared_string rhs) noexcept {
+      swap(rhs);
+      return *this;
+    }
+
+    void swap(shared_string &rhs) noexcept {
+      unsigned char tmp[sizeof(bytes_)];
+      std::memcpy(tmp, bytes_, sizeof(bytes_));
+      std::memcpy(bytes_, rhs.bytes_, sizeof(bytes_));
+      std::memcpy(rhs.bytes_, tmp, sizeof(bytes_));
+    }
+
+    operator std::string_view() const noexcept { return {data(), size()}; }
+
+    // Element access
+    const char * data() const noexcept {
+      return is_inline() ? reinterpret_cast<const char *>(bytes_) :
+                           heap_ptr()->chars();
+    }
+    const char & operator [](size_type i) const noexcept { return data()[i]; }
+
+    // Iterators
+    const_iterator begin() const noexcept { return data(); }
+    const_iterator end() const noexcept { return data() + size(); }
+
+    // Capacity
+    bool empty() const noexcept { return size() == 0; }
+    size_type size() const noexcept {
+      return is_inline() ? bytes_[inline_capacity] : heap_ptr()->size;
+    }
+    size_type length() const noexcept { return size(); }
+
+    friend bool
+    operator ==(const shared_string &lhs, const shared_string &rhs) {
+      return std::string_view(lhs) == std::string_view(rhs);
+    }
+    friend auto
+    operator <=>(const shared_string &lhs, const shared_string &rhs) {
+      return std::string_view(lhs) <=> std::string_view(rhs);
+    }
+
+    template<typename T>
+    requires(std::convertible_to<const T &, std::string_view> &&
+             !std::same_as<T, shared_string>)
+    friend bool operator ==(const shared_string &lhs, const T &rhs) {
+      return std::string_view(lhs) == std::string_view(rhs);
+    }
+    template<typename T>
+    requires(std::convertible_to<const T &, std::string_view> &&
+             !std::same_as<T, shared_string>)
+    friend auto operator <=>(const shared_string &lhs, const T &rhs) {
+      return std::string_view(lhs) <=> std::string_view(rhs);
+    }
+
+    friend std::ostream &
+    operator <<(std::ostream &os, const shared_string &s) {
+      return os << std::string_view(s);
+    }
+  private:
+    static constexpr unsigned char heap_tag = 0xff;
+
+    struct heap_block {
+      std::atomic<size_type> refs;
+      size_type size;
+
+      char * chars() noexcept { return reinterpret_cast<char *>(this + 1); }
+    };
+
+    bool is_inline() const noexcept {
+      return bytes_[inline_capacity] != heap_tag;
+    }
+
+    void set_inline_size(size_type n) noexcept {
+      bytes_[inline_capacity] = static_cast<unsigned char>(n);
+    }
+
+    heap_block * heap_ptr() const noexcept {
+      heap_block *p;
+      std::memcpy(&p, bytes_, sizeof(p));
+      return p;
+    }
+
+    char * allocate(size_type n) {
+      if(n <= inline_capacity) {
+        set_inline_size(n);
+        return reinterpret_cast<char *>(bytes_);
+      }
+
+      void *mem = ::operator new(sizeof(heap_block) + n);
+      auto *p = new(mem) heap_block{{1}, n};
+      std::memcpy(bytes_, &p, sizeof(p));
+      bytes_[inline_capacity] = heap_tag;
+      return p->chars();
+    }
+
+    void deallocate() noexcept {
+      if(is_inline())
+        return;
+      auto *p = heap_ptr();
+      if(p->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        p->~heap_block();
+        ::operator delete(p);
+      }
+    }
+
+    static_assert(sizeof(heap_block *) <= inline_capacity);
+    unsigned char bytes_[inline_capacity + 1];
+  };
+
+  // Already-encoded bencode data, which is written out verbatim when encoding.
+  // This lets you forward parts of a message without decoding and re-encoding
+  // them. A `basic_data` can also hold one of these as a fifth alternative
+  // (see `raw_data`).
+  template<typename String>
+  class basic_raw {
+  public:
+    using string = String;
+
+    basic_raw() = default;
+    explicit basic_raw(String data) : data_(std::move(data)) {}
+
+    template<typename Other>
+    requires(!std::same_as<Other, String>)
+    explicit basic_raw(const basic_raw<Other> &other)
+      : data_(other.data().begin(), other.data().end()) {}
+
+    const String & data() const noexcept { return data_; }
+    std::size_t size() const noexcept { return data_.size(); }
+
+    friend bool operator ==(const basic_raw &, const basic_raw &) = default;
+  private:
+    String data_;
+  };
+
+  using raw = basic_raw<std::string>;
+  using raw_view = basic_raw<std::string_view>;
+
+  namespace detail {
+    template<typename ...T>
+    struct raw_alternative {
+      using type = void;
+    };
+
+    template<typename T>
+    struct raw_alternative<T> {
+      using type = T;
+    };
+  } // namespace detail
+
+#define BENCODE_DATA_GETTER(func, impl, arg_type, container_type)             \
+  basic_data & func(const arg_type &key) & {                                  \
+    return impl<container_type>(*this, key);                                  \
+  }                                                                           \
+  basic_data && func(const arg_type &key) && {                                \
+    return std::move(impl<container_type>(std::move(*this), key));            \
+  }                                                                           \
+  const basic_data & func(const arg_type &key) const & {                      \
+    return impl<container_type>(*this, key);                                  \
+  }                                                                           \
+  const basic_data && func(const arg_type &key) const && {                    \
+    return std::move(impl<container_type>(std::move(*this), key));            \
+  }
+
+  // A bencode value. If `Raw` is given (e.g. `raw`), it's an additional
+  // alternative holding an already-encoded value.
+  template<template<typename ...> typename Variant, typename I, typename S,
+           template<typename ...> typename L, template<typename ...> typename D,
+           typename ...Raw>
+  class basic_data : public Variant<
+    I, S, L<basic_data<Variant, I, S, L, D, Raw...>>,
+    D<S, basic_data<Variant, I, S, L, D, Raw...>>, Raw...
+  > {
+    static_assert(sizeof...(Raw) <= 1, "only one raw alternative allowed");
+  public:
+    using integer = I;
+    using string = S;
+    using list = L<basic_data>;
+    using dict = D<S, basic_data>;
+    // The raw alternative, or `void` if there isn't one.
+    using raw = typename detail::raw_alternative<Raw...>::type;
+
+    using base_type = Variant<integer, string, list, dict, Raw...>;
+    using base_type::base_type;
+
+    base_type & base() & { return *this; }
+    base_type && base() && { return std::move(*this); }
+    const base_type & base() const & { return *this; }
+    const base_type && base() const && { return std::move(*this); }
+
+    // The below wouldn't need macros if we had "deducing `this`"...
+    BENCODE_DATA_GETTER(at,          at_impl,    integer, list)
+    BENCODE_DATA_GETTER(at,          at_impl,    string,  dict)
+    BENCODE_DATA_GETTER(operator [], index_impl, integer, list)
+    BENCODE_DATA_GETTER(operator [], index_impl, string,  dict)
+
+  private:
+    template<typename Type, typename Self, typename Key>
+    static inline decltype(auto) at_impl(Self &&self, Key &&key) {
+      return variant_traits<Variant>::template get<Type>(
+        std::forward<Self>(self)
+      ).at(std::forward<Key>(key));
+    }
+
+    template<typename Type, typename Self, typename Key>
+    static inline decltype(auto) index_impl(Self &&self, Key &&key) {
+      return variant_traits<Variant>::template get<Type>(
+        std::forward<Self>(self)
+      )[std::forward<Key>(key)];
+    }
+  };
+
+  template<typename T>
+  struct variant_traits_for;
+
+  template<template<typename ...> typename Variant,
+           typename I, typename S, template<typename ...> typename L,
+           template<typename ...> typename D, typename ...Raw>
+  struct variant_traits_for<basic_data<Variant, I, S, L, D, Raw...>>
+    : variant_traits<Variant> {};
+
+  template<>
+  struct variant_traits<std::variant> {
+    template<typename Visitor, typename ...Variants>
+    inline static decltype(auto)
+    visit(Visitor &&visitor, Variants &&...variants) {
+      return std::visit(std::forward<Visitor>(visitor),
+                        std::forward<Variants>(variants).base()...);
+    }
+
+    template<typename Type, typename Variant>
+    inline static decltype(auto) get(Variant &&variant) {
+      return std::get<Type>(std::forward<Variant>(variant).base());
+    }
+
+    template<typename Type, typename Variant>
+    inline static decltype(auto) get_if(Variant *variant) {
+      return std::get_if<Type>(&variant->base());
+    }
+
+    template<typename Variant>
+    inline static auto index(const Variant &variant) {
+      return variant.index();
+    }
+  };
+
+  using data = basic_data<std::variant, long long, std::string, std::vector,
+                          map_proxy>;
+  using data_view = basic_data<std::variant, long long, std::string_view,
+                               std::vector, map_proxy>;
+  using hash_data = basic_data<std::variant, long long, std::string,
+                               std::vector, unordered_map_proxy>;
+  using hash_data_view = basic_data<std::variant, long long, std::string_view,
+                                    std::vector, unordered_map_proxy>;
+  using raw_data = basic_data<std::variant, long long, std::string, std::vector,
+                              map_proxy, raw>;
+  using raw_data_view = basic_data<std::variant, long long, std::string_view,
+                                   std::vector, map_proxy, raw_view>;
+
+#ifdef BENCODE_HAS_BOOST
+  template<>
+  struct variant_traits<boost::variant> {
+    template<typename Visitor, typename ...Variants>
+    static decltype(auto)
+    visit(Visitor &&visitor, Variants &&...variants) {
+      return boost::apply_visitor(std::forward<Visitor>(visitor),
+                                  std::forward<Variants>(variants).base()...);
+    }
+
+    template<typename Type, typename Variant>
+    inline static decltype(auto) get(Variant &&variant) {
+      return boost::get<Type>(std::forward<Variant>(variant));
+    }
+
+    template<typename Type, typename Variant>
+    inline static decltype(auto) get_if(Variant *variant) {
+      return boost::get<Type>(variant);
+    }
+
+    template<typename Variant>
+    inline static auto index(const Variant &variant) {
+      return variant.which();
+    }
+  };
+
+  using boost_data = basic_data<boost::variant, long long, std::string,
+                                std::vector, map_proxy>;
+  using boost_data_view = basic_data<boost::variant, long long,
+                                     std::string_view, std::vector, map_proxy>;
+#endif
+
+  // A variant holding exactly the four bencode types. Compared to
+  // `std::variant`, this is never valueless, visits via a switch on a one-byte
+  // index, and packs that index into the byte just past the largest
+  // alternative. When every alternative fits in 15 bytes (as with
+  // `compact_data`), each node is only 16 bytes.
+  template<typename I, typename S, typename L, typename D>
+  class variant {
+    template<std::size_t N>
+    using alternative_t = std::tuple_element_t<N, std::tuple<I, S, L, D>>;
+
+    template<std::size_t N>
+    using index_t = std::integral_constant<std::size_t, N>;
+
+    // Pick the alternative to construct from a `T` via overload resolution,
+    // like `std::variant` does.
+    static index_t<0> select(I);
+    static index_t<1> select(S);
+    static index_t<2> select(L);
+    static index_t<3> select(D);
+
+    template<typename T>
+    static constexpr std::size_t select_v =
+      decltype(select(std::declval<T>()))::value;
+
+    template<typename T>
+    static constexpr bool converting_v = requires {
+      requires !std::is_base_of_v<variant, std::remove_cvref_t<T>>;
+      select(std::declval<T>());
+    };
+  public:
+    using index_type = unsigned char;
+
+    // Construction/assignment
+    variant() noexcept(std::is_nothrow_default_constructible_v<I>) {
+      construct<0>();
+    }
+
+    template<typename T>
+    requires(converting_v<T>)
+    variant(T &&t) {
+      construct<select_v<T>>(std::forward<T>(t));
+    }
+
+    variant(const variant &rhs) {
+      dispatch(rhs, [this]<std::size_t N>(index_t<N>, const auto &value) {
+        construct<N>(value);
+      });
+    }
+
+    variant(variant &&rhs) noexcept {
+      dispatch(std::move(rhs), [this]<std::size_t N>(index_t<N>, auto &&value) {
+        construct<N>(std::move(value));
+      });
+    }
+
+    ~variant() { destroy(); }
+
+    variant & operator =(const variant &rhs) {
+      if(this != &rhs)
+        *this = variant(rhs);
+      return *this;
+    }
+
+    variant & operator =(variant &&rhs) noexcept {
+      if(this == &rhs)
+        return *this;
+      dispatch(std::move(rhs), [this]<std::size_t N>(index_t<N>, auto &&value) {
+        if(index_ == N) {
+          get_unchecked<N>() = std::move(value);
+        } else {
+          destroy();
+          construct<N>(std::move(value));
+        }
+      });
+      return *this;
+    }
+
+    template<typename T>
+    requires(converting_v<T>)
+    variant & operator =(T &&t) {
+      constexpr std::size_t N = select_v<T>;
+      if(index_ == N) {
+        get_unchecked<N>() = std::forward<T>(t);
+      } else {
+        // Construct the new value first so that we never end up without a
+        // value if that throws.
+        alternative_t<N> value(std::forward<T>(t));
+        destroy();
+        construct<N>(std::move(value));
+      }
+      return *this;
+    }
+
+    // Observers
+    index_type index() const noexcept { return index_; }
+
+    template<typename T>
+    bool holds_alternative() const noexcept {
+      return index_ == index_of<T>();
+    }
+
+    // Element access
+    template<typename T>
+    T & get() & { return checked_get<T>(*this); }
+    template<typename T>
+    const T & get() const & { return checked_get<T>(*this); }
+    template<typename T>
+    T && get() && { return std::move(checked_get<T>(*this)); }
+    template<typename T>
+    const T && get() const && { return std::move(checked_get<T>(*this)); }
+
+    template<typename T>
+    T * get_if() noexcept {
+      return holds_alternative<T>() ?
+             &get_unchecked<index_of<T>()>() : nullptr;
+    }
+    template<typename T>
+    const T * get_if() const noexcept {
+      return holds_alternative<T>() ?
+             &get_unchecked<index_of<T>()>() : nullptr;
+    }
+
+    template<typename Visitor, typename Self>
+    static decltype(auto) visit(Visitor &&visitor, Self &&self) {
+      return dispatch(std::forward<Self>(self), [&visitor](auto, auto &&value)
+                      -> decltype(auto) {
+        return std::forward<Visitor>(visitor)(
+          std::forward<decltype(value)>(value)
+        );
+      });
+    }
+
+    friend bool operator ==(const variant &lhs, const variant &rhs) {
+      if(lhs.index_ != rhs.index_)
+        return false;
+      return dispatch(lhs, [&rhs]<std::size_t N>(index_t<N>, const auto &v) {
+        return v == rhs.template get_unchecked<N>();
+      });
+    }
+  private:
+    template<typename T>
+    static consteval std::size_t index_of() {
+      if constexpr(std::is_same_v<T, I>)
+        return 0;
+      else if constexpr(std::is_same_v<T, S>)
+        return 1;
+      else if constexpr(std::is_same_v<T, L>)
+        return 2;
+      else {
+        static_assert(std::is_same_v<T, D>, "type is not an alternative");
+        return 3;
+      }
+    }
+
+    template<std::size_t N>
+    alternative_t<N> & get_unchecked() noexcept {
+      return *std::launder(reinterpret_cast<alternative_t<N> *>(storage_));
+    }
+    template<std::size_t N>
+    const alternative_t<N> & get_unchecked() const noexcept {
+      return *std::launder(
+        reinterpret_cast<const alternative_t<N> *>(storage_)
+      );
+    }
+
+    template<typename T, typename Self>
+    static auto & checked_get(Self &self) {
+      if(!self.template holds_alternative<T>())
+        throw std::bad_variant_access();
+      return self.template get_unchecked<index_of<T>()>();
+    }
+
+    // Call `f(index_t<N>{}, value)` with the currently-held value, preserving
+    // the value category of `self`. This is a plain switch, so compilers emit
+    // a jump table rather than a table of function pointers.
+    template<typename Self, typename F>
+    static decltype(auto) dispatch(Self &&self, F &&f) {
+      switch(self.index_) {
+      case 0:
+        return f(index_t<0>{}, forward_alternative<Self, 0>(self));
+      case 1:
+        return f(index_t<1>{}, forward_alternative<Self, 1>(self));
+      case 2:
+        return f(index_t<2>{}, forward_alternative<Self, 2>(self));
+      default:
+        assert(self.index_ == 3);
+        return f(index_t<3>{}, forward_alternative<Self, 3>(self));
+      }
+    }
+
+    template<typename Self, std::size_t N>
+    static decltype(auto) forward_alternative(auto &self) noexcept {
+      if constexpr(std::is_lvalue_reference_v<Self>)
+        return self.template get_unchecked<N>();
+      else
+        return std::move(self.template get_unchecked<N>());
+    }
+
+    template<std::size_t N, typename ...Args>
+    void construct(Args &&...args) {
+      ::new(static_cast<void *>(storage_)) alternative_t<N>(
+        std::forward<Args>(args)...
+      );
+      index_ = N;
+    }
+
+    void destroy() noexcept {
+      dispatch(*this, []<typename T>(auto, T &value) {
+        value.~T();
+      });
+    }
+
+    alignas(I) alignas(S) alignas(L) alignas(D)
+    unsigned char storage_[std::max({sizeof(I), sizeof(S), sizeof(L),
+                                     sizeof(D)})];
+    index_type index_;
+  };
+
+  template<typename T, typename I, typename S, typename L, typename D>
+  inline decltype(auto) get(variant<I, S, L, D> &v) {
+    return v.template get<T>();
+  }
+  template<typename T, typename I, typename S, typename L, typename D>
+  inline decltype(auto) get(const variant<I, S, L, D> &v) {
+    return v.template get<T>();
+  }
+  template<typename T, typename I, typename S, typename L, typename D>
+  inline decltype(auto) get(variant<I, S, L, D> &&v) {
+    return std::move(v).template get<T>();
+  }
+
+  template<typename T, typename I, typename S, typename L, typename D>
+  inline auto get_if(variant<I, S, L, D> *v) noexcept {
+    return v->template get_if<T>();
+  }
+  template<typename T, typename I, typename S, typename L, typename D>
+  inline auto get_if(const variant<I, S, L, D> *v) noexcept {
+    return v->template get_if<T>();
+  }
+
+  template<typename T, typename I, typename S, typename L, typename D>
+  inline bool
+  holds_alternative(const variant<I, S, L, D> &v) noexcept {
+    return v.template holds_alternative<T>();
+  }
+
+  template<typename Visitor, typename I, typename S, typename L, typename D>
+  inline decltype(auto) visit(Visitor &&visitor, variant<I, S, L, D> &v) {
+    return v.visit(std::forward<Visitor>(visitor), v);
+  }
+  template<typename Visitor, typename I, typename S, typename L, typename D>
+  inline decltype(auto)
+  visit(Visitor &&visitor, const variant<I, S, L, D> &v) {
+    return v.visit(std::forward<Visitor>(visitor), v);
+  }
+  template<typename Visitor, typename I, typename S, typename L, typename D>
+  inline decltype(auto) visit(Visitor &&visitor, variant<I, S, L, D> &&v) {
+    return v.visit(std::forward<Visitor>(visitor), std::move(v));
+  }
+
+  template<>
+  struct variant_traits<variant> {
+    template<typename Visitor, typename Variant>
+    inline static decltype(auto) visit(Visitor &&visitor, Variant &&variant) {
+      using Base = decltype(std::forward<Variant>(variant).base());
+      return std::remove_cvref_t<Base>::visit(
+        std::forward<Visitor>(visitor), std::forward<Variant>(variant).base()
+      );
+    }
+
+    template<typename Type, typename Variant>
+    inline static decltype(auto) get(Variant &&variant) {
+      return std::forward<Variant>(variant).base().template get<Type>();
+    }
+
+    template<typename Type, typename Variant>
+    inline static decltype(auto) get_if(Variant *variant) {
+      return variant->base().template get_if<Type>();
+    }
+
+    template<typename Variant>
+    inline static auto index(const Variant &variant) {
+      return variant.index();
+    }
+  };
+
+  using fast_data = basic_data<variant, long long, std::string, std::vector,
+                               map_proxy>;
+  using fast_data_view = basic_data<variant, long long, std::string_view,
+                                    std::vector, map_proxy>;
+  using compact_data = basic_data<variant, long long, compact_string,
+                                  list_proxy, map_proxy>;
+  using shared_data = basic_data<variant, long long, shared_string,
+                                 shared_list_proxy, shared_map_proxy>;
+
+  using integer = data::integer;
+  using string = data::string;
+  using list = data::list;
+  using dict = data::dict;
+
+  using integer_view = data_view::integer;
+  using string_view = data_view::string;
+  using list_view = data_view::list;
+  using dict_view = data_view::dict;
+
+  enum eof_behavior {
+    check_eof,
+    no_check_eof
+  };
+
+  // A tag for decoding input that's known to be valid, such as data you
+  // encoded yourself. This skips checks for duplicate keys and integer
+  // overflow, as well as any `decode_limits`, but still won't read outside of
+  // the input.
+  struct trusted_t {
+    explicit trusted_t() = default;
+  };
+  inline constexpr trusted_t trusted{};
+
+  struct syntax_error : std::runtime_error {
+    using std::runtime_error::runtime_error;
+  };
+
+  struct end_of_input_error : syntax_error {
+    end_of_input_error() : syntax_error("unexpected end of input") {}
+  };
+
+  struct limit_error : std::runtime_error {
+    using std::runtime_error::runtime_error;
+  };
+
+  // Limits to enforce when decoding untrusted input. By default, everything
+  // is unlimited.
+  struct decode_limits {
+    static constexpr std::size_t unlimited =
+      (std::numeric_limits<std::size_t>::max)();
+
+    // The maximum nesting depth of lists and dicts.
+    std::size_t max_depth = unlimited;
+    // The maximum length of any string, including dict keys.
+    std::size_t max_string_length = unlimited;
+    // The maximum number of values (not including dict keys).
+    std::size_t max_nodes = unlimited;
+    // The maximum number of bytes of input to read.
+    std::size_t max_bytes = unlimited;
+    // The maximum number of entries in any dict.
+    std::size_t max_dict_size = unlimited;
+  };
+
+  class decode_error : public std::runtime_error {
+  public:
+    decode_error(std::string message, std::size_t offset,
+                 std::exception_ptr e = {})
+      : runtime_error(message + ", at offset " + std::to_string(offset)),
+        offset_(offset), nested_(e) {}
+
+    [[noreturn]] void rethrow_nested() const {
+      if(nested_)
+        std::rethrow_exception(nested_);
+      std::terminate();
+    }
+
+    std::exception_ptr nested_ptr() const noexcept {
+      return nested_;
+    }
+
+    std::size_t offset() const noexcept {
+      return offset_;
+    }
+  private:
+    std::size_t offset_;
+    std::exception_ptr nested_;
+  };
+
+  enum class decode_errc {
+    ok = 0,
+    unexpected_end_of_input,
+    unexpected_type_token,
+    unexpected_e_token,
+    expected_e_token,
+    expected_colon_token,
+    expected_string_start_token,
+    extraneous_character,
+    duplicated_key,
+    integer_overflow,
+    integer_underflow,
+    expected_unsigned_integer,
+    depth_limit_exceeded,
+    string_length_limit_exceeded,
+    node_limit_exceeded,
+    byte_limit_exceeded,
+    dict_size_limit_exceeded
+  };
+
+  inline const char * error_message(decode_errc code) noexcept {
+    switch(code) {
+    case decode_errc::ok:
+      return "success";
+    case decode_errc::unexpected_end_of_input:
+      return "unexpected end of input";
+    case decode_errc::unexpected_type_token:
+      return "unexpected type token";
+    case decode_errc::unexpected_e_token:
+      return "unexpected 'e' token";
+    case decode_errc::expected_e_token:
+      return "expected 'e' token";
+    case decode_errc::expected_colon_token:
+      return "expected ':' token";
+    case decode_errc::expected_string_start_token:
+      return "expected string start token for dict key";
+    case decode_errc::extraneous_character:
+      return "extraneous character";
+    case decode_errc::duplicated_key:
+      return "duplicated key in dict";
+    case decode_errc::integer_overflow:
+      return "integer overflow";
+    case decode_errc::integer_underflow:
+      return "integer underflow";
+    case decode_errc::expected_unsigned_integer:
+      return "expected unsigned integer";
+    case decode_errc::depth_limit_exceeded:
+      return "maximum nesting depth exceeded";
+    case decode_errc::string_length_limit_exceeded:
+      return "maximum string length exceeded";
+    case decode_errc::node_limit_exceeded:
+      return "maximum number of nodes exceeded";
+    case decode_errc::byte_limit_exceeded:
+      return "maximum input size exceeded";
+    case decode_errc::dict_size_limit_exceeded:
+      return "maximum dict size exceeded";
+    }
+    return "unknown error";
+  }
+
+  enum class node_kind {
+    integer,
+    string,
+    list,
+    dict
+  };
+
+  // The phases of decoding a message: `prescan` counts the elements of each
+  // list (only if the decoder is set to reserve space for lists), and `build`
+  // decodes the message into its value.
+  enum class decode_phase {
+    prescan,
+    build
+  };
+
+  // An observer is notified of what the decoder (or encoder) is doing, for
+  // instrumentation. Each of its member functions is called at the
+  // corresponding point:
+  //   * `begin_decode()` and `end_decode(bytes, error)` around each message
+  //   * `phase(phase)` at the start of each phase of decoding a message
+  //   * `node(kind, depth)` for each value decoded
+  //   * `string(length, copied)` for each string (including dict keys),
+  //     where `copied` is false if the string is a view of the input
+  //   * `dict_insert()` for each element added to a dict
+  //   * `allocation(bytes)` for each heap allocation the decoder can see
+  //     itself making: new dict nodes, and growing the storage of lists and
+  //     strings that have a `capacity()`
+  //   * `begin_encode()` and `end_encode(bytes)` around each encoding
+  template<typename T>
+  concept observer = requires(T &o, std::size_t n, decode_errc ec,
+                              decode_phase p, node_kind k, bool b) {
+    o.begin_decode();
+    o.end_decode(n, ec);
+    o.phase(p);
+    o.node(k, n);
+    o.string(n, b);
+    o.dict_insert();
+    o.allocation(n);
+    o.begin_encode();
+    o.end_encode(n);
+  };
+
+  // An observer that does nothing. This is the default, and compiles away
+  // entirely.
+  struct null_observer {
+    void begin_decode() noexcept {}
+    void end_decode(std::size_t, decode_errc) noexcept {}
+    void phase(decode_phase) noexcept {}
+    void node(node_kind, std::size_t) noexcept {}
+    void string(std::size_t, bool) noexcept {}
+    void dict_insert() noexcept {}
+    void allocation(std::size_t) noexcept {}
+    void begin_encode() noexcept {}
+    void end_encode(std::size_t) noexcept {}
+  };
+
+  // A histogram of non-negative values, with power-of-two buckets: bucket 0
+  // holds 0, and bucket `i` holds values in [2^(i-1), 2^i).
+  class histogram {
+  public:
+    static constexpr std::size_t buckets =
+      std::numeric_limits<std::uint64_t>::digits + 1;
+
+    void record(std::uint64_t value) noexcept {
+      counts_[std::bit_width(value)]++;
+      count_++;
+      sum_ += value;
+      max_ = (std::max)(max_, value);
+    }
+
+    std::uint64_t count() const noexcept { return count_; }
+    std::uint64_t sum() const noexcept { return sum_; }
+    std::uint64_t max() const noexcept { return max_; }
+    std::uint64_t bucket(std::size_t i) const { return counts_.at(i); }
+
+    // The smallest value that's at least the given fraction of all recorded
+    // values, rounded up to the top of its bucket.
+    std::uint64_t quantile(double q) const noexcept {
+      auto target = static_cast<std::uint64_t>(q * count_);
+      std::uint64_t seen = 0;
+      for(std::size_t i = 0; i != buckets; i++) {
+        seen += counts_[i];
+        if(seen > target || (seen == count_ && counts_[i]))
+          return i == 0 ? 0 : (std::min)(max_, (std::uint64_t(2) << (i - 1)) -
+                                               1);
+      }
+      return 0;
+    }
+
+    // Write the non-empty buckets, one per line, as "[low, high): count".
+    friend std::ostream & operator <<(std::ostream &os, const histogram &h) {
+      for(std::size_t i = 0; i != buckets; i++) {
+        if(!h.counts_[i])
+          continue;
+        std::uint64_t low = i == 0 ? 0 : std::uint64_t(1) << (i - 1);
+        os << "[" << low << ", ";
+        if(i == buckets - 1)
+          os << "inf";
+        else
+          os << (std::uint64_t(1) << i);
+        os << "): " << h.counts_[i] << "\n";
+      }
+      return os;
+    }
+  private:
+    std::array<std::uint64_t, buckets> counts_ = {};
+    std::uint64_t count_ = 0, sum_ = 0, max_ = 0;
+  };
+
+  // An observer that totals up what it sees, both for the most recent
+  // message and across all messages, and keeps histograms of per-message
+  // sizes and timings.
+  class stats_observer {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    struct counters {
+      std::uint64_t messages = 0;
+      std::uint64_t errors = 0;
+      std::uint64_t bytes = 0;
+      std::uint64_t nodes[4] = {};
+      std::uint64_t max_depth = 0;
+      std::uint64_t string_bytes_copied = 0;
+      std::uint64_t string_bytes_viewed = 0;
+      std::uint64_t dict_inserts = 0;
+      std::uint64_t allocations = 0;
+      std::uint64_t allocated_bytes = 0;
+      std::uint64_t encodes = 0;
+      std::uint64_t encoded_bytes = 0;
+      clock::duration decode_time = {};
+      clock::duration phase_times[2] = {};
+      clock::duration encode_time = {};
+
+      std::uint64_t node_count(node_kind k) const noexcept {
+        return nodes[static_cast<std::size_t>(k)];
+      }
+
+      std::uint64_t node_count() const noexcept {
+        return nodes[0] + nodes[1] + nodes[2] + nodes[3];
+      }
+
+      clock::duration phase_time(decode_phase p) const noexcept {
+        return phase_times[static_cast<std::size_t>(p)];
+      }
+    };
+
+    // The counters for the most recent message decoded (or encoded).
+    const counters & last() const noexcept { return last_; }
+    // The counters across all messages.
+    const counters & total() const noexcept { return total_; }
+
+    const histogram & message_bytes() const noexcept { return bytes_; }
+    const histogram & message_nodes() const noexcept { return nodes_; }
+    const histogram & message_depth() const noexcept { return depth_; }
+    const histogram & decode_ns() const noexcept { return decode_ns_; }
+    const histogram & encode_ns() const noexcept { return encode_ns_; }
+
+    void reset() noexcept { *this = stats_observer(); }
+
+    void begin_decode() noexcept {
+      last_ = counters();
+      phase_ = no_phase;
+      start_ = clock::now();
+    }
+
+    void end_decode(std::size_t bytes, decode_errc ec) noexcept {
+      auto now = clock::now();
+      end_phase(now);
+      last_.decode_time = now - start_;
+      last_.messages = 1;
+      last_.errors = ec != decode_errc::ok;
+      last_.bytes = bytes;
+
+      bytes_.record(bytes);
+      nodes_.record(last_.node_count());
+      depth_.record(last_.max_depth);
+      decode_ns_.record(nanoseconds(last_.decode_time));
+      accumulate();
+    }
+
+    void node(node_kind kind, std::size_t depth) noexcept {
+      last_.nodes[static_cast<std::size_t>(kind)]++;
+      last_.max_depth = (std::max<std::uint64_t>)(last_.max_depth, depth);
+    }
+
+    void string(std::size_t length, bool copied) noexcept {
+      (copied ? last_.string_bytes_copied : last_.string_bytes_viewed) +=
+        length;
+    }
+
+    void phase(decode_phase p) noexcept {
+      auto now = clock::now();
+      end_phase(now);
+      phase_ = static_cast<std::size_t>(p);
+      phase_start_ = now;
+    }
+
+    void dict_insert() noexcept { last_.dict_inserts++; }
+
+    void allocation(std::size_t bytes) noexcept {
+      last_.allocations++;
+      last_.allocated_bytes += bytes;
+    }
+
+    void begin_encode() noexcept {
+      last_ = counters();
+      start_ = clock::now();
+    }
+
+    void end_encode(std::size_t bytes) noexcept {
+      last_.encode_time = clock::now() - start_;
+      last_.encodes = 1;
+      last_.encoded_bytes = bytes;
+      encode_ns_.record(nanoseconds(last_.encode_time));
+      accumulate();
+    }
+  private:
+    static constexpr std::size_t no_phase = -1;
+
+    static std::uint64_t nanoseconds(clock::duration d) noexcept {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+    }
+
+    void end_phase(clock::time_point now) noexcept {
+      if(phase_ != no_phase)
+        last_.phase_times[phase_] += now - phase_start_;
+      phase_ = no_phase;
+    }
+
+    void accumulate() noexcept {
+      total_.messages += last_.messages;
+      total_.errors += last_.errors;
+      total_.bytes += last_.bytes;
+      for(std::size_t i = 0; i != 4; i++)
+        total_.nodes[i] += last_.nodes[i];
+      total_.max_depth = (std::max)(total_.max_depth, last_.max_depth);
+      total_.string_bytes_copied += last_.string_bytes_copied;
+      total_.string_bytes_viewed += last_.string_bytes_viewed;
+      total_.dict_inserts += last_.dict_inserts;
+      total_.allocations += last_.allocations;
+      total_.allocated_bytes += last_.allocated_bytes;
+      total_.encodes += last_.encodes;
+      total_.encoded_bytes += last_.encoded_bytes;
+      total_.decode_time += last_.decode_time;
+      for(std::size_t i = 0; i != 2; i++)
+        total_.phase_times[i] += last_.phase_times[i];
+      total_.encode_time += last_.encode_time;
+    }
+
+    counters last_, total_;
+    histogram bytes_, nodes_, depth_, decode_ns_, encode_ns_;
+    clock::time_point start_, phase_start_;
+    std::size_t phase_ = no_phase;
+  };
+
+  namespace detail {
+    // Build the exception that the throwing decode functions report for
+    // `code`. `detail` is appended to the message if it's non-empty.
+    inline decode_error make_decode_error(decode_errc code, std::size_t offset,
+                                          std::string_view detail = {}) {
+      std::string message = error_message(code);
+      if(!detail.empty()) {
+        message += ": ";
+        message += detail;
+      }
+
+      std::exception_ptr nested;
+      switch(code) {
+      case decode_errc::unexpected_end_of_input:
+        nested = std::make_exception_ptr(end_of_input_error());
+        break;
+      case decode_errc::integer_overflow:
+        nested = std::make_exception_ptr(std::overflow_error(message));
+        break;
+      case decode_errc::integer_underflow:
+      case decode_errc::expected_unsigned_integer:
+        nested = std::make_exception_ptr(std::underflow_error(message));
+        break;
+      case decode_errc::depth_limit_exceeded:
+      case decode_errc::string_length_limit_exceeded:
+      case decode_errc::node_limit_exceeded:
+      case decode_errc::byte_limit_exceeded:
+      case decode_errc::dict_size_limit_exceeded:
+        nested = std::make_exception_ptr(limit_error(message));
+        break;
+      default:
+        nested = std::make_exception_ptr(syntax_error(message));
+        break;
+      }
+      return decode_error(std::move(message), offset, nested);
+    }
+  } // namespace detail
+
+  // The reason a call to one of the `try_decode` functions failed. This is
+  // cheap to create; the human-readable message is only built on request.
+  class decode_failure {
+  public:
+    decode_failure() noexcept = default;
+    decode_failure(decode_errc code, std::size_t offset) noexcept
+      : code_(code), offset_(offset) {}
+
+    decode_errc code() const noexcept {
+      return code_;
+    }
+
+    std::size_t offset() const noexcept {
+      return offset_;
+    }
+
+    std::string message() const {
+      return error_message(code_) + std::string(", at offset ") +
+             std::to_string(offset_);
+    }
+
+    [[noreturn]] void raise() const {
+      throw detail::make_decode_error(code_, offset_);
+    }
+  private:
+    decode_errc code_ = decode_errc::ok;
+    std::size_t offset_ = 0;
+  };
+
+  // The result of one of the `try_decode` functions: either the decoded data
+  // or a `decode_failure`, similar to `std::expected`.
+  template<typename Data>
+  class decode_result {
+  public:
+    using value_type = Data;
+    using error_type = decode_failure;
+
+    decode_result(Data value) : value_(std::move(value)) {}
+    decode_result(decode_failure error) : error_(error) {
+      assert(error.code() != decode_errc::ok);
+    }
+
+    bool has_value() const noexcept {
+      return error_.code() == decode_errc::ok;
+    }
+
+    explicit operator bool() const noexcept {
+      return has_value();
+    }
+
+    Data & value() & { return check(), value_; }
+    const Data & value() const & { return check(), value_; }
+    Data && value() && { return check(), std::move(value_); }
+    const Data && value() const && { return check(), std::move(value_); }
+
+    Data & operator *() & { return value_; }
+    const Data & operator *() const & { return value_; }
+    Data && operator *() && { return std::move(value_); }
+    const Data && operator *() const && { return std::move(value_); }
+    Data * operator ->() { return &value_; }
+    const Data * operator ->() const { return &value_; }
+
+    const decode_failure & error() const noexcept {
+      return error_;
+    }
+  private:
+    void check() const {
+      if(!has_value())
+        error_.raise();
+    }
+
+    Data value_;
+    decode_failure error_;
+  };
+
+  namespace detail {
+    struct path_segment {
+      enum class kind_type { key, wildcard, range };
+
+      kind_type kind;
+      std::string key = {};
+      // The list indices this segment matches, as a half-open range. For a
+      // key, this is empty unless the key is an index.
+      std::size_t first = 0, last = 0;
+
+      bool matches(std::string_view k) const noexcept {
+        return kind == kind_type::wildcard || k == key;
+      }
+
+      bool matches(std::size_t index) const noexcept {
+        return kind == kind_type::wildcard || (first <= index && index < last);
+      }
+    };
+
+    // Parse a list index in a path. As in JSON Pointer, indices can't have
+    // leading zeros.
+    inline bool parse_path_index(std::string_view s, std::size_t &value) {
+      if(s.empty() || (s[0] == '0' && s.size() > 1) ||
+         !std::all_of(s.begin(), s.end(), [](char c) {
+           return std::isdigit(c);
+         }))
+        return false;
+      auto r = std::from_chars(s.data(), s.data() + s.size(), value);
+      return r.ec == std::errc();
+    }
+
+    // Parse a path like "/info/files/*/length" into its segments. As in JSON
+    // Pointer, the empty path refers to the whole document, and "~0" and "~1"
+    // in a segment stand for "~" and "/", respectively. A segment of "*"
+    // matches any dict key or list index, and a segment like "2:5" matches
+    // the list indices in [2, 5) (either bound may be omitted).
+    inline std::vector<path_segment> parse_path(std::string_view path) {
+      std::vector<path_segment> result;
+      if(path.empty())
+        return result;
+      if(path[0] != '/')
+        throw std::invalid_argument("path must be empty or begin with '/'");
+
+      std::size_t pos = 1;
+      while(true) {
+        std::size_t next = (std::min)(path.find('/', pos), path.size());
+        std::string_view segment = path.substr(pos, next - pos);
+        if(segment == "*") {
+          result.push_back({path_segment::kind_type::wildcard});
+        } else {
+          std::string key;
+          for(std::size_t i = 0; i != segment.size(); i++) {
+            if(segment[i] != '~') {
+              key += segment[i];
+            } else if(i + 1 != segment.size() && segment[i + 1] == '0') {
+              key += '~';
+              i++;
+            } else if(i + 1 != segment.size() && segment[i + 1] == '1') {
+              key += '/';
+              i++;
+            } else {
+              throw std::invalid_argument("invalid escape in path");
+            }
+          }
+
+          path_segment seg{path_segment::kind_type::key, std::move(key)};
+          std::string_view k = seg.key;
+          if(auto colon = k.find(':'); colon != k.npos) {
+            std::size_t first = 0;
+            std::size_t last = (std::numeric_limits<std::size_t>::max)();
+            std::string_view lo = k.substr(0, colon), hi = k.substr(colon + 1);
+            if((lo.empty() || parse_path_index(lo, first)) &&
+               (hi.empty() || parse_path_index(hi, last))) {
+              seg.kind = path_segment::kind_type::range;
+              seg.first = first;
+              seg.last = last;
+            }
+          } else if(std::size_t index; parse_path_index(k, index) &&
+                    index != (std::numeric_limits<std::size_t>::max)()) {
+            seg.first = index;
+            seg.last = index + 1;
+          }
+          result.push_back(std::move(seg));
+        }
+
+        if(next == path.size())
+          return result;
+        pos = next + 1;
+      }
+    }
+  } // namespace detail
+
+  // A set of paths (see `detail::parse_path`) to keep when decoding with
+  // `decode_projected`. The paths are compiled into a trie whose states are
+  // the sets of paths that could still match at a given position in the
+  // data. Index ranges aren't supported here, and match only as dict keys.
+  class projection {
+  public:
+    // The state for a subtree that should be kept in its entirety.
+    static constexpr std::size_t all =
+      (std::numeric_limits<std::size_t>::max)();
+    // The state for a subtree that should be skipped.
+    static constexpr std::size_t none = all - 1;
+
+    projection(std::initializer_list<std::string_view> paths) {
+      for(auto &&i : paths)
+        add(i);
+      compile(0);
+    }
+
+    template<std::ranges::input_range Range>
+    explicit projection(const Range &paths) {
+      for(auto &&i : paths)
+        add(std::string_view(i));
+      compile(0);
+    }
+
+    std::size_t root() const noexcept {
+      return nodes_[0].terminal ? all : 0;
+    }
+
+    // Get the state for the element at `key` given the state of its parent.
+    std::size_t child(std::size_t state, std::string_view key) const {
+      if(state == all || state == none)
+        return state;
+
+      auto &node = nodes_[state];
+      std::size_t result = none;
+      if(auto i = node.children.find(key); i != node.children.end())
+        result = i->second;
+      else
+        result = node.wildcard;
+
+      return result != none && nodes_[result].terminal ? all : result;
+    }
+
+    std::size_t child(std::size_t state, std::size_t index) const {
+      if(state == all || state == none)
+        return state;
+
+      char buf[std::numeric_limits<std::size_t>::digits10 + 1];
+      auto r = std::to_chars(buf, buf + sizeof(buf), index);
+      return child(state, std::string_view(buf, r.ptr));
+    }
+  private:
+    struct node {
+      std::map<std::string, std::size_t, std::less<>> children;
+      std::size_t wildcard = none;
+      bool terminal = false;
+    };
+
+    void add(std::string_view path) {
+      if(nodes_.empty())
+        nodes_.emplace_back();
+
+      std::size_t state = 0;
+      for(auto &segment : detail::parse_path(path)) {
+        std::size_t next;
+        if(segment.kind == detail::path_segment::kind_type::wildcard) {
+          next = nodes_[state].wildcard;
+          if(next == none)
+            next = nodes_[state].wildcard = new_node();
+        } else {
+          auto i = nodes_[state].children.find(segment.key);
+          if(i != nodes_[state].children.end()) {
+            next = i->second;
+          } else {
+            next = new_node();
+            nodes_[state].children.emplace(std::move(segment.key), next);
+          }
+        }
+        state = next;
+      }
+      nodes_[state].terminal = true;
+    }
+
+    std::size_t new_node() {
+      nodes_.emplace_back();
+      return nodes_.size() - 1;
+    }
+
+    std::size_t clone(std::size_t from) {
+      std::size_t to = new_node();
+      merge(to, from);
+      return to;
+    }
+
+    // Add everything matched by `from` to `to`.
+    void merge(std::size_t to, std::size_t from) {
+      if(nodes_[from].terminal)
+        nodes_[to].terminal = true;
+
+      // Copy these, since `nodes_` may be reallocated below.
+      auto children = nodes_[from].children;
+      std::size_t wildcard = nodes_[from].wildcard;
+
+      for(auto &[key, i] : children) {
+        auto existing = nodes_[to].children.find(key);
+        if(existing != nodes_[to].children.end()) {
+          merge(existing->second, i);
+        } else {
+          std::size_t c = clone(i);
+          nodes_[to].children.emplace(key, c);
+        }
+      }
+      if(wildcard != none) {
+        if(nodes_[to].wildcard == none) {
+          std::size_t w = clone(wildcard);
+          nodes_[to].wildcard = w;
+        } else {
+          merge(nodes_[to].wildcard, wildcard);
+        }
+      }
+    }
+
+    // Make the trie deterministic: anything matched by a wildcard is also
+    // merged into its sibling keys, so that looking up a key only needs to
+    // fall back to the wildcard if there's no exact match.
+    void compile(std::size_t state) {
+      if(nodes_.empty())
+        nodes_.emplace_back();
+
+      std::size_t wildcard = nodes_[state].wildcard;
+      std::vector<std::size_t> children;
+      for(auto &i : nodes_[state].children)
+        children.push_back(i.second);
+
+      if(wildcard != none) {
+        for(auto i : children)
+          merge(i, wildcard);
+        compile(wildcard);
+      }
+      for(auto i : children)
+        compile(i);
+    }
+
+    std::vector<node> nodes_;
+  };
+
+  // A position within a sequence of input segments.
+  struct segment_position {
+    std::size_t segment = 0;
+    std::size_t offset = 0;
+
+    friend bool
+    operator ==(const segment_position &, const segment_position &) = default;
+  };
+
+  // Owned storage for strings that straddle two or more input segments, and
+  // so can't be viewed directly. Strings are allocated in chunks, which are
+  // never moved, so views into them remain valid until the arena is
+  // destroyed.
+  class string_arena {
+  public:
+    static constexpr std::size_t chunk_size = 4096;
+
+    string_arena() = default;
+
+    string_arena(string_arena &&other) noexcept
+      : chunks_(std::move(other.chunks_)),
+        current_(std::exchange(other.current_, nullptr)),
+        left_(std::exchange(other.left_, 0)),
+        size_(std::exchange(other.size_, 0)) {}
+
+    string_arena & operator =(string_arena &&other) noexcept {
+      chunks_ = std::move(other.chunks_);
+      current_ = std::exchange(other.current_, nullptr);
+      left_ = std::exchange(other.left_, 0);
+      size_ = std::exchange(other.size_, 0);
+      return *this;
+    }
+
+    char * allocate(std::size_t n) {
+      size_ += n;
+      // Give big strings their own chunk so that we don't waste the rest of
+      // the current one.
+      if(n > chunk_size / 4) {
+        chunks_.emplace_back(new char[n]);
+        return chunks_.back().get();
+      }
+
+      if(left_ < n) {
+        chunks_.emplace_back(new char[chunk_size]);
+        current_ = chunks_.back().get();
+        left_ = chunk_size;
+      }
+      char *result = current_;
+      current_ += n;
+      left_ -= n;
+      return result;
+    }
+
+    // The total number of bytes allocated from this arena.
+    std::size_t size() const noexcept {
+      return size_;
+    }
+  private:
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    char *current_ = nullptr;
+    std::size_t left_ = 0;
+    std::size_t size_ = 0;
+  };
+
+  // The result of decoding segmented input: the decoded value, plus the
+  // storage for any strings that had to be copied out of the input.
+  template<typename Data>
+  struct segmented_data {
+    Data value;
+    string_arena arena;
+  };
+
+  // A view-type document along with the single buffer holding all of the
+  // strings it points to.
+  template<typename Data>
+  struct materialized_data {
+    Data value;
+    std::unique_ptr<char[]> buffer;
+  };
+
+  namespace detail {
+    // The total number of bytes in all the strings (including dict keys)
+    // within `node`.
+    template<typename Data>
+    std::size_t string_bytes(const Data &node) {
+      using Traits = variant_traits_for<Data>;
+      return Traits::visit([](const auto &value) -> std::size_t {
+        using T = std::remove_cvref_t<decltype(value)>;
+        if constexpr(std::same_as<T, typename Data::string>) {
+          return std::ranges::size(value);
+        } else if constexpr(std::same_as<T, typename Data::raw>) {
+          return std::ranges::size(value.data());
+        } else if constexpr(std::same_as<T, typename Data::list>) {
+          std::size_t n = 0;
+          for(auto &&i : value)
+            n += string_bytes(i);
+          return n;
+        } else if constexpr(std::same_as<T, typename Data::dict>) {
+          std::size_t n = 0;
+          for(auto &&[key, i] : value)
+            n += std::ranges::size(key) + string_bytes(i);
+          return n;
+        } else {
+          return 0;
+        }
+      }, node);
+    }
+
+    // Convert `node` to an `Out` document, using `make_string` to convert
+    // each string and dict key.
+    template<typename Out, typename In, typename MakeString>
+    Out convert_data(const In &node, MakeString &make_string) {
+      using Traits = variant_traits_for<In>;
+      return Traits::visit([&make_string](const auto &value) -> Out {
+        using T = std::remove_cvref_t<decltype(value)>;
+        if constexpr(std::same_as<T, typename In::string>) {
+          return make_string(value);
+        } else if constexpr(std::same_as<T, typename In::raw>) {
+          return typename Out::raw(make_string(value.data()));
+        } else if constexpr(std::same_as<T, typename In::list>) {
+          typename Out::list result;
+          auto &list = cow_access::container(result);
+          list.reserve(std::ranges::size(value));
+          for(auto &&i : value)
+            list.push_back(convert_data<Out>(i, make_string));
+          return result;
+        } else if constexpr(std::same_as<T, typename In::dict>) {
+          typename Out::dict result;
+          auto &dict = cow_access::container(result);
+          for(auto &&[key, i] : value) {
+            dict.emplace_hint(dict.end(), make_string(key),
+                              convert_data<Out>(i, make_string));
+          }
+          return result;
+        } else {
+          return static_cast<typename Out::integer>(value);
+        }
+      }, node);
+    }
+  } // namespace detail
+
+  // Copy all the strings in `value` into a single buffer, returning a new
+  // view-type document pointing to that buffer. This lets you keep (part of)
+  // a decoded view after its input has been destroyed, with one allocation
+  // for all the strings.
+  template<typename Data>
+  materialized_data<Data> materialize(const Data &value) {
+    using String = typename Data::string;
+
+    materialized_data<Data> result;
+    result.buffer.reset(new char[detail::string_bytes(value)]);
+    char *next = result.buffer.get();
+    auto make_string = [&next](const auto &s) {
+      auto n = std::ranges::size(s);
+      std::copy_n(std::ranges::data(s), n, next);
+      next += n;
+      return String(next - n, n);
+    };
+    result.value = detail::convert_data<Data>(value, make_string);
+    return result;
+  }
+
+  // Get a view-type document of `View` pointing to the strings in `value`.
+  template<typename View, typename Data>
+  View basic_to_view(const Data &value) {
+    auto make_string = [](const auto &s) {
+      return typename View::string(std::ranges::data(s), std::ranges::size(s));
+    };
+    return detail::convert_data<View>(value, make_string);
+  }
+
+  inline data_view to_view(const data &value) {
+    return basic_to_view<data_view>(value);
+  }
+
+  inline fast_data_view to_view(const fast_data &value) {
+    return basic_to_view<fast_data_view>(value);
+  }
+
+  inline raw_data_view to_view(const raw_data &value) {
+    return basic_to_view<raw_data_view>(value);
+  }
+
+  // An estimate of the memory used by a document, by category. Each heap
+  // allocation is counted at the size requested; whatever the allocator
+  // likely reserves beyond that is counted in `allocator_slack`.
+  struct memory_footprint {
+    // The values themselves: the root, and each list element and dict value.
+    std::size_t node_storage = 0;
+    // The contents of strings (including dict keys) stored on the heap.
+    std::size_t string_payload = 0;
+    // Unused list capacity, and the parts of dicts outside their nodes.
+    std::size_t container_overhead = 0;
+    // The rest of each dict node: its links, its key, and any padding.
+    std::size_t dict_node_overhead = 0;
+    // Rounding and bookkeeping added to each allocation by the allocator.
+    std::size_t allocator_slack = 0;
+
+    std::size_t total() const noexcept {
+      return node_storage + string_payload + container_overhead +
+             dict_node_overhead + allocator_slack;
+    }
+  };
+
+  namespace detail {
+    // Estimate the number of bytes the allocator reserves for a request of
+    // `n` bytes. This models common 64-bit allocators (such as glibc's): one
+    // word of bookkeeping, rounded up to a multiple of two words, and at
+    // least four words.
+    constexpr std::size_t allocation_size(std::size_t n) noexcept {
+      constexpr std::size_t word = sizeof(void *), align = 2 * word;
+      if(n == 0)
+        return 0;
+      return (std::max)(4 * word, (n + word + align - 1) & ~(align - 1));
+    }
+
+    // The layouts of the nodes allocated by std::map and std::unordered_map.
+    // The latter also stores each key's hash in its node if `CacheHash` is
+    // set (see `caches_hash`).
+    template<typename Value>
+    struct tree_node {
+      int color;
+      void *links[3];
+      Value value;
+    };
+
+    template<typename Value, bool CacheHash>
+    struct hash_node {
+      void *next;
+      Value value;
+      std::size_t hash;
+    };
+
+    template<typename Value>
+    struct hash_node<Value, false> {
+      void *next;
+      Value value;
+    };
+
+    template<typename Hash>
+    constexpr bool slow_std_hash = false;
+
+    template<typename Char, typename Traits, typename Alloc>
+    constexpr bool
+    slow_std_hash<std::hash<std::basic_string<Char, Traits, Alloc>>> = true;
+
+    template<typename Char, typename Traits>
+    constexpr bool
+    slow_std_hash<std::hash<std::basic_string_view<Char, Traits>>> = true;
+
+    // Whether std::unordered_map caches hashes in its nodes. libstdc++ does
+    // unless the hasher is noexcept and fast, which it assumes of every
+    // hasher but the standard ones for strings; so `string_hash` isn't
+    // cached, even though hashing a string isn't cheap.
+    template<typename Hash, typename Key>
+    constexpr bool caches_hash = slow_std_hash<Hash> ||
+      !std::is_nothrow_invocable_v<const Hash &, const Key &>;
+
+    template<typename String>
+    std::size_t string_heap_size(const String &s) {
+      if constexpr(std::ranges::view<String>) {
+        return 0;
+      } else {
+        // Short strings are stored inline, with no heap allocation.
+        static const std::size_t inline_capacity = String().capacity();
+        if(s.capacity() <= inline_capacity)
+          return 0;
+        return (s.capacity() + 1) * sizeof(typename String::value_type);
+      }
+    }
+
+    // The size of each node a dict allocates.
+    template<typename Dict>
+    constexpr std::size_t dict_node_size() noexcept {
+      using value_type = typename Dict::value_type;
+      if constexpr(requires { typename Dict::hasher; }) {
+        return sizeof(hash_node<value_type, caches_hash<
+          typename Dict::hasher, typename Dict::key_type
+        >>);
+      } else
+        return sizeof(tree_node<value_type>);
+    }
+
+    inline void
+    add_allocation(memory_footprint &m, std::size_t &category, std::size_t n) {
+      category += n;
+      m.allocator_slack += allocation_size(n) - n;
+    }
+
+    // Add the memory reachable from `node` (but not `node` itself) to `m`.
+    template<typename Data>
+    void add_memory_usage(memory_footprint &m, const Data &node) {
+      using Traits = variant_traits_for<Data>;
+      Traits::visit([&m](const auto &value) {
+        using T = std::remove_cvref_t<decltype(value)>;
+        if constexpr(std::same_as<T, typename Data::string>) {
+          add_allocation(m, m.string_payload, string_heap_size(value));
+        } else if constexpr(std::same_as<T, typename Data::raw>) {
+          add_allocation(m, m.string_payload, string_heap_size(value.data()));
+        } else if constexpr(std::same_as<T, typename Data::list>) {
+          m.node_storage += value.size() * sizeof(Data);
+          m.container_overhead += (value.capacity() - value.size()) *
+                                  sizeof(Data);
+          auto n = value.capacity() * sizeof(Data);
+          m.allocator_slack += allocation_size(n) - n;
+          for(auto &&i : value)
+            add_memory_usage(m, i);
+        } else if constexpr(std::same_as<T, typename Data::dict>) {
+          using map_type = typename T::map_type;
+
+          constexpr std::size_t node_size = dict_node_size<T>();
+          add_allocation(m, m.container_overhead, sizeof(map_type));
+          if constexpr(requires { typename T::hasher; }) {
+            // A table with only one bucket stores it inline.
+            if(value->bucket_count() > 1) {
+              add_allocation(m, m.container_overhead,
+                             value->bucket_count() * sizeof(void *));
+            }
+          }
+
+          for(auto &&[key, i] : value) {
+            m.node_storage += sizeof(Data);
+            m.dict_node_overhead += node_size - sizeof(Data);
+            m.allocator_slack += allocation_size(node_size) - node_size;
+            add_allocation(m, m.string_payload, string_heap_size(key));
+            add_memory_usage(m, i);
+          }
+        }
+      }, node);
+    }
+  } // namespace detail
+
+  // Estimate the memory used by `value`, including `value` itself. This
+  // supports documents whose strings are `std::basic_string`s or views, whose
+  // lists are `std::vector`s, and whose dicts are `map_proxy`s or
+  // `unordered_map_proxy`s, such as `data`, `data_view`, and `boost_data`.
+  template<typename Data>
+  memory_footprint memory_usage(const Data &value) {
+    memory_footprint result;
+    result.node_storage = sizeof(Data);
+    detail::add_memory_usage(result, value);
+    return result;
+  }
+
+  namespace detail {
+    constexpr std::uint64_t hash_mix(std::uint64_t x) noexcept {
+      x ^= x >> 32;
+      x *= 0xd6e8feb86659fd93ull;
+      x ^= x >> 32;
+      x *= 0xd6e8feb86659fd93ull;
+      x ^= x >> 32;
+      return x;
+    }
+
+    constexpr std::uint64_t
+    hash_combine(std::uint64_t seed, std::uint64_t value) noexcept {
+      return hash_mix(seed + 0x9e3779b97f4a7c15ull + value);
+    }
+  } // namespace detail
+
+  namespace detail {
+    // Read `n` (at most 8) bytes as a little-endian integer.
+    inline std::uint64_t load_le(const char *data, std::size_t n) noexcept {
+      std::uint64_t word = 0;
+      if constexpr(std::endian::native == std::endian::little) {
+        std::memcpy(&word, data, n);
+      } else {
+        for(std::size_t i = 0; i != n; i++)
+          word |= std::uint64_t(static_cast<unsigned char>(data[i])) << 8 * i;
+      }
+      return word;
+    }
+
+    // The 64-bit hash behind `hash_bytes`. This is the same on every
+    // platform, so it can be persisted (e.g. as a checksum).
+    inline std::uint64_t
+    hash_bytes64(const char *data, std::size_t n) noexcept {
+      constexpr std::uint64_t c1 = 0x87c37b91114253d5ull,
+                              c2 = 0x4cf5ad432745937full;
+      auto step = [](std::uint64_t h, std::uint64_t word) {
+        h ^= std::rotl(word * c1, 31) * c2;
+        return std::rotl(h, 27) * 5 + 0x52dce729;
+      };
+
+      std::uint64_t h = hash_mix(n);
+      for(; n >= sizeof(std::uint64_t); n -= sizeof(std::uint64_t)) {
+        h = step(h, load_le(data, sizeof(std::uint64_t)));
+        data += sizeof(std::uint64_t);
+      }
+      if(n)
+        h = step(h, load_le(data, n));
+      return hash_mix(h);
+    }
+  } // namespace detail
+
+  // A fast, non-cryptographic hash of a buffer of bytes (e.g. an encoded
+  // message), reading it a word at a time.
+  inline std::size_t hash_bytes(const char *data, std::size_t n) noexcept {
+    return static_cast<std::size_t>(detail::hash_bytes64(data, n));
+  }
+
+  inline std::size_t hash_bytes(std::string_view s) noexcept {
+    return hash_bytes(s.data(), s.size());
+  }
+
+  // Hash the structure and contents of `value`. This is consistent with
+  // `operator ==`: equal documents have equal hashes (including documents
+  // with unordered dicts whose elements are in different orders).
+  template<template<typename ...> typename Variant, typename I, typename S,
+           template<typename ...> typename L, template<typename ...> typename D,
+           typename ...Raw>
+  std::size_t hash(const basic_data<Variant, I, S, L, D, Raw...> &value) {
+    using Data = basic_data<Variant, I, S, L, D, Raw...>;
+    using Traits = variant_traits_for<Data>;
+    auto hash_string = [](const auto &s) -> std::uint64_t {
+      return hash_bytes(reinterpret_cast<const char *>(std::ranges::data(s)),
+                        std::ranges::size(s));
+    };
+
+    return Traits::visit([&hash_string](const auto &v) -> std::size_t {
+      using T = std::remove_cvref_t<decltype(v)>;
+      using detail::hash_combine;
+      if constexpr(std::same_as<T, typename Data::string>) {
+        return hash_combine(1, hash_string(v));
+      } else if constexpr(std::same_as<T, typename Data::raw>) {
+        return hash_combine(4, hash_string(v.data()));
+      } else if constexpr(std::same_as<T, typename Data::list>) {
+        std::uint64_t h = hash_combine(2, std::ranges::size(v));
+        for(auto &&i : v)
+          h = hash_combine(h, hash(i));
+        return h;
+      } else if constexpr(std::same_as<T, typename Data::dict>) {
+        // The elements of unordered dicts are combined commutatively, since
+        // their order doesn't affect equality.
+        constexpr bool ordered = !requires { typename T::hasher; };
+        std::uint64_t h = hash_combine(3, std::ranges::size(v)), sum = 0;
+        for(auto &&[key, i] : v) {
+          auto element = hash_combine(hash_string(key), hash(i));
+          if constexpr(ordered)
+            h = hash_combine(h, element);
+          else
+            sum += element;
+        }
+        return hash_combine(h, sum);
+      } else {
+        return hash_combine(0, static_cast<std::uint64_t>(v));
+      }
+    }, value);
+  }
+
+  namespace detail {
+
+    template<std::integral Integer>
+    inline decode_errc check_overflow(Integer value, Integer digit) {
+      using limits = std::numeric_limits<Integer>;
+      // Wrap `max` in parentheses to work around <windows.h> #defining `max`.
+      if((value > (limits::max)() / 10) ||
+         (value == (limits::max)() / 10 && digit > (limits::max)() % 10))
+        return decode_errc::integer_overflow;
+      return decode_errc::ok;
+    }
+
+    template<std::integral Integer>
+    inline decode_errc check_underflow(Integer value, Integer digit) {
+      using limits = std::numeric_limits<Integer>;
+      // As above, work around <windows.h> #defining `min`.
+      if((value < (limits::min)() / 10) ||
+         (value == (limits::min)() / 10 && digit < (limits::min)() % 10))
+        return decode_errc::integer_underflow;
+      return decode_errc::ok;
+    }
+
+    template<std::integral Integer>
+    inline decode_errc
+    check_over_underflow(Integer value, Integer digit, Integer sgn) {
+      if(sgn == 1)
+        return check_overflow(value, digit);
+      else
+        return check_underflow(value, digit);
+    }
+
+    template<std::integral Integer, std::input_iterator Iter>
+    inline decode_errc
+    decode_digits(Iter &begin, Iter end, Integer &value,
+                  [[maybe_unused]] Integer sgn = 1) {
+      assert(sgn == 1 || (std::is_signed_v<Integer> &&
+                          std::make_signed_t<Integer>(sgn) == -1));
+
+      value = 0;
+
+      // For performance, decode as many digits as we know will fit within an
+      // `Integer` value, and then if there are any more beyond that, do
+      // proper overflow detection.
+      for(int i = 0; i != std::numeric_limits<Integer>::digits10; i++) {
+        if(begin == end)
+          return decode_errc::unexpected_end_of_input;
+        if(!std::isdigit(*begin))
+          return decode_errc::ok;
+
+        if constexpr(std::is_signed_v<Integer>)
+          value = value * 10 + (*begin++ - u8'0') * sgn;
+        else
+          value = value * 10 + (*begin++ - u8'0');
+      }
+      if(begin == end)
+        return decode_errc::unexpected_end_of_input;
+
+      // We're approaching the limits of what `Integer` can hold. Check for
+      // overflow.
+      if(std::isdigit(*begin)) {
+        Integer digit;
+        decode_errc ec;
+        if constexpr(std::is_signed_v<Integer>) {
+          digit = (*begin++ - u8'0') * sgn;
+          ec = check_over_underflow(value, digit, sgn);
+        } else {
+          digit = (*begin++ - u8'0');
+          ec = check_overflow(value, digit);
+        }
+        if(ec != decode_errc::ok)
+          return ec;
+        value = value * 10 + digit;
+      }
+
+      // Still more digits? That's too many!
+      if(begin != end && std::isdigit(*begin)) {
+        if(sgn == 1)
+          return decode_errc::integer_overflow;
+        else
+          return decode_errc::integer_underflow;
+      }
+
+      return decode_errc::ok;
+    }
+
+    // Decode an integer without checking for overflow or malformed digits,
+    // for use with trusted input.
+    template<std::integral Integer, std::input_iterator Iter>
+    decode_errc decode_int_unchecked(Iter &begin, Iter end, Integer &value) {
+      assert(*begin == u8'i');
+      ++begin;
+      bool negative = begin != end && *begin == u8'-';
+      if(negative)
+        ++begin;
+
+      // Accumulate in an unsigned type so that bad input can't cause signed
+      // overflow.
+      using Unsigned = std::make_unsigned_t<Integer>;
+      Unsigned n = 0;
+      while(begin != end && std::isdigit(*begin))
+        n = static_cast<Unsigned>(n * 10u + (*begin++ - u8'0'));
+      if(begin == end)
+        return decode_errc::unexpected_end_of_input;
+      if(*begin != u8'e')
+        return decode_errc::expected_e_token;
+
+      ++begin;
+      value = static_cast<Integer>(negative ? static_cast<Unsigned>(0u - n) :
+                                   n);
+      return decode_errc::ok;
+    }
+
+    template<std::integral Integer, std::input_iterator Iter>
+    decode_errc decode_int(Iter &begin, Iter end, Integer &value) {
+      assert(*begin == u8'i');
+      ++begin;
+      if(begin == end)
+        return decode_errc::unexpected_end_of_input;
+
+      Integer sgn = 1;
+      if(*begin == u8'-') {
+        if constexpr(std::is_unsigned_v<Integer>) {
+          return decode_errc::expected_unsigned_integer;
+        } else {
+          sgn = -1;
+          ++begin;
+        }
+      }
+
+      if(auto ec = decode_digits<Integer>(begin, end, value, sgn);
+         ec != decode_errc::ok)
+        return ec;
+      if(begin == end)
+        return decode_errc::unexpected_end_of_input;
+      if(*begin != u8'e')
+        return decode_errc::expected_e_token;
+
+      ++begin;
+      return decode_errc::ok;
+    }
+
+    // Wraps a non-random-access iterator to count how many elements have been
+    // read, and to make it appear to reach the end of input after `limit`
+    // elements.
+    template<std::input_iterator Iter>
+    class counting_iterator {
+    public:
+      using iterator_concept = std::conditional_t<
+        std::forward_iterator<Iter>, std::forward_iterator_tag,
+        std::input_iterator_tag
+      >;
+      using value_type = std::iter_value_t<Iter>;
+      using difference_type = std::iter_difference_t<Iter>;
+
+      counting_iterator() = default;
+      counting_iterator(Iter iter, std::size_t limit =
+                        (std::numeric_limits<std::size_t>::max)())
+        : iter_(iter), limit_(limit) {}
+
+      decltype(auto) operator *() const { return *iter_; }
+
+      counting_iterator & operator ++() {
+        ++iter_;
+        ++count_;
+        return *this;
+      }
+
+      auto operator ++(int) {
+        if constexpr(std::forward_iterator<Iter>) {
+          auto tmp = *this;
+          ++*this;
+          return tmp;
+        } else {
+          // Like `std::istreambuf_iterator`, hold onto the current value,
+          // since the underlying iterator may not be able to produce it again.
+          struct proxy {
+            value_type value;
+            value_type operator *() const { return value; }
+          };
+          proxy p{*iter_};
+          ++*this;
+          return p;
+        }
+      }
+
+      friend bool
+      operator ==(const counting_iterator &lhs, const counting_iterator &rhs) {
+        return lhs.count_ >= lhs.limit_ || rhs.count_ >= rhs.limit_ ||
+               lhs.iter_ == rhs.iter_;
+      }
+
+      Iter base() const { return iter_; }
+      std::size_t count() const noexcept { return count_; }
+    private:
+      Iter iter_ = Iter();
+      std::size_t count_ = 0;
+      std::size_t limit_ = (std::numeric_limits<std::size_t>::max)();
+    };
+
+    // A stack that holds its first `N` elements inline, so that we only
+    // allocate for deeply-nested data.
+    template<typename T, std::size_t N>
+    class small_stack {
+    public:
+      bool empty() const noexcept { return size_ == 0; }
+      std::size_t size() const noexcept { return size_; }
+
+      T & top() noexcept {
+        assert(size_ != 0);
+        return size_ <= N ? inline_[size_ - 1] : spill_.back();
+      }
+
+      void push(T value) {
+        if(size_ < N)
+          inline_[size_] = std::move(value);
+        else
+          spill_.push_back(std::move(value));
+        ++size_;
+      }
+
+      void pop() noexcept {
+        assert(size_ != 0);
+        if(size_ > N)
+          spill_.pop_back();
+        --size_;
+      }
+
+      void clear() noexcept {
+        spill_.clear();
+        size_ = 0;
+      }
+    private:
+      T inline_[N];
+      std::vector<T> spill_;
+      std::size_t size_ = 0;
+    };
+
+    template<typename String, std::forward_iterator Iter>
+    decode_errc
+    decode_chars(Iter &begin, Iter end, std::size_t len, String &value) {
+      if(std::distance(begin, end) < static_cast<std::ptrdiff_t>(len)) {
+        begin = end;
+        return decode_errc::unexpected_end_of_input;
+      }
+
+      auto orig = begin;
+      std::advance(begin, len);
+      // Prefer `assign` so that we can reuse any storage `value` already has.
+      if constexpr(requires { value.assign(orig, begin); })
+        value.assign(orig, begin);
+      else
+        value = String(orig, begin);
+      return decode_errc::ok;
+    }
+
+    template<typename String, std::input_iterator Iter>
+    inline decode_errc
+    decode_chars(Iter &begin, Iter end, std::size_t len, String &value) {
+      // We can't tell how much input is left, so don't trust `len` enough to
+      // allocate it all up front; instead, grow the string as we go.
+      constexpr std::size_t max_reserve = 64 * 1024;
+      std::string buf;
+      auto &out = [&]() -> auto & {
+        if constexpr(std::is_same_v<String, std::string>)
+          return value;
+        else
+          return buf;
+      }();
+
+      out.clear();
+      out.reserve((std::min)(len, max_reserve));
+      for(std::size_t i = 0; i < len; i++) {
+        if(begin == end)
+          return decode_errc::unexpected_end_of_input;
+        out.push_back(*begin++);
+      }
+
+      if constexpr(!std::is_same_v<String, std::string>)
+        value = String(buf.begin(), buf.end());
+      return decode_errc::ok;
+    }
+
+    template<std::ranges::view String, std::contiguous_iterator Iter>
+    decode_errc
+    decode_chars(Iter &begin, Iter end, std::size_t len, String &value) {
+      if(std::distance(begin, end) < static_cast<std::ptrdiff_t>(len)) {
+        begin = end;
+        return decode_errc::unexpected_end_of_input;
+      }
+
+      value = String(&*begin, len);
+      std::advance(begin, len);
+      return decode_errc::ok;
+    }
+
+    // Get the characters of an input segment, which may be any contiguous
+    // range of `char`s or bytes.
+    template<typename Segment>
+    inline std::string_view segment_chars(const Segment &segment) {
+      return std::string_view(
+        reinterpret_cast<const char *>(std::ranges::data(segment)),
+        std::ranges::size(segment)
+      );
+    }
+
+    // An iterator over the characters of a sequence of input segments. It
+    // also tracks how many characters it's advanced so far, and carries an
+    // arena to copy strings into when they straddle two segments.
+    template<std::ranges::random_access_range Segments>
+    class segment_iterator {
+    public:
+      using iterator_concept = std::forward_iterator_tag;
+      using iterator_category = std::forward_iterator_tag;
+      using value_type = char;
+      using difference_type = std::ptrdiff_t;
+      using pointer = const char *;
+      using reference = const char &;
+
+      segment_iterator() = default;
+      segment_iterator(const Segments &segments, segment_position pos,
+                       string_arena &arena)
+        : segments_(&segments), arena_(&arena), segment_(pos.segment) {
+        std::size_t num_segments = std::ranges::size(segments);
+        if(segment_ < num_segments) {
+          auto chars = current_chars();
+          if(pos.offset > chars.size())
+            throw std::out_of_range("invalid segment offset");
+          ptr_ = chars.data() + pos.offset;
+          end_ = chars.data() + chars.size();
+          if(ptr_ == end_)
+            next_segment();
+        } else if(segment_ > num_segments || pos.offset != 0) {
+          throw std::out_of_range("invalid segment position");
+        }
+      }
+
+      reference operator *() const {
+        return *ptr_;
+      }
+
+      segment_iterator & operator ++() {
+        ++ptr_;
+        ++count_;
+        if(ptr_ == end_)
+          next_segment();
+        return *this;
+      }
+
+      segment_iterator operator ++(int) {
+        auto old = *this;
+        ++*this;
+        return old;
+      }
+
+      friend bool
+      operator ==(const segment_iterator &lhs, const segment_iterator &rhs) {
+        return lhs.count_ == rhs.count_;
+      }
+
+      // Advance by `n` characters, which must all be available.
+      void advance(std::size_t n) {
+        while(n != 0) {
+          std::size_t step = (std::min)(n, contiguous());
+          ptr_ += step;
+          count_ += step;
+          n -= step;
+          if(ptr_ == end_)
+            next_segment();
+        }
+      }
+
+      // The number of characters remaining from here to the end of all the
+      // segments.
+      std::size_t remaining() const {
+        std::size_t result = contiguous();
+        for(std::size_t i = segment_ + 1; i < std::ranges::size(*segments_);
+            i++) {
+          result += segment_chars(std::ranges::begin(*segments_)[i]).size();
+        }
+        return result;
+      }
+
+      // The number of characters from here to the end of this segment.
+      std::size_t contiguous() const noexcept {
+        return end_ - ptr_;
+      }
+
+      const char * data() const noexcept { return ptr_; }
+      string_arena & arena() const noexcept { return *arena_; }
+      std::size_t count() const noexcept { return count_; }
+
+      segment_position position() const {
+        if(segment_ == std::ranges::size(*segments_))
+          return {segment_, 0};
+        return {segment_, static_cast<std::size_t>(
+          ptr_ - current_chars().data()
+        )};
+      }
+    private:
+      std::string_view current_chars() const {
+        return segment_chars(std::ranges::begin(*segments_)[segment_]);
+      }
+
+      void next_segment() {
+        // Skip over any empty segments.
+        std::size_t num_segments = std::ranges::size(*segments_);
+        while(++segment_ < num_segments) {
+          auto chars = current_chars();
+          if(!chars.empty()) {
+            ptr_ = chars.data();
+            end_ = chars.data() + chars.size();
+            return;
+          }
+        }
+        ptr_ = end_ = nullptr;
+      }
+
+      const Segments *segments_ = nullptr;
+      string_arena *arena_ = nullptr;
+      std::size_t segment_ = 0;
+      const char *ptr_ = nullptr, *end_ = nullptr;
+      std::size_t count_ = 0;
+    };
+
+    template<typename String, typename Segments>
+    decode_errc
+    decode_chars(segment_iterator<Segments> &begin,
+                 segment_iterator<Segments> end, std::size_t len,
+                 String &value) {
+      if(end.count() - begin.count() < len) {
+        begin = end;
+        return decode_errc::unexpected_end_of_input;
+      }
+
+      if constexpr(std::ranges::view<String>) {
+        if(begin.contiguous() >= len) {
+          value = String(begin.data(), len);
+          begin.advance(len);
+        } else {
+          // This string straddles two or more segments, so copy it.
+          char *buf = begin.arena().allocate(len);
+          for(std::size_t done = 0; done != len;) {
+            std::size_t step = (std::min)(len - done, begin.contiguous());
+            std::memcpy(buf + done, begin.data(), step);
+            begin.advance(step);
+            done += step;
+          }
+          value = String(buf, len);
+        }
+      } else {
+        auto orig = begin;
+        begin.advance(len);
+        if constexpr(requires { value.assign(orig, begin); })
+          value.assign(orig, begin);
+        else
+          value = String(orig, begin);
+      }
+      return decode_errc::ok;
+    }
+
+    template<typename String, std::input_iterator Iter>
+    decode_errc decode_str(Iter &begin, Iter end, String &value,
+                           std::size_t max_len) {
+      assert(std::isdigit(*begin));
+      std::size_t len;
+      if(auto ec = decode_digits<std::size_t>(begin, end, len);
+         ec != decode_errc::ok)
+        return ec;
+      if(len > max_len)
+        return decode_errc::string_length_limit_exceeded;
+      if(begin == end)
+        return decode_errc::unexpected_end_of_input;
+      if(*begin != u8':')
+        return decode_errc::expected_colon_token;
+      ++begin;
+
+      return decode_chars<String>(begin, end, len, value);
+    }
+
+    // Skip over the next bencode object in [begin, end) without building
+    // anything. This only checks that the input is structurally valid: for
+    // instance, dict keys aren't checked to be strings, and integers aren't
+    // checked for overflow.
+    template<std::input_iterator Iter>
+    decode_errc skip_value(Iter &begin, Iter end, std::size_t max_depth,
+                           std::size_t max_string_length) {
+      std::size_t depth = 0;
+      do {
+        if(begin == end)
+          return decode_errc::unexpected_end_of_input;
+
+        if(*begin == u8'e') {
+          if(depth == 0)
+            return decode_errc::unexpected_e_token;
+          --depth;
+          ++begin;
+        } else if(*begin == u8'i') {
+          ++begin;
+          if(begin != end && *begin == u8'-')
+            ++begin;
+          while(begin != end && std::isdigit(*begin))
+            ++begin;
+          if(begin == end)
+            return decode_errc::unexpected_end_of_input;
+          if(*begin != u8'e')
+            return decode_errc::expected_e_token;
+          ++begin;
+        } else if(*begin == u8'l' || *begin == u8'd') {
+          if(depth >= max_depth)
+            return decode_errc::depth_limit_exceeded;
+          ++depth;
+          ++begin;
+        } else if(std::isdigit(*begin)) {
+          std::size_t len;
+          if(auto ec = decode_digits<std::size_t>(begin, end, len);
+             ec != decode_errc::ok)
+            return ec;
+          if(len > max_string_length)
+            return decode_errc::string_length_limit_exceeded;
+          if(begin == end)
+            return decode_errc::unexpected_end_of_input;
+          if(*begin != u8':')
+            return decode_errc::expected_colon_token;
+          ++begin;
+
+          if constexpr(std::random_access_iterator<Iter>) {
+            if(end - begin < static_cast<std::ptrdiff_t>(len)) {
+              begin = end;
+              return decode_errc::unexpected_end_of_input;
+            }
+            begin += len;
+          } else {
+            for(std::size_t i = 0; i != len; i++) {
+              if(begin == end)
+                return decode_errc::unexpected_end_of_input;
+              ++begin;
+            }
+          }
+        } else {
+          return decode_errc::unexpected_type_token;
+        }
+      } while(depth != 0);
+
+      return decode_errc::ok;
+    }
+
+    // Scan the next bencode object in [begin, end) and record the number of
+    // elements in each of its lists, in the order the lists are opened. This
+    // stops early on malformed input or if `limits` would be exceeded, since
+    // the real decoding pass will report the error.
+    template<std::forward_iterator Iter>
+    void count_list_sizes(Iter begin, Iter end, const decode_limits &limits,
+                          std::vector<std::size_t> &sizes) {
+      constexpr std::size_t not_list =
+        (std::numeric_limits<std::size_t>::max)();
+      small_stack<std::size_t, 32> open;
+      sizes.clear();
+
+      do {
+        if(begin == end)
+          return;
+
+        if(*begin == u8'e') {
+          if(open.empty())
+            return;
+          open.pop();
+          ++begin;
+          continue;
+        }
+
+        if(!open.empty() && open.top() != not_list)
+          ++sizes[open.top()];
+
+        if(*begin == u8'l' || *begin == u8'd') {
+          if(open.size() >= limits.max_depth ||
+             sizes.size() >= limits.max_nodes)
+            return;
+          if(*begin++ == u8'l') {
+            open.push(sizes.size());
+            sizes.push_back(0);
+          } else {
+            open.push(not_list);
+          }
+        } else if(skip_value(begin, end, 0, limits.max_string_length) !=
+                  decode_errc::ok) {
+          return;
+        }
+      } while(!open.empty());
+    }
+
+    // Holds onto the nodes of dicts from a previously-decoded value so that we
+    // can reuse them. This is only possible for dict types that support node
+    // handles (like `std::map`).
+    template<typename Dict>
+    struct dict_node_pool {
+      static constexpr bool enabled = false;
+      void clear() noexcept {}
+    };
+
+    template<typename Dict>
+    requires requires(Dict &d) { d.insert(d.end(), d.extract(d.begin())); }
+    struct dict_node_pool<Dict> {
+      static constexpr bool enabled = true;
+      using node_type = decltype(std::declval<Dict &>().extract(
+        std::declval<Dict &>().begin()
+      ));
+
+      // Move all the nodes of `dict` into the pool, leaving its first key on
+      // top (if it's ordered).
+      void take(Dict &dict) {
+        while(!dict.empty()) {
+          if constexpr(std::bidirectional_iterator<decltype(dict.end())>)
+            nodes.push_back(dict.extract(std::prev(dict.end())));
+          else
+            nodes.push_back(dict.extract(dict.begin()));
+        }
+      }
+
+      // Discard any nodes above `mark`.
+      void release(std::size_t mark) {
+        nodes.erase(nodes.begin() + mark, nodes.end());
+      }
+
+      void clear() noexcept {
+        nodes.clear();
+        pending = node_type();
+      }
+
+      std::vector<node_type> nodes;
+      node_type pending;
+    };
+
+    // The scratch space used while decoding. This can be held onto across
+    // calls so that we don't need to reallocate it each time.
+    template<typename Data, observer Observer = null_observer>
+    struct decode_state {
+      struct frame {
+        Data *node;
+        // For lists, the number of elements decoded so far; for dicts, the
+        // size of the node pool when we started decoding it.
+        std::size_t count;
+        // When decoding with a projection, the projection state of this node
+        // and (for lists) the index of the next element in the input.
+        std::size_t match;
+        std::size_t index;
+      };
+
+      void clear() noexcept {
+        stack.clear();
+        pool.clear();
+      }
+
+      small_stack<frame, 32> stack;
+      typename Data::string dict_key;
+      dict_node_pool<cow_container_t<typename Data::dict>> pool;
+
+      // If set, count the elements of each list before decoding so that we
+      // can reserve exactly enough space for them.
+      bool reserve_lists = false;
+      std::vector<std::size_t> list_sizes;
+      std::size_t next_list = 0;
+
+      [[no_unique_address]] Observer observer;
+    };
+
+    // Used in place of a `projection` to decode everything.
+    struct no_projection {};
+
+    // Decode the next bencode object in [begin, end) into `result`, reusing
+    // any storage `result` already has where the shapes match. If `proj` is a
+    // `projection`, only the parts of the object it matches are decoded; the
+    // rest are stored as raw values if `Data` has a raw alternative, and
+    // dropped otherwise. On
+    // failure, `begin` points to where the error was found, `result` is valid
+    // but unspecified, and if the error is `duplicated_key`, `state.dict_key`
+    // holds the offending key. If `Trusted` is set, the input is assumed to be
+    // valid, and only the checks needed to stay within [begin, end) are made.
+    template<bool Trusted = false, typename Data, typename Observer,
+             std::input_iterator Iter, typename Projection = no_projection>
+    decode_errc decode_value(Data &result, Iter &begin, Iter end,
+                             const decode_limits &limits,
+                             decode_state<Data, Observer> &state,
+                             const Projection &proj = {}) {
+      using Traits = variant_traits_for<Data>;
+      using Integer = typename Data::integer;
+      using String  = typename Data::string;
+      using List    = typename Data::list;
+      using Dict    = typename Data::dict;
+      // Build containers directly, so that the nodes of copy-on-write types
+      // stay shareable.
+      using ListImpl = cow_container_t<List>;
+      using DictImpl = cow_container_t<Dict>;
+      auto impl = [](auto *p) {
+        return p ? &cow_access::container(*p) : nullptr;
+      };
+      constexpr bool use_pool = decltype(state.pool)::enabled;
+      constexpr bool projecting = !std::is_same_v<Projection, no_projection>;
+      constexpr bool copies_strings = !std::ranges::view<String>;
+      constexpr bool keeps_raw = projecting &&
+        !std::is_void_v<typename Data::raw>;
+      static_assert(!keeps_raw || std::forward_iterator<Iter>,
+                    "keeping raw values requires a forward iterator");
+
+      auto &stack = state.stack;
+      auto &pool = state.pool;
+      auto &observer = state.observer;
+      std::size_t nodes = 0;
+      state.clear();
+
+      // Pre-counting only works if we can read the input twice, and if we
+      // decode every list we see.
+      state.next_list = 0;
+      state.list_sizes.clear();
+      if constexpr(std::forward_iterator<Iter> && !projecting) {
+        if(state.reserve_lists) {
+          observer.phase(decode_phase::prescan);
+          count_list_sizes(begin, end, limits, state.list_sizes);
+        }
+      }
+      observer.phase(decode_phase::build);
+
+      // To report allocations, compare the heap storage of strings and lists
+      // before and after we write to them. This is skipped entirely if no one
+      // is observing.
+      constexpr bool observing = !std::is_same_v<Observer, null_observer>;
+      auto heap_size = [](const auto &c) -> std::size_t {
+        using T = std::remove_cvref_t<decltype(c)>;
+        if constexpr(!observing || !requires { c.capacity(); })
+          return 0;
+        else if constexpr(std::same_as<T, String>)
+          return string_heap_size(c);
+        else
+          return c.capacity() * sizeof(Data);
+      };
+      auto grew = [&observer](std::size_t before, std::size_t after) {
+        if(after > before)
+          observer.allocation(after);
+      };
+
+      // There are three places we can store an element we've just parsed:
+      //   1) the root node
+      //   2) a list
+      //   3) a dict
+      // If there's an existing node there that we can reuse, `slot` points to
+      // it; if that node is from our dict node pool, `pending` is set, and we
+      // still need to insert it into its dict. Otherwise, `slot` is null and
+      // we add a new element to the list or dict.
+      //
+      // Either way, we return a pointer to the stored element, which lets us
+      // add that pointer to our node stack. Since we only ever manipulate the
+      // top element of the stack, this pointer should be valid for as long as
+      // we hold onto it. If the element couldn't be stored because its key is
+      // already in the dict, return null.
+      Data *slot;
+      bool pending;
+      ListImpl *parent_list;
+      DictImpl *parent_dict;
+      std::size_t match = 0;
+
+      // When projecting, we skip the next value if it doesn't match any path,
+      // or if it's a scalar along the way to a match.
+      auto unwanted = [&]() {
+        if constexpr(projecting) {
+          return match == projection::none || (
+            match != projection::all && *begin != u8'l' && *begin != u8'd'
+          );
+        } else {
+          return false;
+        }
+      };
+      auto skip = [&]() {
+        return skip_value(begin, end, limits.max_depth - stack.size(),
+                          limits.max_string_length);
+      };
+
+      auto commit = [&]() -> Data * {
+        if constexpr(use_pool) {
+          if(pending) {
+            // Keys are usually sorted, so hint that this goes at the end. If
+            // the key is a duplicate, the node is left in `pool.pending`.
+            auto i = parent_dict->insert(parent_dict->end(),
+                                         std::move(pool.pending));
+            if(!pool.pending.empty()) {
+              if constexpr(Trusted) {
+                // As in `store`, the last value for a duplicate key wins.
+                i->second = std::move(pool.pending.mapped());
+                return &i->second;
+              } else {
+                state.dict_key = std::move(pool.pending.key());
+                return nullptr;
+              }
+            }
+            return &i->second;
+          }
+        }
+        return slot;
+      };
+
+      auto store = [&](auto &&thing) -> Data * {
+        if(slot) {
+          *slot = std::move(thing);
+          return commit();
+        } else if(parent_list) {
+          auto before = heap_size(*parent_list);
+          parent_list->push_back(std::move(thing));
+          grew(before, heap_size(*parent_list));
+          return &parent_list->back();
+        } else {
+          assert(parent_dict && "expected list or dict");
+          auto new_node = [&observer](Data &value) {
+            observer.allocation(dict_node_size<DictImpl>());
+            return &value;
+          };
+
+          // Well-formed bencode dicts have sorted keys, so if this key comes
+          // after the last one, we can just append it to the end.
+          auto &dict = *parent_dict;
+          if constexpr(Trusted) {
+            // Trusted input can still have duplicate keys; if so, the last
+            // value wins, so that we always return the node we stored.
+            auto size = dict.size();
+            auto i = dict.try_emplace(dict.end(), std::move(state.dict_key),
+                                      std::move(thing));
+            if(dict.size() == size) {
+              i->second = std::move(thing);
+              return &i->second;
+            }
+            return new_node(i->second);
+          } else if constexpr(requires { dict.key_comp(); }) {
+            if(dict.empty() ||
+               dict.key_comp()(dict.rbegin()->first, state.dict_key)) {
+              return new_node(dict.emplace_hint(
+                dict.end(), std::move(state.dict_key), std::move(thing)
+              )->second);
+            }
+          }
+
+          // Otherwise, use `try_emplace` so that `dict_key` is left intact if
+          // it's a duplicate.
+          auto i = dict.try_emplace(std::move(state.dict_key),
+                                    std::move(thing));
+          return i.second ? new_node(i.first->second) : nullptr;
+        }
+      };
+
+      do {
+        if(begin == end)
+          return decode_errc::unexpected_end_of_input;
+
+        if(*begin == u8'e') {
+          if(stack.empty())
+            return decode_errc::unexpected_e_token;
+          auto &top = stack.top();
+          if(auto p = impl(Traits::template get_if<List>(top.node))) {
+            // Drop any elements left over from the list we reused.
+            if(top.count < p->size())
+              p->erase(p->begin() + top.count, p->end());
+          } else if constexpr(use_pool) {
+            pool.release(top.count);
+          }
+          ++begin;
+          stack.pop();
+          continue;
+        }
+
+        slot = nullptr;
+        pending = false;
+        parent_list = nullptr;
+        parent_dict = nullptr;
+        if(stack.empty()) {
+          slot = &result;
+          if constexpr(projecting)
+            match = proj.root();
+        } else if((parent_list = impl(Traits::template get_if<List>(
+                     stack.top().node
+                   )))) {
+          auto &top = stack.top();
+          if constexpr(projecting) {
+            match = proj.child(top.match, top.index++);
+            if(!keeps_raw && unwanted()) {
+              if(auto ec = skip(); ec != decode_errc::ok)
+                return ec;
+              continue;
+            }
+          }
+
+          if(top.count < parent_list->size())
+            slot = &(*parent_list)[top.count];
+          ++top.count;
+        } else if((parent_dict = impl(Traits::template get_if<Dict>(
+                     stack.top().node
+                   )))) {
+          if(!Trusted && parent_dict->size() >= limits.max_dict_size)
+            return decode_errc::dict_size_limit_exceeded;
+          if(!std::isdigit(*begin))
+            return decode_errc::expected_string_start_token;
+
+          String *key = &state.dict_key;
+          if constexpr(use_pool) {
+            if(pool.nodes.size() > stack.top().count) {
+              pool.pending = std::move(pool.nodes.back());
+              pool.nodes.pop_back();
+              key = &pool.pending.key();
+              slot = &pool.pending.mapped();
+              pending = true;
+            }
+          }
+
+          auto before = heap_size(*key);
+          if(auto ec = detail::decode_str(begin, end, *key,
+                                          limits.max_string_length);
+             ec != decode_errc::ok)
+            return ec;
+          grew(before, heap_size(*key));
+          observer.string(std::size(*key), copies_strings);
+          if(begin == end)
+            return decode_errc::unexpected_end_of_input;
+
+          if constexpr(projecting) {
+            match = proj.child(stack.top().match, std::string_view(*key));
+            if(!keeps_raw && unwanted()) {
+              if(auto ec = skip(); ec != decode_errc::ok)
+                return ec;
+              // Put back the node we took so that later keys can use it.
+              if constexpr(use_pool) {
+                if(pending)
+                  pool.nodes.push_back(std::move(pool.pending));
+              }
+              continue;
+            }
+          }
+        }
+
+        if constexpr(!Trusted) {
+          if(++nodes > limits.max_nodes)
+            return decode_errc::node_limit_exceeded;
+        }
+
+        Data *stored;
+        if(keeps_raw && !stack.empty() && unwanted()) {
+          // Keep the unwanted value as-is so that it can be encoded verbatim.
+          if constexpr(keeps_raw) {
+            using Raw = typename Data::raw;
+            auto start = begin;
+            if(auto ec = skip(); ec != decode_errc::ok)
+              return ec;
+            stored = store(Raw(typename Raw::string(start, begin)));
+          }
+        } else if(*begin == u8'i') {
+          Integer value;
+          decode_errc ec;
+          if constexpr(Trusted)
+            ec = detail::decode_int_unchecked(begin, end, value);
+          else
+            ec = detail::decode_int(begin, end, value);
+          if(ec != decode_errc::ok)
+            return ec;
+          observer.node(node_kind::integer, stack.size());
+          stored = store(value);
+        } else if(*begin == u8'l') {
+          if(!Trusted && stack.size() >= limits.max_depth)
+            return decode_errc::depth_limit_exceeded;
+          observer.node(node_kind::list, stack.size());
+          ++begin;
+          if(slot && Traits::template get_if<List>(slot))
+            stored = commit();
+          else
+            stored = store( List{} );
+          if(stored) {
+            if(state.next_list < state.list_sizes.size()) {
+              auto p = impl(Traits::template get_if<List>(stored));
+              if constexpr(requires { p->reserve(0); }) {
+                auto before = heap_size(*p);
+                p->reserve(state.list_sizes[state.next_list]);
+                grew(before, heap_size(*p));
+              }
+              ++state.next_list;
+            }
+            stack.push({stored, 0, match, 0});
+          }
+        } else if(*begin == u8'd') {
+          if(!Trusted && stack.size() >= limits.max_depth)
+            return decode_errc::depth_limit_exceeded;
+          observer.node(node_kind::dict, stack.size());
+          ++begin;
+          bool reused = slot && Traits::template get_if<Dict>(slot);
+          stored = reused ? commit() : store( Dict{} );
+          if(stored) {
+            std::size_t mark = 0;
+            if constexpr(use_pool) {
+              mark = pool.nodes.size();
+              if(reused)
+                pool.take(*impl(Traits::template get_if<Dict>(stored)));
+            } else if(reused) {
+              impl(Traits::template get_if<Dict>(stored))->clear();
+            }
+            stack.push({stored, mark, match, 0});
+          }
+        } else if(std::isdigit(*begin)) {
+          observer.node(node_kind::string, stack.size());
+          if(auto p = slot ? Traits::template get_if<String>(slot) : nullptr) {
+            auto before = heap_size(*p);
+            if(auto ec = detail::decode_str(begin, end, *p,
+                                            limits.max_string_length);
+               ec != decode_errc::ok)
+              return ec;
+            grew(before, heap_size(*p));
+            observer.string(std::size(*p), copies_strings);
+            stored = commit();
+          } else {
+            String value;
+            if(auto ec = detail::decode_str(begin, end, value,
+                                            limits.max_string_length);
+               ec != decode_errc::ok)
+              return ec;
+            grew(0, heap_size(value));
+            observer.string(std::size(value), copies_strings);
+            stored = store(std::move(value));
+          }
+        } else {
+          return decode_errc::unexpected_type_token;
+        }
+
+        if(!stored)
+          return decode_errc::duplicated_key;
+        if(parent_dict)
+          observer.dict_insert();
+      } while(!stack.empty());
+
+      return decode_errc::ok;
+    }
+
+    // Decode the next bencode object in [begin, end) into `result`, enforcing
+    // `limits`. Returns the error (if any) and the offset where decoding
+    // stopped.
+    template<typename Data, typename Observer, std::input_iterator Iter,
+             typename Projection = no_projection>
+    std::pair<decode_errc, std::size_t>
+    do_decode(Data &result, Iter &begin, Iter end, bool all,
+              const decode_limits &limits, decode_state<Data, Observer> &state,
+              const Projection &proj = {}) {
+      decode_errc ec;
+      std::size_t offset;
+      bool truncated;
+      state.observer.begin_decode();
+
+      if constexpr(std::random_access_iterator<Iter>) {
+        // Enforce `max_bytes` by pretending the input ends there.
+        Iter orig_begin = begin;
+        Iter limited_end = end;
+        truncated = static_cast<std::size_t>(end - begin) > limits.max_bytes;
+        if(truncated)
+          limited_end = begin + limits.max_bytes;
+
+        ec = decode_value(result, begin, limited_end, limits, state, proj);
+        offset = begin - orig_begin;
+      } else {
+        // We can't see how much input there is, so count as we go.
+        counting_iterator<Iter> counted_begin(begin, limits.max_bytes),
+                                counted_end(end);
+        ec = decode_value(result, counted_begin, counted_end, limits, state,
+                          proj);
+        begin = counted_begin.base();
+        offset = counted_begin.count();
+        truncated = offset == limits.max_bytes && begin != end;
+      }
+
+      if(ec == decode_errc::unexpected_end_of_input && truncated)
+        ec = decode_errc::byte_limit_exceeded;
+      else if(ec == decode_errc::ok && all && begin != end)
+        ec = decode_errc::extraneous_character;
+      state.observer.end_decode(offset, ec);
+      return {ec, offset};
+    }
+
+    // Read contiguous byte buffers as `char`s so that views can alias them
+    // directly.
+    template<typename Data, typename Observer, byte_iterator Iter,
+             typename Projection = no_projection>
+    std::pair<decode_errc, std::size_t>
+    do_decode(Data &result, Iter &begin, Iter end, bool all,
+              const decode_limits &limits, decode_state<Data, Observer> &state,
+              const Projection &proj = {}) {
+      auto cbegin = reinterpret_cast<const char *>(std::to_address(begin));
+      auto cend = cbegin + (end - begin);
+      auto r = do_decode(result, cbegin, cend, all, limits, state, proj);
+      begin += r.second;
+      return r;
+    }
+
+    // Throw the `decode_error` for a failed call to `do_decode`.
+    template<typename Data, typename Observer>
+    [[noreturn]] void
+    throw_decode_error(decode_errc ec, std::size_t offset,
+                       const decode_state<Data, Observer> &state) {
+      if(ec == decode_errc::duplicated_key)
+        throw make_decode_error(ec, offset, std::string(state.dict_key));
+      throw make_decode_error(ec, offset);
+    }
+
+    // Like the above, but throw a `decode_error` on failure.
+    template<typename Data, typename Observer, std::input_iterator Iter,
+             typename Projection = no_projection>
+    void do_decode_or_throw(Data &result, Iter &begin, Iter end, bool all,
+                            const decode_limits &limits,
+                            decode_state<Data, Observer> &state,
+                            const Projection &proj = {}) {
+      auto [ec, offset] = do_decode(result, begin, end, all, limits, state,
+                                    proj);
+      if(ec != decode_errc::ok)
+        throw_decode_error(ec, offset, state);
+    }
+
+    template<typename Data, typename Segments>
+    segmented_data<Data>
+    do_decode_segments(const Segments &segments, segment_position &pos,
+                       bool all, const decode_limits &limits) {
+      segmented_data<Data> result;
+      decode_state<Data> state;
+      segment_iterator begin(segments, pos, result.arena);
+
+      // Enforce `max_bytes` by pretending the input ends there.
+      std::size_t remaining = begin.remaining();
+      bool truncated = remaining > limits.max_bytes;
+      auto end = begin;
+      end.advance(truncated ? limits.max_bytes : remaining);
+
+      auto ec = decode_value(result.value, begin, end, limits, state);
+      std::size_t offset = begin.count();
+      if(ec == decode_errc::unexpected_end_of_input && truncated)
+        ec = decode_errc::byte_limit_exceeded;
+      else if(ec == decode_errc::ok && all && offset != remaining)
+        ec = decode_errc::extraneous_character;
+
+      if(ec != decode_errc::ok)
+        throw_decode_error(ec, offset, state);
+      pos = begin.position();
+      return result;
+    }
+
+    template<typename Data, std::input_iterator Iter>
+    decode_result<Data> do_try_decode(Iter &begin, Iter end, bool all,
+                                      const decode_limits &limits) {
+      decode_state<Data> state;
+      Data result;
+      auto [ec, offset] = do_decode(result, begin, end, all, limits, state);
+      if(ec != decode_errc::ok)
+        return decode_failure(ec, offset);
+      return result;
+    }
+
+    template<typename Data, std::input_iterator Iter,
+             typename Projection = no_projection>
+    Data do_decode(Iter &begin, Iter end, bool all,
+                   const decode_limits &limits, const Projection &proj = {}) {
+      decode_state<Data> state;
+      Data result;
+      do_decode_or_throw(result, begin, end, all, limits, state, proj);
+      return result;
+    }
+
+    template<typename Data, std::contiguous_iterator Iter>
+    Data do_decode_trusted(Iter &begin, Iter end, bool all) {
+      // Read the input as `char`s so that byte buffers work too.
+      auto cbegin = reinterpret_cast<const char *>(std::to_address(begin));
+      auto cend = cbegin + (end - begin), orig = cbegin;
+
+      decode_state<Data> state;
+      Data result;
+      auto ec = decode_value<true>(result, cbegin, cend, decode_limits{},
+                                   state);
+      if(ec == decode_errc::ok && all && cbegin != cend)
+        ec = decode_errc::extraneous_character;
+      if(ec != decode_errc::ok)
+        throw_decode_error(ec, cbegin - orig, state);
+      begin += cbegin - orig;
+      return result;
+    }
+
+    template<typename Data, typename Decode>
+    auto decode_stream(std::istream &s, eof_behavior e, Decode &&decode) {
+      static_assert(!std::ranges::view<typename Data::string>,
+                    "reading from stream not supported for data views");
+
+      std::istreambuf_iterator<char> begin(s), end;
+      auto result = decode(begin, end);
+      // If we hit EOF, update the parent stream.
+      if(e == check_eof && begin == end)
+        s.setstate(std::ios_base::eofbit);
+      return result;
+    }
+
+    template<typename Data, typename Projection = no_projection>
+    Data do_decode(std::istream &s, eof_behavior e, bool all,
+                   const decode_limits &limits, const Projection &proj = {}) {
+      return decode_stream<Data>(s, e, [&](auto &begin, auto end) {
+        return do_decode<Data>(begin, end, all, limits, proj);
+      });
+    }
+
+    template<typename Data>
+    decode_result<Data>
+    do_try_decode(std::istream &s, eof_behavior e, bool all,
+                  const decode_limits &limits) {
+      return decode_stream<Data>(s, e, [all, &limits](auto &begin, auto end) {
+        return do_try_decode<Data>(begin, end, all, limits);
+      });
+    }
+
+  } // namespace detail
+
+  template<typename Data, std::input_iterator Iter>
+  inline Data basic_decode(Iter begin, Iter end,
+                           const decode_limits &limits = {}) {
+    return detail::do_decode<Data>(begin, end, true, limits);
+  }
+
+  template<typename Data, typename String>
+  inline Data basic_decode(const String &s, const decode_limits &limits = {})
+  requires(detail::iterable<String> && !std::is_array_v<String>) {
+    return basic_decode<Data>(std::begin(s), std::end(s), limits);
+  }
+
+  template<typename Data>
+  inline Data basic_decode(const char *s, const decode_limits &limits = {}) {
+    return basic_decode<Data>(s, s + std::strlen(s), limits);
+  }
+
+  template<typename Data>
+  inline Data basic_decode(const char *s, std::size_t length,
+                           const decode_limits &limits = {}) {
+    return basic_decode<Data>(s, s + length, limits);
+  }
+
+  template<typename Data>
+  inline Data basic_decode(std::istream &s, eof_behavior e = check_eof,
+                           const decode_limits &limits = {}) {
+    return detail::do_decode<Data>(s, e, true, limits);
+  }
+
+  template<typename Data>
+  inline Data basic_decode(std::istream &s, const decode_limits &limits) {
+    return basic_decode<Data>(s, check_eof, limits);
+  }
+
+  template<typename Data, std::contiguous_iterator Iter>
+  inline Data basic_decode(trusted_t, Iter begin, Iter end) {
+    return detail::do_decode_trusted<Data>(begin, end, true);
+  }
+
+  template<typename Data, std::ranges::contiguous_range String>
+  inline Data basic_decode(trusted_t, const String &s)
+  requires(!std::is_array_v<String>) {
+    return basic_decode<Data>(trusted, std::ranges::begin(s),
+                              std::ranges::end(s));
+  }
+
+  template<typename Data>
+  inline Data basic_decode(trusted_t, const char *s) {
+    return basic_decode<Data>(trusted, s, s + std::strlen(s));
+  }
+
+  template<typename Data, std::input_iterator Iter>
+  inline Data basic_decode_some(Iter &begin, Iter end,
+                                const decode_limits &limits = {}) {
+    return detail::do_decode<Data>(begin, end, false, limits);
+  }
+
+  template<typename Data, std::contiguous_iterator Iter>
+  inline Data basic_decode_some(trusted_t, Iter &begin, Iter end) {
+    return detail::do_decode_trusted<Data>(begin, end, false);
+  }
+
+  template<typename Data>
+  inline Data basic_decode_some(const char *&s,
+                                const decode_limits &limits = {}) {
+    return basic_decode_some<Data>(s, s + std::strlen(s), limits);
+  }
+
+  template<typename Data>
+  inline Data basic_decode_some(const char *&s, std::size_t length,
+                                const decode_limits &limits = {}) {
+    return basic_decode_some<Data>(s, s + length, limits);
+  }
+
+  template<typename Data>
+  inline Data basic_decode_some(std::istream &s, eof_behavior e = check_eof,
+                                const decode_limits &limits = {}) {
+    return detail::do_decode<Data>(s, e, false, limits);
+  }
+
+  template<typename Data>
+  inline Data
+  basic_decode_some(std::istream &s, const decode_limits &limits) {
+    return basic_decode_some<Data>(s, check_eof, limits);
+  }
+
+  template<typename Data, std::input_iterator Iter>
+  inline Data
+  basic_decode_projected(Iter begin, Iter end, const projection &proj,
+                         const decode_limits &limits = {}) {
+    return detail::do_decode<Data>(begin, end, true, limits, proj);
+  }
+
+  template<typename Data, typename String>
+  inline Data
+  basic_decode_projected(const String &s, const projection &proj,
+                         const decode_limits &limits = {})
+  requires(detail::iterable<String> && !std::is_array_v<String>) {
+    return basic_decode_projected<Data>(std::begin(s), std::end(s), proj,
+                                        limits);
+  }
+
+  template<typename Data>
+  inline Data
+  basic_decode_projected(const char *s, const projection &proj,
+                         const decode_limits &limits = {}) {
+    return basic_decode_projected<Data>(s, s + std::strlen(s), proj, limits);
+  }
+
+  template<typename Data>
+  inline Data
+  basic_decode_projected(const char *s, std::size_t length,
+                         const projection &proj,
+                         const decode_limits &limits = {}) {
+    return basic_decode_projected<Data>(s, s + length, proj, limits);
+  }
+
+  template<typename Data>
+  inline Data
+  basic_decode_projected(std::istream &s, const projection &proj,
+                         const decode_limits &limits = {}) {
+    return detail::do_decode<Data>(s, check_eof, true, limits, proj);
+  }
+
+  template<typename Data, std::ranges::random_access_range Segments>
+  inline segmented_data<Data>
+  basic_decode_segments(const Segments &segments,
+                        const decode_limits &limits = {}) {
+    segment_position pos;
+    return detail::do_decode_segments<Data>(segments, pos, true, limits);
+  }
+
+  template<typename Data, std::ranges::random_access_range Segments>
+  inline segmented_data<Data>
+  basic_decode_segments_some(const Segments &segments, segment_position &pos,
+                             const decode_limits &limits = {}) {
+    return detail::do_decode_segments<Data>(segments, pos, false, limits);
+  }
+
+  template<typename Data, std::input_iterator Iter>
+  inline decode_result<Data>
+  basic_try_decode(Iter begin, Iter end, const decode_limits &limits = {}) {
+    return detail::do_try_decode<Data>(begin, end, true, limits);
+  }
+
+  template<typename Data, typename String>
+  inline decode_result<Data>
+  basic_try_decode(const String &s, const decode_limits &limits = {})
+  requires(detail::iterable<String> && !std::is_array_v<String>) {
+    return basic_try_decode<Data>(std::begin(s), std::end(s), limits);
+  }
+
+  template<typename Data>
+  inline decode_result<Data>
+  basic_try_decode(const char *s, const decode_limits &limits = {}) {
+    return basic_try_decode<Data>(s, s + std::strlen(s), limits);
+  }
+
+  template<typename Data>
+  inline decode_result<Data>
+  basic_try_decode(const char *s, std::size_t length,
+                   const decode_limits &limits = {}) {
+    return basic_try_decode<Data>(s, s + length, limits);
+  }
+
+  template<typename Data>
+  inline decode_result<Data>
+  basic_try_decode(std::istream &s, eof_behavior e = check_eof,
+                   const decode_limits &limits = {}) {
+    return detail::do_try_decode<Data>(s, e, true, limits);
+  }
+
+  template<typename Data>
+  inline decode_result<Data>
+  basic_try_decode(std::istream &s, const decode_limits &limits) {
+    return basic_try_decode<Data>(s, check_eof, limits);
+  }
+
+  template<typename Data, std::input_iterator Iter>
+  inline decode_result<Data>
+  basic_try_decode_some(Iter &begin, Iter end,
+                        const decode_limits &limits = {}) {
+    return detail::do_try_decode<Data>(begin, end, false, limits);
+  }
+
+  template<typename Data>
+  inline decode_result<Data>
+  basic_try_decode_some(const char *&s, const decode_limits &limits = {}) {
+    return basic_try_decode_some<Data>(s, s + std::strlen(s), limits);
+  }
+
+  template<typename Data>
+  inline decode_result<Data>
+  basic_try_decode_some(const char *&s, std::size_t length,
+                        const decode_limits &limits = {}) {
+    return basic_try_decode_some<Data>(s, s + length, limits);
+  }
+
+  template<typename Data>
+  inline decode_result<Data>
+  basic_try_decode_some(std::istream &s, eof_behavior e = check_eof,
+                        const decode_limits &limits = {}) {
+    return detail::do_try_decode<Data>(s, e, false, limits);
+  }
+
+  template<typename Data>
+  inline decode_result<Data>
+  basic_try_decode_some(std::istream &s, const decode_limits &limits) {
+    return basic_try_decode_some<Data>(s, check_eof, limits);
+  }
+
+  template<typename ...T>
+  inline data decode(T &&...t) {
+    return basic_decode<data>(std::forward<T>(t)...);
+  }
+
+  template<typename ...T>
+  inline data decode_some(T &&...t) {
+    return basic_decode_some<data>(std::forward<T>(t)...);
+  }
+
+  template<typename ...T>
+  inline data_view decode_view(T &&...t) {
+    return basic_decode<data_view>(std::forward<T>(t)...);
+  }
+
+  template<typename ...T>
+  inline data_view decode_view_some(T &&...t) {
+    return basic_decode_some<data_view>(std::forward<T>(t)...);
+  }
+
+  template<typename ...T>
+  inline decode_result<data> try_decode(T &&...t) {
+    return basic_try_decode<data>(std::forward<T>(t)...);
+  }
+
+  template<typename ...T>
+  inline decode_result<data> try_decode_some(T &&...t) {
+    return basic_try_decode_some<data>(std::forward<T>(t)...);
+  }
+
+  template<typename ...T>
+  inline decode_result<data_view> try_decode_view(T &&...t) {
+    return basic_try_decode<data_view>(std::forward<T>(t)...);
+  }
+
+  template<typename ...T>
+  inline decode_result<data_view> try_decode_view_some(T &&...t) {
+    return basic_try_decode_some<data_view>(std::forward<T>(t)...);
+  }
+
+  template<typename ...T>
+  inline data decode_projected(T &&...t) {
+    return basic_decode_projected<data>(std::forward<T>(t)...);
+  }
+
+  // Allow passing the projection as a braced list of paths.
+  template<typename Input>
+  inline data decode_projected(Input &&input, const projection &proj,
+                               const decode_limits &limits = {}) {
+    return basic_decode_projected<data>(std::forward<Input>(input), proj,
+                                        limits);
+  }
+
+  template<typename ...T>
+  inline data_view decode_view_projected(T &&...t) {
+    return basic_decode_projected<data_view>(std::forward<T>(t)...);
+  }
+
+  template<typename Input>
+  inline data_view decode_view_projected(Input &&input, const projection &proj,
+                                         const decode_limits &limits = {}) {
+    return basic_decode_projected<data_view>(std::forward<Input>(input), proj,
+                                             limits);
+  }
+
+  template<typename ...T>
+  inline segmented_data<data> decode_segments(T &&...t) {
+    return basic_decode_segments<data>(std::forward<T>(t)...);
+  }
+
+  template<typename ...T>
+  inline segmented_data<data> decode_segments_some(T &&...t) {
+    return basic_decode_segments_some<data>(std::forward<T>(t)...);
+  }
+
+  template<typename ...T>
+  inline segmented_data<data_view> decode_view_segments(T &&...t) {
+    return basic_decode_segments<data_view>(std::forward<T>(t)...);
+  }
+
+  template<typename ...T>
+  inline segmented_data<data_view> decode_view_segments_some(T &&...t) {
+    return basic_decode_segments_some<data_view>(std::forward<T>(t)...);
+  }
+
+#ifdef BENCODE_HAS_BOOST
+  template<typename ...T>
+  inline boost_data boost_decode(T &&...t) {
+    return basic_decode<boost_data>(std::forward<T>(t)...);
+  }
+
+  template<typename ...T>
+  inline boost_data boost_decode_some(T &&...t) {
+    return basic_decode_some<boost_data>(std::forward<T>(t)...);
+  }
+
+  template<typename ...T>
+  inline boost_data_view boost_decode_view(T &&...t) {
+    return basic_decode<boost_data_view>(std::forward<T>(t)...);
+  }
+
+  template<typename ...T>
+  inline boost_data_view boost_decode_view_some(T &&...t) {
+    return basic_decode_some<boost_data_view>(std::forward<T>(t)...);
+  }
+#endif
+
+  template<typename ...T>
+  inline fast_data fast_decode(T &&...t) {
+    return basic_decode<fast_data>(std::forward<T>(t)...);
+  }
+
+  template<typename ...T>
+  inline fast_data fast_decode_some(T &&...t) {
+    return basic_decode_some<fast_data>(std::forward<T>(t)...);
+  }
+
+  template<typename ...T>
+  inline fast_data_view fast_decode_view(T &&...t) {
+    return basic_decode<fast_data_view>(std::forward<T>(t)...);
+  }
+
+  template<typename ...T>
+  inline fast_data_view fast_decode_view_some(T &&...t) {
+    return basic_decode_some<fast_data_view>(std::forward<T>(t)...);
+  }
+
+  // A reusable decoder. This holds onto its scratch space between calls, and
+  // can decode into an existing value, reusing the storage of its strings,
+  // lists, and dicts wherever the new message has the same shape. Each
+  // message decoded is reported to `Observer`.
+  template<typename Data, observer Observer = null_observer>
+  class decoder {
+  public:
+    explicit decoder(const decode_limits &limits = {}, Observer obs = {})
+      : limits_(limits) {
+      state_.observer = std::move(obs);
+    }
+
+    const decode_limits & limits() const noexcept { return limits_; }
+    void set_limits(const decode_limits &limits) { limits_ = limits; }
+
+    Observer & observer() noexcept { return state_.observer; }
+    const Observer & observer() const noexcept { return state_.observer; }
+
+    // If set, scan each input before decoding it to count the elements of
+    // its lists, and reserve exactly that much space for them. This only
+    // applies to multi-pass (forward) iterators.
+    bool reserve_lists() const noexcept { return state_.reserve_lists; }
+    void set_reserve_lists(bool reserve) { state_.reserve_lists = reserve; }
+
+    template<std::input_iterator Iter>
+    Data decode(Iter begin, Iter end) {
+      Data result;
+      decode_into(result, begin, end);
+      return result;
+    }
+
+    template<typename String>
+    Data decode(const String &s)
+    requires(detail::iterable<String> && !std::is_array_v<String>) {
+      return decode(std::begin(s), std::end(s));
+    }
+
+    template<std::input_iterator Iter>
+    Data decode_some(Iter &begin, Iter end) {
+      Data result;
+      decode_some_into(result, begin, end);
+      return result;
+    }
+
+    template<std::input_iterator Iter>
+    void decode_into(Data &result, Iter begin, Iter end) {
+      detail::do_decode_or_throw(result, begin, end, true, limits_, state_);
+    }
+
+    template<typename String>
+    void decode_into(Data &result, const String &s)
+    requires(detail::iterable<String> && !std::is_array_v<String>) {
+      decode_into(result, std::begin(s), std::end(s));
+    }
+
+    template<std::input_iterator Iter>
+    void decode_some_into(Data &result, Iter &begin, Iter end) {
+      detail::do_decode_or_throw(result, begin, end, false, limits_, state_);
+    }
+
+    template<std::input_iterator Iter>
+    std::optional<decode_failure>
+    try_decode_into(Data &result, Iter begin, Iter end) {
+      return try_decode_impl(result, begin, end, true);
+    }
+
+    template<typename String>
+    std::optional<decode_failure>
+    try_decode_into(Data &result, const String &s)
+    requires(detail::iterable<String> && !std::is_array_v<String>) {
+      return try_decode_into(result, std::begin(s), std::end(s));
+    }
+
+    template<std::input_iterator Iter>
+    std::optional<decode_failure>
+    try_decode_some_into(Data &result, Iter &begin, Iter end) {
+      return try_decode_impl(result, begin, end, false);
+    }
+  private:
+    template<std::input_iterator Iter>
+    std::optional<decode_failure>
+    try_decode_impl(Data &result, Iter &begin, Iter end, bool all) {
+      auto [ec, offset] = detail::do_decode(result, begin, end, all, limits_,
+                                            state_);
+      if(ec != decode_errc::ok)
+        return decode_failure(ec, offset);
+      return std::nullopt;
+    }
+
+    decode_limits limits_;
+    detail::decode_state<Data, Observer> state_;
+  };
+
+  // A cache of decoded messages, keyed by their encoded bytes, so that
+  // decoding a recently-seen message is just a lookup. The cache is split
+  // into shards, each an LRU cache with its own lock, and a message's shard
+  // is picked by its `hash_bytes`. Results are shared and immutable, and own
+  // a copy of their input, so view-type documents can be cached too.
+  template<typename Data>
+  class decode_cache {
+  public:
+    using value_ptr = std::shared_ptr<const Data>;
+
+    struct statistics {
+      std::uint64_t hits = 0;
+      std::uint64_t misses = 0;
+      std::uint64_t evictions = 0;
+
+      double hit_rate() const noexcept {
+        auto lookups = hits + misses;
+        return lookups ? static_cast<double>(hits) / lookups : 0.0;
+      }
+    };
+
+    // Create a cache holding up to `capacity` messages in all, spread as
+    // evenly as possible across `shards` shards. Each message can only be
+    // cached in its own shard, so if `capacity` is less than `shards`, some
+    // shards (and the messages that hash to them) won't be cached at all.
+    explicit decode_cache(std::size_t capacity, std::size_t shards = 16,
+                          const decode_limits &limits = {})
+      : limits_(limits), shard_count_(shards), capacity_(capacity) {
+      if(shards == 0)
+        throw std::invalid_argument("decode cache needs at least one shard");
+      shards_.reset(new shard[shards]);
+      for(std::size_t i = 0; i != shards; i++)
+        shards_[i].capacity = capacity / shards + (i < capacity % shards);
+    }
+
+    // Get the decoded form of `input`, decoding it if it isn't cached. Any
+    // errors are thrown as with `basic_decode`, and aren't cached.
+    value_ptr decode(std::string_view input) {
+      key k{input, hash_bytes(input)};
+      auto &s = shards_[k.hash % shard_count_];
+      {
+        std::lock_guard lock(s.mutex);
+        if(auto i = s.index.find(k); i != s.index.end()) {
+          s.stats.hits++;
+          s.lru.splice(s.lru.begin(), s.lru, i->second);
+          return value_of(*i->second);
+        }
+        s.stats.misses++;
+      }
+
+      // Decode without holding the lock, so that other threads can still
+      // use this shard.
+      auto e = std::make_shared<entry>();
+      e->input.assign(input);
+      e->hash = k.hash;
+      e->value = basic_decode<Data>(e->input, limits_);
+      if(s.capacity == 0)
+        return value_of(e);
+
+      std::lock_guard lock(s.mutex);
+      k.input = e->input;
+      if(auto i = s.index.find(k); i != s.index.end())
+        return value_of(*i->second);
+      s.lru.push_front(e);
+      s.index.emplace(k, s.lru.begin());
+      if(s.lru.size() > s.capacity) {
+        auto &last = s.lru.back();
+        s.index.erase(key{last->input, last->hash});
+        s.lru.pop_back();
+        s.stats.evictions++;
+      }
+      return value_of(e);
+    }
+
+    std::size_t capacity() const noexcept {
+      return capacity_;
+    }
+
+    std::size_t size() const {
+      std::size_t n = 0;
+      for(std::size_t i = 0; i != shard_count_; i++) {
+        std::lock_guard lock(shards_[i].mutex);
+        n += shards_[i].lru.size();
+      }
+      return n;
+    }
+
+    statistics stats() const {
+      statistics result;
+      for(std::size_t i = 0; i != shard_count_; i++) {
+        std::lock_guard lock(shards_[i].mutex);
+        result.hits += shards_[i].stats.hits;
+        result.misses += shards_[i].stats.misses;
+        result.evictions += shards_[i].stats.evictions;
+      }
+      return result;
+    }
+
+    // Remove all the cached messages. Results already handed out remain
+    // valid.
+    void clear() {
+      for(std::size_t i = 0; i != shard_count_; i++) {
+        std::lock_guard lock(shards_[i].mutex);
+        shards_[i].index.clear();
+        shards_[i].lru.clear();
+      }
+    }
+  private:
+    struct entry {
+      std::string input;
+      std::size_t hash;
+      Data value;
+    };
+    using entry_ptr = std::shared_ptr<const entry>;
+
+    // A cache key, viewing the input held by its entry along with its hash.
+    struct key {
+      std::string_view input;
+      std::size_t hash;
+
+      friend bool operator ==(const key &lhs, const key &rhs) noexcept {
+        return lhs.input == rhs.input;
+      }
+    };
+
+    struct key_hash {
+      std::size_t operator ()(const key &k) const noexcept {
+        return k.hash;
+      }
+    };
+
+    struct shard {
+      std::size_t capacity = 0;
+      mutable std::mutex mutex;
+      // Most-recently used first.
+      std::list<entry_ptr> lru;
+      std::unordered_map<key, typename std::list<entry_ptr>::iterator,
+                         key_hash> index;
+      statistics stats;
+    };
+
+    static value_ptr value_of(const entry_ptr &e) {
+      return value_ptr(e, &e->value);
+    }
+
+    decode_limits limits_;
+    std::size_t shard_count_, capacity_;
+    std::unique_ptr<shard[]> shards_;
+  };
+
+  // A source of input for `decode_each`: `read` fills up to `n` characters
+  // of `buf`, blocking until at least one is available, and returns how many
+  // it read, or 0 at the end of the input.
+  template<typename T>
+  concept reader = requires(T &r, char *buf, std::size_t n) {
+    { r.read(buf, n) } -> std::convertible_to<std::size_t>;
+  };
+
+  // Read from an `std::istream`, taking whatever's already buffered once at
+  // least one character is available.
+  class istream_reader {
+  public:
+    explicit istream_reader(std::istream &s) : s_(&s) {}
+
+    std::size_t read(char *buf, std::size_t n) {
+      using traits = std::istream::traits_type;
+      if(n == 0)
+        return 0;
+
+      auto *sb = s_->rdbuf();
+      auto c = sb->sbumpc();
+      if(traits::eq_int_type(c, traits::eof())) {
+        s_->setstate(std::ios_base::eofbit);
+        return 0;
+      }
+      buf[0] = traits::to_char_type(c);
+
+      auto avail = sb->in_avail();
+      if(avail <= 0)
+        return 1;
+      auto more = (std::min)(n - 1, static_cast<std::size_t>(avail));
+      return 1 + static_cast<std::size_t>(sb->sgetn(buf + 1, more));
+    }
+  private:
+    std::istream *s_;
+  };
+
+#ifdef BENCODE_HAS_POSIX
+  // Read from a (blocking) POSIX file descriptor.
+  class fd_reader {
+  public:
+    explicit fd_reader(int fd) : fd_(fd) {}
+
+    std::size_t read(char *buf, std::size_t n) {
+      while(true) {
+        auto r = ::read(fd_, buf, n);
+        if(r >= 0)
+          return static_cast<std::size_t>(r);
+        if(errno != EINTR)
+          throw std::system_error(errno, std::generic_category());
+      }
+    }
+
+    int fd() const noexcept { return fd_; }
+  private:
+    int fd_;
+  };
+#endif
+
+  namespace detail {
+    // Produce successive messages directly from a buffer.
+    class buffer_source {
+    public:
+      buffer_source(const char *begin, const char *end)
+        : begin_(begin), end_(end) {}
+
+      template<typename Data, typename Observer>
+      bool next(Data &result, const decode_limits &limits,
+                decode_state<Data, Observer> &state) {
+        if(begin_ == end_)
+          return false;
+        do_decode_or_throw(result, begin_, end_, false, limits, state);
+        return true;
+      }
+    private:
+      const char *begin_, *end_;
+    };
+
+    // Find where the next bencode object ends, scanning incrementally as more
+    // input arrives so that each character is only examined once. This only
+    // checks the structure of the input, and doesn't build anything; once
+    // the object is complete (or invalid), it's decoded in a single pass.
+    class message_scanner {
+    public:
+      enum class status { incomplete, complete, invalid };
+
+      explicit message_scanner(const decode_limits &limits)
+        : limits_(limits) {}
+
+      // Continue scanning `buf`, which holds everything from the start of the
+      // object (including everything scanned by previous calls).
+      status scan(std::string_view buf) {
+        while(pos_ != buf.size()) {
+          if(pos_ >= limits_.max_bytes)
+            return status::invalid;
+
+          char c = buf[pos_];
+          switch(state_) {
+          case state::value:
+            if(c == u8'i') {
+              state_ = state::integer;
+            } else if(c == u8'l' || c == u8'd') {
+              if(depth_ >= limits_.max_depth)
+                return status::invalid;
+              ++depth_;
+            } else if(c == u8'e') {
+              if(depth_ == 0)
+                return status::invalid;
+              --depth_;
+            } else if(std::isdigit(c)) {
+              state_ = state::length;
+              length_ = c - u8'0';
+            } else {
+              return status::invalid;
+            }
+            ++pos_;
+            if(state_ == state::value && depth_ == 0)
+              return status::complete;
+            break;
+          case state::integer:
+            ++pos_;
+            if(c == u8'e') {
+              state_ = state::value;
+              if(depth_ == 0)
+                return status::complete;
+            } else if(c != u8'-' && !std::isdigit(c)) {
+              return status::invalid;
+            }
+            break;
+          case state::length:
+            ++pos_;
+            if(c == u8':') {
+              state_ = state::string;
+            } else if(std::isdigit(c) &&
+                      length_ <= (max_length - (c - u8'0')) / 10) {
+              length_ = length_ * 10 + (c - u8'0');
+            } else {
+              return status::invalid;
+            }
+            if(length_ > limits_.max_string_length)
+              return status::invalid;
+            break;
+          case state::string:
+            break;
+          }
+
+          if(state_ == state::string) {
+            auto n = (std::min)(length_, buf.size() - pos_);
+            pos_ += n;
+            length_ -= n;
+            if(pos_ > limits_.max_bytes)
+              return status::invalid;
+            if(length_ == 0) {
+              state_ = state::value;
+              if(depth_ == 0)
+                return status::complete;
+            }
+          }
+        }
+        return status::incomplete;
+      }
+
+      // The number of characters scanned so far; once the scan is complete,
+      // this is the size of the object.
+      std::size_t size() const noexcept {
+        return pos_;
+      }
+    private:
+      enum class state { value, integer, length, string };
+      static constexpr std::size_t max_length =
+        (std::numeric_limits<std::size_t>::max)();
+
+      decode_limits limits_;
+      state state_ = state::value;
+      std::size_t pos_ = 0, depth_ = 0, length_ = 0;
+    };
+
+    // Produce successive messages from a `reader`, holding the input in a
+    // buffer that grows to fit the largest message. As more input arrives,
+    // it's scanned with a `message_scanner`, so a message is only decoded
+    // once it's complete (or known to be invalid).
+    template<reader Reader>
+    class reader_source {
+    public:
+      static constexpr std::size_t initial_size = 4096;
+
+      explicit reader_source(Reader r) : reader_(std::move(r)) {}
+
+      template<typename Data, typename Observer>
+      bool next(Data &result, const decode_limits &limits,
+                decode_state<Data, Observer> &state) {
+        using status = message_scanner::status;
+
+        // Skip past the previous message. Its bytes stay in the buffer until
+        // we need the room, but any views of it are now invalid.
+        message_scanner scanner(limits);
+        while(true) {
+          std::string_view pending(buf_.data() + begin_, end_ - begin_);
+          auto s = scanner.scan(pending);
+          if(s != status::incomplete || eof_) {
+            if(pending.empty())
+              return false;
+
+            // Now decode the message in one pass. If it's invalid (or
+            // truncated), this will report the error.
+            std::size_t size = s == status::complete ? scanner.size() :
+                               pending.size();
+            const char *begin = pending.data();
+            auto [ec, offset] = do_decode(result, begin, begin + size, false,
+                                          limits, state);
+            if(ec != decode_errc::ok)
+              throw_decode_error(ec, offset, state);
+            begin_ = begin - buf_.data();
+            return true;
+          }
+
+          if(end_ == buf_.size()) {
+            // Make room for more input, preferring to move the incomplete
+            // message to the front of the buffer over growing it.
+            if(begin_ != 0) {
+              std::copy(buf_.data() + begin_, buf_.data() + end_,
+                        buf_.data());
+              end_ -= begin_;
+              begin_ = 0;
+            } else {
+              buf_.resize((std::max)(buf_.size() * 2, initial_size));
+            }
+          }
+          std::size_t n = reader_.read(buf_.data() + end_,
+                                       buf_.size() - end_);
+          if(n == 0)
+            eof_ = true;
+          end_ += n;
+        }
+      }
+    private:
+      Reader reader_;
+      std::vector<char> buf_;
+      std::size_t begin_ = 0, end_ = 0;
+      bool eof_ = false;
+    };
+  } // namespace detail
+
+  // An input range of the successive messages in some input. Each message is
+  // decoded into the same value, reusing its storage, so views and
+  // references into it are only valid until the iterator is incremented.
+  template<typename Data, typename Source>
+  class decode_range {
+  public:
+    class iterator {
+    public:
+      using value_type = Data;
+      using difference_type = std::ptrdiff_t;
+
+      iterator() = default;
+
+      Data & operator *() const {
+        return range_->value_;
+      }
+
+      Data * operator ->() const {
+        return &range_->value_;
+      }
+
+      iterator & operator ++() {
+        range_->next();
+        return *this;
+      }
+
+      void operator ++(int) {
+        ++*this;
+      }
+
+      friend bool operator ==(const iterator &i, std::default_sentinel_t) {
+        return i.done();
+      }
+    private:
+      friend decode_range;
+      explicit iterator(decode_range *range) : range_(range) {}
+
+      bool done() const {
+        return range_->done_;
+      }
+
+      decode_range *range_ = nullptr;
+    };
+
+    decode_range(Source source, const decode_limits &limits)
+      : source_(std::move(source)), limits_(limits) {}
+
+    decode_range(const decode_range &) = delete;
+    decode_range & operator =(const decode_range &) = delete;
+    decode_range(decode_range &&) = default;
+    decode_range & operator =(decode_range &&) = default;
+
+    // Start decoding. Like other input ranges, this can only be called once.
+    iterator begin() {
+      next();
+      return iterator(this);
+    }
+
+    std::default_sentinel_t end() const noexcept {
+      return std::default_sentinel;
+    }
+  private:
+    void next() {
+      done_ = !source_.next(value_, limits_, state_);
+    }
+
+    Source source_;
+    decode_limits limits_;
+    detail::decode_state<Data> state_;
+    Data value_;
+    bool done_ = false;
+  };
+
+  template<typename Data, reader Reader>
+  inline decode_range<Data, detail::reader_source<Reader>>
+  basic_decode_each(Reader r, const decode_limits &limits = {}) {
+    return {detail::reader_source<Reader>(std::move(r)), limits};
+  }
+
+  template<typename Data>
+  inline decode_range<Data, detail::reader_source<istream_reader>>
+  basic_decode_each(std::istream &s, const decode_limits &limits = {}) {
+    return basic_decode_each<Data>(istream_reader(s), limits);
+  }
+
+  template<typename Data, typename String>
+  inline decode_range<Data, detail::buffer_source>
+  basic_decode_each(const String &s, const decode_limits &limits = {})
+  requires(std::ranges::contiguous_range<String> && !std::is_array_v<String>) {
+    auto begin = reinterpret_cast<const char *>(std::ranges::data(s));
+    return {detail::buffer_source(begin, begin + std::ranges::size(s)),
+            limits};
+  }
+
+  // The range refers to the buffer as it goes, so don't let it outlive it.
+  template<typename Data, typename String>
+  void basic_decode_each(const String &&s, const decode_limits &limits = {})
+  requires(std::ranges::contiguous_range<String> &&
+           !std::ranges::borrowed_range<String>) = delete;
+
+  template<typename Data>
+  inline decode_range<Data, detail::buffer_source>
+  basic_decode_each(const char *s, const decode_limits &limits = {}) {
+    return {detail::buffer_source(s, s + std::strlen(s)), limits};
+  }
+
+  template<typename ...T>
+  inline auto decode_each(T &&...t) {
+    return basic_decode_each<data>(std::forward<T>(t)...);
+  }
+
+  template<typename ...T>
+  inline auto decode_view_each(T &&...t) {
+    return basic_decode_each<data_view>(std::forward<T>(t)...);
+  }
+
+#ifdef BENCODE_HAS_COROUTINES
+  // A lazily-started coroutine producing a `T`. Awaiting a task starts it and
+  // resumes the awaiter once it finishes; to drive a task from outside a
+  // coroutine, call `start` and then `get` once it's `done`.
+  template<typename T>
+  class task {
+  public:
+    class promise_type {
+    public:
+      task get_return_object() {
+        return task(handle::from_promise(*this));
+      }
 
-      // For performance, decode as many digits as we know will fit within an
-      // `Integer` value, and then if there are any more beyond that, do
-      // proper overflow detection.
-      for(int i = 0; i != std::numeric_limits<Integer>::digits10; i++) {
-        if(begin == end)
-          throw end_of_input_error();
-        if(!std::isdigit(*begin))
-          return value;
+      std::suspend_always initial_suspend() noexcept {
+        return {};
+      }
 
-        if constexpr(std::is_signed_v<Integer>)
-          value = value * 10 + (*begin++ - u8'0') * sgn;
-        else
-          value = value * 10 + (*begin++ - u8'0');
+      auto final_suspend() noexcept {
+        struct final_awaiter {
+          bool await_ready() noexcept {
+            return false;
+          }
+
+          std::coroutine_handle<> await_suspend(handle h) noexcept {
+            if(auto c = h.promise().continuation_)
+              return c;
+            return std::noop_coroutine();
+          }
+
+          void await_resume() noexcept {}
+        };
+        return final_awaiter{};
       }
-      if(begin == end)
-        throw end_of_input_error();
 
-      // We're approaching the limits of what `Integer` can hold. Check for
-      // overflow.
-      if(std::isdigit(*begin)) {
-        Integer digit;
-        if constexpr(std::is_signed_v<Integer>) {
-          digit = (*begin++ - u8'0') * sgn;
-          check_over_underflow(value, digit, sgn);
-        } else {
-          digit = (*begin++ - u8'0');
-          check_overflow(value, digit);
-        }
-        value = value * 10 + digit;
+      template<typename U>
+      void return_value(U &&value) {
+        result_.template emplace<1>(std::forward<U>(value));
       }
 
-      // Still more digits? That's too many!
-      if(std::isdigit(*begin)) {
-        if(sgn == 1)
-          throw std::overflow_error("integer overflow");
-        else
-          throw std::underflow_error("integer underflow");
+      void unhandled_exception() {
+        result_.template emplace<2>(std::current_exception());
       }
+    private:
+      friend task;
+      std::coroutine_handle<> continuation_;
+      std::variant<std::monostate, T, std::exception_ptr> result_;
+    };
+
+    task(task &&other) noexcept
+      : handle_(std::exchange(other.handle_, {})),
+        started_(std::exchange(other.started_, false)) {}
 
-      return value;
+    task & operator =(task &&other) noexcept {
+      if(this != &other) {
+        if(handle_)
+          handle_.destroy();
+        handle_ = std::exchange(other.handle_, {});
+        started_ = std::exchange(other.started_, false);
+      }
+      return *this;
     }
 
-    template<std::integral Integer, std::input_iterator Iter>
-    Integer decode_int(Iter &begin, Iter end) {
-      assert(*begin == u8'i');
-      ++begin;
-      Integer sgn = 1;
-      if(*begin == u8'-') {
-        if constexpr(std::is_unsigned_v<Integer>) {
-          throw std::underflow_error("expected unsigned integer");
-        } else {
-          sgn = -1;
-          ++begin;
-        }
+    ~task() {
+      if(handle_)
+        handle_.destroy();
+    }
+
+    // Run the task until it first suspends, if it hasn't started yet. None
+    // of the below may be called on a task that's been moved from.
+    void start() {
+      assert(handle_);
+      if(!started_) {
+        started_ = true;
+        handle_.resume();
       }
+    }
 
-      Integer value = decode_digits<Integer>(begin, end, sgn);
-      if(*begin != u8'e')
-        throw syntax_error("expected 'e' token");
+    bool done() const noexcept {
+      assert(handle_);
+      return handle_.done();
+    }
 
-      ++begin;
-      return value;
+    // Get the task's result, rethrowing any exception it threw. The task must
+    // be `done`.
+    T get() {
+      assert(done());
+      auto &result = handle_.promise().result_;
+      if(result.index() == 2)
+        std::rethrow_exception(std::get<2>(result));
+      return std::move(std::get<1>(result));
     }
 
-    template<typename String, std::forward_iterator Iter>
-    String decode_chars(Iter &begin, Iter end, std::size_t len) {
-      if(std::distance(begin, end) < static_cast<std::ptrdiff_t>(len)) {
-        begin = end;
-        throw end_of_input_error();
-      }
+    bool await_ready() const noexcept {
+      return false;
+    }
 
-      auto orig = begin;
-      std::advance(begin, len);
-      return String(orig, begin);
+    std::coroutine_handle<>
+    await_suspend(std::coroutine_handle<> awaiter) noexcept {
+      assert(handle_ && !started_);
+      started_ = true;
+      handle_.promise().continuation_ = awaiter;
+      return handle_;
     }
 
-    template<typename String, std::input_iterator Iter>
-    inline String decode_chars(Iter &begin, Iter end, std::size_t len) {
-      String value(len, 0);
-      for(std::size_t i = 0; i < len; i++) {
-        if(begin == end)
-          throw end_of_input_error();
-        value[i] = *begin++;
-      }
-      return value;
+    T await_resume() {
+      return get();
     }
+  private:
+    using handle = std::coroutine_handle<promise_type>;
+    explicit task(handle h) : handle_(h) {}
 
-    template<std::ranges::view String, std::contiguous_iterator Iter>
-    String decode_chars(Iter &begin, Iter end, std::size_t len) {
-      if(std::distance(begin, end) < static_cast<std::ptrdiff_t>(len)) {
-        begin = end;
-        throw end_of_input_error();
+    handle handle_;
+    bool started_ = false;
+  };
+
+  // A source of input for `async_decode`. `buffer` returns the input that's
+  // been read but not yet consumed, `consume(n)` discards the first `n`
+  // characters of it, and `co_await fill()` appends more input to it,
+  // resuming with `false` at the end of the input.
+  template<typename T>
+  concept async_reader = requires(T &r, const T &cr, std::size_t n) {
+    { cr.buffer() } -> std::convertible_to<std::string_view>;
+    r.consume(n);
+    r.fill();
+  };
+
+  // Decode the next object from `reader`, suspending whenever it needs more
+  // input. `reader` must outlive the returned task.
+  template<typename Data, async_reader Reader>
+  task<Data> basic_async_decode(Reader &reader, decode_limits limits = {}) {
+    static_assert(!std::ranges::view<typename Data::string>,
+                  "reading asynchronously not supported for data views");
+
+    using status = detail::message_scanner::status;
+    detail::message_scanner scanner(limits);
+    auto s = status::incomplete;
+    while((s = scanner.scan(reader.buffer())) == status::incomplete) {
+      if(!co_await reader.fill())
+        break;
+    }
+
+    // Now decode the object in one pass. If it's invalid, this will report
+    // the error.
+    auto buf = reader.buffer();
+    std::size_t size = s == status::complete ? scanner.size() : buf.size();
+    const char *begin = buf.data();
+    Data result;
+    detail::decode_state<Data> state;
+    auto [ec, offset] = detail::do_decode(result, begin, begin + size, false,
+                                          limits, state);
+    if(ec != decode_errc::ok)
+      detail::throw_decode_error(ec, offset, state);
+    reader.consume(begin - buf.data());
+    co_return result;
+  }
+
+  template<async_reader Reader>
+  inline task<data> async_decode(Reader &reader, decode_limits limits = {}) {
+    return basic_async_decode<data>(reader, limits);
+  }
+
+#  ifdef BENCODE_HAS_POSIX
+  // A minimal event loop for `fd_async_reader`s, which waits with `poll` for
+  // their file descriptors to become readable.
+  class poll_scheduler {
+  public:
+    // Wait up to `timeout` milliseconds (or forever if negative) for any of
+    // the waiting file descriptors to become readable, and resume the
+    // coroutines waiting on them. Returns false if nothing was waiting.
+    bool run_once(int timeout = -1) {
+      if(waiting_.empty())
+        return false;
+
+      std::vector<pollfd> fds;
+      for(auto &i : waiting_)
+        fds.push_back({i.first, POLLIN, 0});
+      while(::poll(fds.data(), fds.size(), timeout) < 0) {
+        if(errno != EINTR)
+          throw std::system_error(errno, std::generic_category());
       }
 
-      String value(&*begin, len);
-      std::advance(begin, len);
-      return value;
+      // Resuming a coroutine may make it wait again, so collect everything
+      // that's ready first.
+      std::vector<std::coroutine_handle<>> ready;
+      for(std::size_t i = fds.size(); i-- != 0;) {
+        if(fds[i].revents) {
+          ready.push_back(waiting_[i].second);
+          waiting_.erase(waiting_.begin() + i);
+        }
+      }
+      for(auto i = ready.rbegin(); i != ready.rend(); ++i)
+        i->resume();
+      return true;
     }
 
-    template<typename String, std::input_iterator Iter>
-    String decode_str(Iter &begin, Iter end) {
-      assert(std::isdigit(*begin));
-      std::size_t len = decode_digits<std::size_t>(begin, end);
-      if(begin == end)
-        throw end_of_input_error();
-      if(*begin != u8':')
-        throw syntax_error("expected ':' token");
-      ++begin;
+    // Run until nothing is waiting.
+    void run() {
+      while(run_once());
+    }
 
-      return decode_chars<String>(begin, end, len);
+    void wait(int fd, std::coroutine_handle<> h) {
+      waiting_.emplace_back(fd, h);
     }
+  private:
+    std::vector<std::pair<int, std::coroutine_handle<>>> waiting_;
+  };
 
-    template<typename Data, std::input_iterator Iter>
-    Data do_decode(Iter &begin, Iter end, bool all) {
-      using Traits = variant_traits_for<Data>;
-      using Integer = typename Data::integer;
-      using String  = typename Data::string;
-      using List    = typename Data::list;
-      using Dict    = typename Data::dict;
+  // An `async_reader` for a POSIX file descriptor, which is put into
+  // non-blocking mode.
+  class fd_async_reader {
+  public:
+    static constexpr std::size_t initial_size = 4096;
 
-      Iter orig_begin = begin;
-      String dict_key;
-      Data result;
-      std::stack<Data*> state;
-
-      // There are three ways we can store an element we've just parsed:
-      //   1) to the root node
-      //   2) appended to the end of a list
-      //   3) inserted into a dict
-      // We then return a pointer to the thing we've just inserted, which lets
-      // us add that pointer to our node stack. Since we only ever manipulate
-      // the top element of the stack, this pointer should be valid for as long
-      // as we hold onto it.
-      auto store = [&result, &state, &dict_key](auto &&thing) -> Data * {
-        if(state.empty()) {
-          result = std::move(thing);
-          return &result;
-        } else if(auto p = Traits::template get_if<List>(state.top())) {
-          p->push_back(std::move(thing));
-          return &p->back();
-        } else if(auto p = Traits::template get_if<Dict>(state.top())) {
-          auto i = p->emplace(std::move(dict_key), std::move(thing));
-          if(!i.second) {
-            throw syntax_error(
-              "duplicated key in dict: " + std::string(i.first->first)
-            );
-          }
-          return &i.first->second;
-        }
-        assert(false && "expected list or dict");
-        return nullptr;
-      };
+    fd_async_reader(int fd, poll_scheduler &scheduler)
+      : fd_(fd), scheduler_(&scheduler) {
+      int flags = ::fcntl(fd_, F_GETFL);
+      if(flags < 0 || ::fcntl(fd_, F_SETFL, flags | O_NONBLOCK) < 0)
+        throw std::system_error(errno, std::generic_category());
+    }
 
-      try {
-        do {
-          if(begin == end)
-            throw end_of_input_error();
+    std::string_view buffer() const noexcept {
+      return std::string_view(buf_.data() + begin_, end_ - begin_);
+    }
 
-          if(*begin == u8'e') {
-            if(!state.empty()) {
-              ++begin;
-              state.pop();
-            } else {
-              throw syntax_error("unexpected 'e' token");
-            }
-          } else {
-            if(!state.empty() && Traits::index(*state.top()) == 3 /* dict */) {
-              if(!std::isdigit(*begin))
-                throw syntax_error("expected string start token for dict key");
-              dict_key = detail::decode_str<String>(begin, end);
-              if(begin == end)
-                throw end_of_input_error();
-            }
+    void consume(std::size_t n) noexcept {
+      assert(n <= end_ - begin_);
+      begin_ += n;
+    }
 
-            if(*begin == u8'i') {
-              store(detail::decode_int<Integer>(begin, end));
-            } else if(*begin == u8'l') {
-              ++begin;
-              state.push(store( List{} ));
-            } else if(*begin == u8'd') {
-              ++begin;
-              state.push(store( Dict{} ));
-            } else if(std::isdigit(*begin)) {
-              store(detail::decode_str<String>(begin, end));
-            } else {
-              throw syntax_error("unexpected type token");
-            }
-          }
-        } while(!state.empty());
+    auto fill() {
+      struct awaiter {
+        fd_async_reader &r;
+
+        bool await_ready() {
+          return r.try_read();
+        }
+
+        void await_suspend(std::coroutine_handle<> h) {
+          r.scheduler_->wait(r.fd_, h);
+        }
+
+        bool await_resume() {
+          // We were woken up by `poll`, so try reading again; if this was a
+          // spurious wakeup, our caller will just try again.
+          if(!r.done_reading_)
+            r.try_read();
+          r.done_reading_ = false;
+          return !r.eof_;
+        }
+      };
+      return awaiter{*this};
+    }
+
+    int fd() const noexcept { return fd_; }
+  private:
+    // Try to read more input without blocking. Returns true if we read
+    // anything or hit the end of the input.
+    bool try_read() {
+      if(eof_)
+        return done_reading_ = true;
+
+      // If the buffer is full, make room for more input, preferring to move
+      // any unconsumed input to the front over growing the buffer.
+      if(end_ == buf_.size()) {
+        if(begin_ != 0) {
+          std::copy(buf_.data() + begin_, buf_.data() + end_, buf_.data());
+          end_ -= begin_;
+          begin_ = 0;
+        } else {
+          buf_.resize((std::max)(buf_.size() * 2, initial_size));
+        }
+      }
 
-        if(all && begin != end)
-          throw syntax_error("extraneous character");
-      } catch(const std::exception &e) {
-        throw decode_error(e.what(), std::distance(orig_begin, begin),
-                           std::current_exception());
+      while(true) {
+        auto n = ::read(fd_, buf_.data() + end_, buf_.size() - end_);
+        if(n > 0) {
+          end_ += n;
+          return done_reading_ = true;
+        } else if(n == 0) {
+          eof_ = true;
+          return done_reading_ = true;
+        } else if(errno == EAGAIN || errno == EWOULDBLOCK) {
+          return false;
+        } else if(errno != EINTR) {
+          throw std::system_error(errno, std::generic_category());
+        }
       }
+    }
+
+    int fd_;
+    poll_scheduler *scheduler_;
+    std::vector<char> buf_;
+    std::size_t begin_ = 0, end_ = 0;
+    bool eof_ = false, done_reading_ = false;
+  };
+#  endif
+#endif
+
+  // A compiled path (see `detail::parse_path`) for finding values, either in
+  // decoded data or directly in an encoded buffer.
+  class path {
+  public:
+    explicit path(std::string_view p) : segments_(detail::parse_path(p)) {}
 
+    // Find all the values in `data` matching this path.
+    template<typename Data>
+    requires requires { typename Data::dict; }
+    std::vector<Data *> find_all(Data &data) const {
+      std::vector<Data *> result;
+      find_in(data, 0, result, false);
       return result;
     }
 
+    // Find the first value in `data` matching this path, or null if there
+    // isn't one.
     template<typename Data>
-    Data do_decode(std::istream &s, eof_behavior e, bool all) {
-      static_assert(!std::ranges::view<typename Data::string>,
-                    "reading from stream not supported for data views");
+    requires requires { typename Data::dict; }
+    Data * find(Data &data) const {
+      std::vector<Data *> result;
+      find_in(data, 0, result, true);
+      return result.empty() ? nullptr : result.front();
+    }
 
-      std::istreambuf_iterator<char> begin(s), end;
-      auto result = detail::do_decode<Data>(begin, end, all);
-      // If we hit EOF, update the parent stream.
-      if(e == check_eof && begin == end)
-        s.setstate(std::ios_base::eofbit);
+    // Find all the values in the encoded document `buf` matching this path,
+    // returning the encoded form of each. Subtrees that can't match are
+    // skipped without decoding them. Throws a `decode_error` if `buf` is
+    // malformed.
+    std::vector<std::string_view> find_all(std::string_view buf) const {
+      std::vector<std::string_view> result;
+      const char *begin = buf.data(), *end = begin + buf.size();
+      auto ec = find_in(begin, end, 0, result, false);
+      if(ec == decode_errc::ok && begin != end)
+        ec = decode_errc::extraneous_character;
+      if(ec != decode_errc::ok)
+        throw detail::make_decode_error(ec, begin - buf.data());
       return result;
     }
 
-  } // namespace detail
+    // Find the first value in the encoded document `buf` matching this path.
+    // This stops reading `buf` as soon as it finds a match.
+    std::optional<std::string_view> find(std::string_view buf) const {
+      std::vector<std::string_view> result;
+      const char *begin = buf.data(), *end = begin + buf.size();
+      if(auto ec = find_in(begin, end, 0, result, true);
+         ec != decode_errc::ok)
+        throw detail::make_decode_error(ec, begin - buf.data());
+      if(result.empty())
+        return std::nullopt;
+      return result.front();
+    }
+  private:
+    using kind_type = detail::path_segment::kind_type;
 
-  template<typename Data, std::input_iterator Iter>
-  inline Data basic_decode(Iter begin, Iter end) {
-    return detail::do_decode<Data>(begin, end, true);
-  }
+    // Add the matches in `node` for the segments starting at `i` to `out`.
+    // Returns true if we should stop looking.
+    template<typename Data>
+    bool find_in(Data &node, std::size_t i, std::vector<Data *> &out,
+                 bool first) const {
+      using Traits = variant_traits_for<std::remove_const_t<Data>>;
+      using List = typename Data::list;
+      using Dict = typename Data::dict;
 
-  template<typename Data, typename String>
-  inline Data basic_decode(const String &s)
-  requires(detail::iterable<String> && !std::is_array_v<String>) {
-    return basic_decode<Data>(std::begin(s), std::end(s));
-  }
+      if(i == segments_.size()) {
+        out.push_back(&node);
+        return first;
+      }
 
-  template<typename Data>
-  inline Data basic_decode(const char *s) {
-    return basic_decode<Data>(s, s + std::strlen(s));
-  }
+      auto &seg = segments_[i];
+      if(auto p = Traits::template get_if<Dict>(&node)) {
+        if(seg.kind == kind_type::wildcard) {
+          for(auto &&[key, value] : *p) {
+            if(find_in(value, i + 1, out, first))
+              return true;
+          }
+        } else if(auto j = p->find(seg.key); j != p->end()) {
+          return find_in(j->second, i + 1, out, first);
+        }
+      } else if(auto p = Traits::template get_if<List>(&node)) {
+        std::size_t lo = 0, hi = p->size();
+        if(seg.kind != kind_type::wildcard) {
+          lo = seg.first;
+          hi = (std::min)(hi, seg.last);
+        }
+        for(std::size_t j = lo; j < hi; j++) {
+          if(find_in((*p)[j], i + 1, out, first))
+            return true;
+        }
+      }
+      return false;
+    }
 
-  template<typename Data>
-  inline Data basic_decode(const char *s, std::size_t length) {
-    return basic_decode<Data>(s, s + length);
-  }
+    decode_errc find_in(const char *&begin, const char *end, std::size_t i,
+                        std::vector<std::string_view> &out,
+                        bool first) const {
+      constexpr auto unlimited = decode_limits::unlimited;
+      auto done = [&]() { return first && !out.empty(); };
 
-  template<typename Data>
-  inline Data basic_decode(std::istream &s, eof_behavior e = check_eof) {
-    return detail::do_decode<Data>(s, e, true);
-  }
+      if(i == segments_.size()) {
+        const char *start = begin;
+        auto ec = detail::skip_value(begin, end, unlimited, unlimited);
+        if(ec == decode_errc::ok)
+          out.emplace_back(start, begin - start);
+        return ec;
+      }
+      if(begin == end)
+        return decode_errc::unexpected_end_of_input;
 
-  template<typename Data, std::input_iterator Iter>
-  inline Data basic_decode_some(Iter &begin, Iter end) {
-    return detail::do_decode<Data>(begin, end, false);
-  }
+      auto &seg = segments_[i];
+      bool is_dict = *begin == u8'd';
+      if(!is_dict && *begin != u8'l')
+        return detail::skip_value(begin, end, unlimited, unlimited);
 
-  template<typename Data>
-  inline Data basic_decode_some(const char *&s) {
-    return basic_decode_some<Data>(s, s + std::strlen(s));
-  }
+      ++begin;
+      for(std::size_t index = 0; ; index++) {
+        if(begin == end)
+          return decode_errc::unexpected_end_of_input;
+        if(*begin == u8'e')
+          break;
 
-  template<typename Data>
-  inline Data basic_decode_some(const char *&s, std::size_t length) {
-    return basic_decode_some<Data>(s, s + length);
-  }
+        bool matched;
+        if(is_dict) {
+          if(!std::isdigit(*begin))
+            return decode_errc::expected_string_start_token;
+          std::string_view key;
+          if(auto ec = detail::decode_str(begin, end, key, unlimited);
+             ec != decode_errc::ok)
+            return ec;
+          matched = seg.matches(key);
+        } else {
+          matched = seg.matches(index);
+        }
 
-  template<typename Data>
-  inline Data basic_decode_some(std::istream &s, eof_behavior e = check_eof) {
-    return detail::do_decode<Data>(s, e, false);
-  }
+        auto ec = matched ? find_in(begin, end, i + 1, out, first) :
+                  detail::skip_value(begin, end, unlimited, unlimited);
+        if(ec != decode_errc::ok || done())
+          return ec;
+      }
+      ++begin;
+      return decode_errc::ok;
+    }
 
-  template<typename ...T>
-  inline data decode(T &&...t) {
-    return basic_decode<data>(std::forward<T>(t)...);
-  }
+    // Find where the value at this path starts in [begin, end), leaving
+    // `begin` there and setting `size` to the length of its encoded form. If
+    // the path names a dict key that doesn't exist yet, `begin` is left where
+    // the key should be inserted to keep the dict sorted, and `size` is 0.
+    decode_errc locate(const char *&begin, const char *end, std::size_t &size,
+                       bool &insert) const {
+      constexpr auto unlimited = decode_limits::unlimited;
 
-  template<typename ...T>
-  inline data decode_some(T &&...t) {
-    return basic_decode_some<data>(std::forward<T>(t)...);
-  }
+      for(std::size_t i = 0; i != segments_.size(); i++) {
+        auto &seg = segments_[i];
+        if(seg.kind == kind_type::wildcard)
+          throw std::invalid_argument("path must refer to a single value");
+        if(begin == end)
+          return decode_errc::unexpected_end_of_input;
 
-  template<typename ...T>
-  inline data_view decode_view(T &&...t) {
-    return basic_decode<data_view>(std::forward<T>(t)...);
-  }
+        if(*begin == u8'd') {
+          ++begin;
+          bool found = false;
+          while(true) {
+            if(begin == end)
+              return decode_errc::unexpected_end_of_input;
+            if(*begin == u8'e')
+              break;
+            if(!std::isdigit(*begin))
+              return decode_errc::expected_string_start_token;
 
-  template<typename ...T>
-  inline data_view decode_view_some(T &&...t) {
-    return basic_decode_some<data_view>(std::forward<T>(t)...);
-  }
+            const char *key_begin = begin;
+            std::string_view key;
+            if(auto ec = detail::decode_str(begin, end, key, unlimited);
+               ec != decode_errc::ok)
+              return ec;
+            if(key == seg.key) {
+              found = true;
+              break;
+            }
+            if(key > seg.key) {
+              begin = key_begin;
+              break;
+            }
+            if(auto ec = detail::skip_value(begin, end, unlimited, unlimited);
+               ec != decode_errc::ok)
+              return ec;
+          }
 
-#ifdef BENCODE_HAS_BOOST
-  template<typename ...T>
-  inline boost_data boost_decode(T &&...t) {
-    return basic_decode<boost_data>(std::forward<T>(t)...);
-  }
+          if(!found) {
+            if(i + 1 != segments_.size())
+              throw_missing();
+            size = 0;
+            insert = true;
+            return decode_errc::ok;
+          }
+        } else if(*begin == u8'l') {
+          if(seg.kind == kind_type::range && seg.last != seg.first + 1)
+            throw std::invalid_argument("path must refer to a single value");
+          if(seg.first == seg.last)
+            throw_missing();
+          ++begin;
+          for(std::size_t index = 0; index != seg.first; index++) {
+            if(begin == end)
+              return decode_errc::unexpected_end_of_input;
+            if(*begin == u8'e')
+              throw_missing();
+            if(auto ec = detail::skip_value(begin, end, unlimited, unlimited);
+               ec != decode_errc::ok)
+              return ec;
+          }
+          if(begin == end)
+            return decode_errc::unexpected_end_of_input;
+          if(*begin == u8'e')
+            throw_missing();
+        } else {
+          throw_missing();
+        }
+      }
 
-  template<typename ...T>
-  inline boost_data boost_decode_some(T &&...t) {
-    return basic_decode_some<boost_data>(std::forward<T>(t)...);
+      const char *start = begin;
+      auto ec = detail::skip_value(begin, end, unlimited, unlimited);
+      size = begin - start;
+      begin = start;
+      insert = false;
+      return ec;
+    }
+
+    [[noreturn]] static void throw_missing() {
+      throw std::out_of_range("no value at path");
+    }
+
+    template<typename Buffer, typename T>
+    friend void patch(Buffer &buf, const path &p, const T &value);
+
+    std::vector<detail::path_segment> segments_;
+  };
+
+  using raw_dict_view = std::map<std::string_view, raw_view, std::less<>>;
+
+  namespace detail {
+    inline decode_errc
+    decode_raw_value(const char *&begin, const char *end, raw_view &value,
+                     const decode_limits &limits) {
+      const char *orig = begin;
+      auto ec = skip_value(begin, end, limits.max_depth,
+                           limits.max_string_length);
+      if(ec == decode_errc::ok)
+        value = raw_view(std::string_view(orig, begin - orig));
+      return ec;
+    }
+
+    // Decode a dict, keeping each of its values raw.
+    inline decode_errc
+    decode_raw_dict(const char *&begin, const char *end, raw_dict_view &value,
+                    const decode_limits &limits, std::string_view &dict_key) {
+      if(begin == end)
+        return decode_errc::unexpected_end_of_input;
+      if(*begin != u8'd')
+        return decode_errc::unexpected_type_token;
+      if(limits.max_depth == 0)
+        return decode_errc::depth_limit_exceeded;
+      ++begin;
+
+      decode_limits value_limits = limits;
+      value_limits.max_depth = limits.max_depth - 1;
+      while(true) {
+        if(begin == end)
+          return decode_errc::unexpected_end_of_input;
+        if(*begin == u8'e')
+          break;
+        if(value.size() >= limits.max_dict_size)
+          return decode_errc::dict_size_limit_exceeded;
+        if(!std::isdigit(*begin))
+          return decode_errc::expected_string_start_token;
+
+        if(auto ec = decode_str(begin, end, dict_key,
+                                limits.max_string_length);
+           ec != decode_errc::ok)
+          return ec;
+        raw_view v;
+        if(auto ec = decode_raw_value(begin, end, v, value_limits);
+           ec != decode_errc::ok)
+          return ec;
+        if(!value.emplace(dict_key, v).second)
+          return decode_errc::duplicated_key;
+      }
+      ++begin;
+      return decode_errc::ok;
+    }
+
+    template<typename Result, typename Decode>
+    Result do_decode_raw(const char *&begin, const char *end, bool all,
+                         const decode_limits &limits, Decode &&decode) {
+      // Enforce `max_bytes` by pretending the input ends there.
+      const char *orig_begin = begin;
+      bool truncated = static_cast<std::size_t>(end - begin) >
+                       limits.max_bytes;
+      const char *limited_end = truncated ? begin + limits.max_bytes : end;
+
+      Result result;
+      std::string_view dict_key;
+      auto ec = decode(begin, limited_end, result, dict_key);
+      if(ec == decode_errc::unexpected_end_of_input && truncated)
+        ec = decode_errc::byte_limit_exceeded;
+      else if(ec == decode_errc::ok && all && begin != end)
+        ec = decode_errc::extraneous_character;
+
+      if(ec == decode_errc::duplicated_key)
+        throw make_decode_error(ec, begin - orig_begin, dict_key);
+      else if(ec != decode_errc::ok)
+        throw make_decode_error(ec, begin - orig_begin);
+      return result;
+    }
+
+    inline auto raw_value_decoder(const decode_limits &limits) {
+      return [&limits](const char *&begin, const char *end, raw_view &value,
+                       std::string_view &) {
+        return decode_raw_value(begin, end, value, limits);
+      };
+    }
+
+    inline auto raw_dict_decoder(const decode_limits &limits) {
+      return [&limits](const char *&begin, const char *end,
+                       raw_dict_view &value, std::string_view &dict_key) {
+        return decode_raw_dict(begin, end, value, limits, dict_key);
+      };
+    }
+  } // namespace detail
+
+  // Get the encoded form of the bencode object in `s` without decoding it.
+  // This only checks that the input is structurally valid (see
+  // `detail::skip_value`).
+  inline raw_view
+  decode_raw_view(std::string_view s, const decode_limits &limits = {}) {
+    const char *begin = s.data();
+    return detail::do_decode_raw<raw_view>(
+      begin, begin + s.size(), true, limits, detail::raw_value_decoder(limits)
+    );
   }
 
-  template<typename ...T>
-  inline boost_data_view boost_decode_view(T &&...t) {
-    return basic_decode<boost_data_view>(std::forward<T>(t)...);
+  inline raw_view
+  decode_raw_view_some(const char *&begin, const char *end,
+                       const decode_limits &limits = {}) {
+    return detail::do_decode_raw<raw_view>(
+      begin, end, false, limits, detail::raw_value_decoder(limits)
+    );
   }
 
-  template<typename ...T>
-  inline boost_data_view boost_decode_view_some(T &&...t) {
-    return basic_decode_some<boost_data_view>(std::forward<T>(t)...);
+  inline raw decode_raw(std::string_view s, const decode_limits &limits = {}) {
+    return raw(decode_raw_view(s, limits));
+  }
+
+  // Decode the dict in `s`, keeping each of its values in their encoded form.
+  inline raw_dict_view
+  decode_raw_dict_view(std::string_view s, const decode_limits &limits = {}) {
+    const char *begin = s.data();
+    return detail::do_decode_raw<raw_dict_view>(
+      begin, begin + s.size(), true, limits, detail::raw_dict_decoder(limits)
+    );
   }
-#endif
 
   namespace detail {
     template<std::input_or_output_iterator Iter>
@@ -714,6 +5537,31 @@ namespace bencode {
       Iter &iter;
     };
 
+    // An output iterator that can write a whole block of characters at once.
+    template<typename Iter>
+    concept block_output = requires(Iter &i, const char *data, std::size_t n) {
+      i.write(data, n);
+    };
+
+    template<std::input_or_output_iterator Iter, typename InIter>
+    Iter write_chars(Iter iter, InIter begin, InIter end) {
+      using value_type = std::iter_value_t<InIter>;
+      constexpr bool is_char = std::same_as<value_type, char> ||
+                               byte_like<value_type>;
+      if constexpr(block_output<Iter> && std::contiguous_iterator<InIter> &&
+                   is_char) {
+        iter.write(reinterpret_cast<const char *>(std::to_address(begin)),
+                   static_cast<std::size_t>(end - begin));
+        return iter;
+      } else if constexpr(byte_like<value_type>) {
+        return std::transform(begin, end, iter, [](auto c) {
+          return static_cast<char>(c);
+        });
+      } else {
+        return std::copy(begin, end, iter);
+      }
+    }
+
     template<std::input_or_output_iterator Iter, typename T>
     Iter write_integer(Iter iter, T value) {
       // digits10 tells how many base-10 digits can fully fit in T, so we add 1
@@ -723,11 +5571,48 @@ namespace bencode {
       auto r = std::to_chars(buf, buf + sizeof(buf), value);
       if(r.ec != std::errc())
         throw std::system_error(std::make_error_code(r.ec));
-      return std::copy(buf, r.ptr, iter);
+      return write_chars(iter, buf, r.ptr);
     }
+
+    // Adapt an output iterator of `std::byte`s so that we can write `char`s
+    // to it.
+    template<byte_output Iter>
+    class byte_writer {
+    public:
+      using difference_type = std::iter_difference_t<Iter>;
+
+      byte_writer() = default;
+      explicit byte_writer(Iter iter) : iter_(std::move(iter)) {}
+
+      byte_writer & operator *() {
+        return *this;
+      }
+
+      byte_writer & operator =(char c) {
+        *iter_ = static_cast<std::byte>(c);
+        return *this;
+      }
+
+      byte_writer & operator ++() {
+        ++iter_;
+        return *this;
+      }
+
+      byte_writer operator ++(int) {
+        byte_writer old = *this;
+        ++iter_;
+        return old;
+      }
+
+      Iter base() const {
+        return iter_;
+      }
+    private:
+      Iter iter_;
+    };
   } // namespace detail
 
-  template<std::input_or_output_iterator Iter>
+  template<detail::char_output Iter>
   inline Iter encode_to(Iter iter, integer value) {
     *iter++ = u8'i';
     iter = detail::write_integer(iter, value);
@@ -735,40 +5620,83 @@ namespace bencode {
     return iter;
   }
 
-  template<std::input_or_output_iterator Iter, detail::stringish Str>
+  template<detail::char_output Iter, detail::stringish Str>
   requires(!std::is_array_v<Str>)
   inline Iter encode_to(Iter iter, const Str &value) {
-    detail::write_integer(iter, std::size(value));
+    iter = detail::write_integer(iter, std::size(value));
     *iter++ = u8':';
-    return std::copy(std::begin(value), std::end(value), iter);
+    return detail::write_chars(iter, std::begin(value), std::end(value));
   }
 
-  template<std::input_or_output_iterator Iter>
+  template<detail::char_output Iter>
   inline Iter encode_to(Iter iter, const char *value, std::size_t length) {
-    detail::write_integer(iter, length);
+    iter = detail::write_integer(iter, length);
     *iter++ = u8':';
-    return std::copy(value, value + length, iter);
+    return detail::write_chars(iter, value, value + length);
+  }
+
+  template<detail::char_output Iter, typename String>
+  inline Iter encode_to(Iter iter, const basic_raw<String> &value) {
+    return detail::write_chars(iter, std::begin(value.data()),
+                               std::end(value.data()));
   }
 
-  template<std::input_or_output_iterator Iter, std::size_t N>
+  template<detail::char_output Iter, std::size_t N>
   inline Iter encode_to(Iter iter, const char (&value)[N]) {
     // Don't write the null terminator.
     return encode_to(std::forward<Iter>(iter), value, N - 1);
   }
 
-  template<std::input_or_output_iterator Iter, detail::iterable Seq>
+  template<detail::char_output Iter, detail::iterable Seq>
   Iter encode_to(Iter iter, const Seq &value) {
-    detail::list_encoder e(iter);
-    for(auto &&i : value)
-      e.add(i);
+    {
+      detail::list_encoder e(iter);
+      for(auto &&i : value)
+        e.add(i);
+    }
     return iter;
   }
 
-  template<std::input_or_output_iterator Iter, detail::mapping Map>
+  namespace detail {
+    template<typename T>
+    concept unordered_mapping = mapping<T> && requires {
+      typename T::hasher;
+    };
+
+    // Get pointers to the elements of `value`, sorted by key as bencode
+    // requires. The keys themselves aren't copied.
+    template<unordered_mapping Map>
+    auto sorted_elements(const Map &value) {
+      auto key = [](const auto *i) {
+        return std::string_view(
+          reinterpret_cast<const char *>(std::ranges::data(i->first)),
+          std::ranges::size(i->first)
+        );
+      };
+
+      std::vector<const typename Map::value_type *> result;
+      result.reserve(value.size());
+      for(auto &&i : value)
+        result.push_back(&i);
+      std::sort(result.begin(), result.end(), [key](auto *lhs, auto *rhs) {
+        return key(lhs) < key(rhs);
+      });
+      return result;
+    }
+  } // namespace detail
+
+  template<detail::char_output Iter, detail::mapping Map>
   Iter encode_to(Iter iter, const Map &value) {
-    detail::dict_encoder e(iter);
-    for(auto &&i : value)
-      e.add(i.first, i.second);
+    {
+      detail::dict_encoder e(iter);
+      if constexpr(detail::unordered_mapping<Map>) {
+        for(auto *i : detail::sorted_elements(value))
+          e.add(i->first, i->second);
+      } else {
+        for(auto &&i : value)
+          e.add(i.first, i.second);
+      }
+    }
     return iter;
   }
 
@@ -780,26 +5708,34 @@ namespace bencode {
 
       template<typename T>
       void operator ()(T &&operand) const {
-        encode_to(iter, std::forward<T>(operand));
+        iter = encode_to(iter, std::forward<T>(operand));
       }
     private:
       Iter &iter;
     };
   } // namespace detail
 
-  template<std::input_or_output_iterator Iter,
+  template<detail::char_output Iter,
            template<typename ...> typename Variant, typename I, typename S,
-           template<typename ...> typename L, template<typename ...> typename D>
-  Iter encode_to(Iter iter, const basic_data<Variant, I, S, L, D> &value) {
+           template<typename ...> typename L, template<typename ...> typename D,
+           typename ...Raw>
+  Iter
+  encode_to(Iter iter, const basic_data<Variant, I, S, L, D, Raw...> &value) {
     variant_traits<Variant>::visit(detail::encode_visitor(iter), value);
     return iter;
   }
 
+  template<detail::byte_output Iter, typename ...T>
+  Iter encode_to(Iter iter, T &&...t) {
+    return encode_to(detail::byte_writer(std::move(iter)),
+                     std::forward<T>(t)...).base();
+  }
+
   namespace detail {
     template<std::input_or_output_iterator Iter>
     template<typename T>
     inline list_encoder<Iter> & list_encoder<Iter>::add(T &&value) {
-      encode_to(iter, std::forward<T>(value));
+      iter = encode_to(iter, std::forward<T>(value));
       return *this;
     }
 
@@ -807,25 +5743,745 @@ namespace bencode {
     template<typename T>
     inline dict_encoder<Iter> &
     dict_encoder<Iter>::add(const string_view &key, T &&value) {
-      encode_to(iter, key);
-      encode_to(iter, std::forward<T>(value));
+      iter = encode_to(iter, key);
+      iter = encode_to(iter, std::forward<T>(value));
       return *this;
     }
   } // namespace detail
 
+  // A destination for encoded output, which accepts blocks of characters via
+  // `write(data, n)`.
+  template<typename T>
+  concept sink = requires(T &s, const char *data, std::size_t n) {
+    s.write(data, n);
+  };
+
+  // Write to an `std::ostream`'s stream buffer.
+  class ostream_sink {
+  public:
+    explicit ostream_sink(std::ostream &os) : os_(&os) {}
+
+    void write(const char *data, std::size_t n) {
+      auto *sb = os_->rdbuf();
+      if(!sb || sb->sputn(data, static_cast<std::streamsize>(n)) !=
+         static_cast<std::streamsize>(n))
+        os_->setstate(std::ios_base::badbit);
+    }
+  private:
+    std::ostream *os_;
+  };
+
+  // Append to a container of `char`s, such as an `std::string` or an
+  // `std::vector<char>`.
+  template<typename Container>
+  class container_sink {
+  public:
+    explicit container_sink(Container &c) : c_(&c) {}
+
+    void write(const char *data, std::size_t n) {
+      c_->insert(c_->end(), data, data + n);
+    }
+  private:
+    Container *c_;
+  };
+
+#ifdef BENCODE_HAS_POSIX
+  // Write to a (blocking) POSIX file descriptor.
+  class fd_sink {
+  public:
+    explicit fd_sink(int fd) : fd_(fd) {}
+
+    void write(const char *data, std::size_t n) {
+      while(n != 0) {
+        auto r = ::write(fd_, data, n);
+        if(r < 0) {
+          if(errno == EINTR)
+            continue;
+          throw std::system_error(errno, std::generic_category());
+        }
+        data += r;
+        n -= static_cast<std::size_t>(r);
+      }
+    }
+  private:
+    int fd_;
+  };
+#endif
+
+  namespace detail {
+    // Collect small writes into a buffer before passing them on to a sink.
+    // Writes at least as big as the buffer go to the sink directly.
+    template<sink Sink>
+    class buffered_sink {
+    public:
+      static constexpr std::size_t buffer_size = 4096;
+
+      explicit buffered_sink(Sink &sink) : sink_(sink) {}
+
+      void put(char c) {
+        if(size_ == buffer_size)
+          flush();
+        buf_[size_++] = c;
+      }
+
+      void write(const char *data, std::size_t n) {
+        if(buffer_size - size_ < n) {
+          flush();
+          if(n >= buffer_size) {
+            sink_.write(data, n);
+            return;
+          }
+        }
+        std::memcpy(buf_ + size_, data, n);
+        size_ += n;
+      }
+
+      void flush() {
+        if(size_ != 0)
+          sink_.write(buf_, size_);
+        size_ = 0;
+      }
+    private:
+      Sink &sink_;
+      char buf_[buffer_size];
+      std::size_t size_ = 0;
+    };
+
+    // An output iterator over a `buffered_sink`.
+    template<sink Sink>
+    class sink_iterator {
+    public:
+      using difference_type = std::ptrdiff_t;
+
+      sink_iterator() = default;
+      explicit sink_iterator(buffered_sink<Sink> &s) : sink_(&s) {}
+
+      sink_iterator & operator *() {
+        return *this;
+      }
+
+      sink_iterator & operator =(char c) {
+        sink_->put(c);
+        return *this;
+      }
+
+      sink_iterator & operator ++() {
+        return *this;
+      }
+
+      sink_iterator operator ++(int) {
+        return *this;
+      }
+
+      void write(const char *data, std::size_t n) {
+        sink_->write(data, n);
+      }
+    private:
+      buffered_sink<Sink> *sink_ = nullptr;
+    };
+  } // namespace detail
+
+  template<typename Sink, typename ...T>
+  requires(sink<std::remove_cvref_t<Sink>> &&
+           !std::input_or_output_iterator<std::remove_cvref_t<Sink>> &&
+           !std::derived_from<std::remove_cvref_t<Sink>, std::ostream>)
+  void encode_to(Sink &&s, T &&...t) {
+    detail::buffered_sink<std::remove_cvref_t<Sink>> buffered(s);
+    encode_to(detail::sink_iterator(buffered), std::forward<T>(t)...);
+    buffered.flush();
+  }
+
+  namespace detail {
+    // A sink that counts the bytes written to another sink.
+    template<sink Sink>
+    class counting_sink {
+    public:
+      explicit counting_sink(Sink &s) : sink_(&s) {}
+
+      void write(const char *data, std::size_t n) {
+        sink_->write(data, n);
+        count_ += n;
+      }
+
+      std::size_t count() const noexcept { return count_; }
+    private:
+      Sink *sink_;
+      std::size_t count_ = 0;
+    };
+
+    // An output iterator that counts the characters written to another one.
+    template<char_output Iter>
+    class counting_output_iterator {
+    public:
+      using difference_type = std::ptrdiff_t;
+
+      counting_output_iterator() = default;
+      explicit counting_output_iterator(Iter iter) : iter_(std::move(iter)) {}
+
+      counting_output_iterator & operator *() {
+        return *this;
+      }
+
+      counting_output_iterator & operator =(char c) {
+        *iter_ = c;
+        ++iter_;
+        ++count_;
+        return *this;
+      }
+
+      counting_output_iterator & operator ++() {
+        return *this;
+      }
+
+      // Return a reference so that `*i++ = c` counts `c`.
+      counting_output_iterator & operator ++(int) {
+        return *this;
+      }
+
+      void write(const char *data, std::size_t n) requires block_output<Iter> {
+        iter_.write(data, n);
+        count_ += n;
+      }
+
+      Iter base() const { return iter_; }
+      std::size_t count() const noexcept { return count_; }
+    private:
+      Iter iter_;
+      std::size_t count_ = 0;
+    };
+  } // namespace detail
+
+  // Encode to an output iterator, reporting the encoding to `obs`.
+  template<observer Observer, detail::char_output Iter, typename ...T>
+  Iter encode_to(Observer &obs, Iter iter, T &&...t) {
+    obs.begin_encode();
+    detail::counting_output_iterator counted(std::move(iter));
+    counted = encode_to(counted, std::forward<T>(t)...);
+    obs.end_encode(counted.count());
+    return counted.base();
+  }
+
+  // Encode to a sink, reporting the encoding to `obs`.
+  template<observer Observer, typename Sink, typename ...T>
+  requires(sink<std::remove_cvref_t<Sink>> &&
+           !std::input_or_output_iterator<std::remove_cvref_t<Sink>>)
+  void encode_to(Observer &obs, Sink &&s, T &&...t) {
+    obs.begin_encode();
+    detail::counting_sink counted(s);
+    encode_to(counted, std::forward<T>(t)...);
+    obs.end_encode(counted.count());
+  }
+
   template<typename ...T>
   std::string encode(T &&...t) {
-    std::stringstream ss;
-    encode_to(std::ostreambuf_iterator(ss), std::forward<T>(t)...);
-    return ss.str();
+    std::string result;
+    encode_to(container_sink(result), std::forward<T>(t)...);
+    return result;
   }
 
   template<typename ...T>
   std::ostream& encode_to(std::ostream &os, T &&...t) {
-    encode_to(std::ostreambuf_iterator(os), std::forward<T>(t)...);
+    encode_to(ostream_sink(os), std::forward<T>(t)...);
     return os;
   }
 
+  namespace detail {
+    // Replace `old_size` bytes at `offset` in `buf` with `s`, moving the rest
+    // of the buffer at most once. If `buf` can't be resized (e.g. it's a
+    // `std::span`), `s` must be the same size as the bytes it replaces.
+    template<typename Buffer>
+    void splice(Buffer &buf, std::size_t offset, std::size_t old_size,
+                std::string_view s) {
+      auto chars = [&buf]() {
+        return reinterpret_cast<char *>(std::ranges::data(buf));
+      };
+      std::size_t tail = std::ranges::size(buf) - offset - old_size;
+
+      if constexpr(requires { buf.resize(0); }) {
+        if(s.size() > old_size) {
+          buf.resize(std::ranges::size(buf) + s.size() - old_size);
+          std::memmove(chars() + offset + s.size(),
+                       chars() + offset + old_size, tail);
+        } else if(s.size() < old_size) {
+          std::memmove(chars() + offset + s.size(),
+                       chars() + offset + old_size, tail);
+          buf.resize(std::ranges::size(buf) - old_size + s.size());
+        }
+      } else {
+        if(s.size() != old_size)
+          throw std::length_error("buffer can't be resized");
+      }
+      std::memcpy(chars() + offset, s.data(), s.size());
+    }
+  } // namespace detail
+
+  // Replace the value at path `p` in the encoded document `buf` with `value`.
+  // If `p` names a dict key that doesn't exist, it's inserted in sorted
+  // position. Only the part of `buf` up to the patched value is scanned, and
+  // if the new value's encoding is the same size as the old one, it's written
+  // over it in place; this is the only kind of patch possible for buffers
+  // that can't be resized, like a `std::span`. Throws an `std::out_of_range`
+  // if there's no value at `p` (other than a missing final dict key), a
+  // `decode_error` if `buf` is malformed before the value, and an
+  // `std::length_error` if `buf` would need to be resized but can't be.
+  template<typename Buffer, typename T>
+  void patch(Buffer &buf, const path &p, const T &value) {
+    using Value = std::ranges::range_value_t<Buffer>;
+    static_assert(std::ranges::contiguous_range<Buffer> &&
+                  (std::same_as<Value, char> || detail::byte_like<Value>),
+                  "buffer must be a contiguous container of bytes");
+
+    const char *data = reinterpret_cast<const char *>(std::ranges::data(buf));
+    const char *begin = data, *end = data + std::ranges::size(buf);
+    std::size_t size;
+    bool insert;
+    if(auto ec = p.locate(begin, end, size, insert); ec != decode_errc::ok)
+      throw detail::make_decode_error(ec, begin - data);
+
+    std::string replacement;
+    if(insert)
+      encode_to(container_sink(replacement), p.segments_.back().key);
+    encode_to(container_sink(replacement), value);
+    detail::splice(buf, begin - data, size, replacement);
+  }
+
+  // A message compiled ahead of time into pre-encoded fragments, with holes
+  // for the values that change from one message to the next. Each hole is
+  // typed by the value it replaces in the original message: integers and
+  // strings can only be filled with the same kind of value, and lists and
+  // dicts can be filled with anything.
+  class message_template {
+  public:
+    enum class hole_kind { integer, string, value };
+
+    // Compile `message`, leaving holes for the values at the paths in
+    // `holes`, which must each refer to a single value and be listed in the
+    // order they appear in the encoded message.
+    template<typename Data>
+    requires requires { typename Data::dict; }
+    message_template(const Data &message,
+                     std::initializer_list<std::string_view> holes) {
+      std::vector<const Data *> nodes;
+      for(auto h : holes) {
+        auto found = path(h).find_all(message);
+        if(found.size() != 1)
+          throw std::invalid_argument("template hole must refer to a single "
+                                      "value");
+        nodes.push_back(found.front());
+      }
+
+      std::size_t next = 0;
+      compile(message, nodes, next);
+      if(next != nodes.size())
+        throw std::invalid_argument("template holes must be in message order");
+    }
+
+    std::size_t holes() const noexcept {
+      return holes_.size();
+    }
+
+    hole_kind kind(std::size_t i) const {
+      return holes_.at(i).kind;
+    }
+
+    // Write the message to `iter`, filling each hole with the corresponding
+    // element of `values`. All the values are checked before anything is
+    // written, so nothing is written if any of them are the wrong type.
+    template<detail::char_output Iter, typename ...T>
+    Iter render_to(Iter iter, const T &...values) const {
+      if(sizeof...(T) != holes_.size())
+        throw std::invalid_argument("wrong number of values for template");
+      std::size_t k = 0;
+      (check_kind<T>(holes_[k++].kind), ...);
+
+      std::size_t i = 0, done = 0;
+      ((iter = fill(iter, i++, done, values)), ...);
+      return detail::write_chars(iter, text_.data() + done,
+                                 text_.data() + text_.size());
+    }
+
+    template<typename Sink, typename ...T>
+    requires(sink<std::remove_cvref_t<Sink>> &&
+             !std::input_or_output_iterator<std::remove_cvref_t<Sink>>)
+    void render_to(Sink &&s, const T &...values) const {
+      detail::buffered_sink<std::remove_cvref_t<Sink>> buffered(s);
+      render_to(detail::sink_iterator(buffered), values...);
+      buffered.flush();
+    }
+
+    template<typename ...T>
+    std::string render(const T &...values) const {
+      std::string result;
+      render_to(container_sink(result), values...);
+      return result;
+    }
+  private:
+    struct hole {
+      std::size_t offset;
+      hole_kind kind;
+    };
+
+    template<typename Data>
+    void compile(const Data &node, const std::vector<const Data *> &nodes,
+                 std::size_t &next) {
+      using Traits = variant_traits_for<Data>;
+      using Integer = typename Data::integer;
+      using String = typename Data::string;
+      using List = typename Data::list;
+      using Dict = typename Data::dict;
+
+      if(next != nodes.size() && &node == nodes[next]) {
+        hole_kind kind = hole_kind::value;
+        if(Traits::template get_if<Integer>(&node))
+          kind = hole_kind::integer;
+        else if(Traits::template get_if<String>(&node))
+          kind = hole_kind::string;
+        holes_.push_back({text_.size(), kind});
+        next++;
+      } else if(auto p = Traits::template get_if<List>(&node)) {
+        text_ += u8'l';
+        for(auto &&i : *p)
+          compile(i, nodes, next);
+        text_ += u8'e';
+      } else if(auto p = Traits::template get_if<Dict>(&node)) {
+        text_ += u8'd';
+        auto add = [&](const auto &key, const Data &value) {
+          encode_to(std::back_inserter(text_), key);
+          compile(value, nodes, next);
+        };
+        if constexpr(detail::unordered_mapping<Dict>) {
+          for(auto *i : detail::sorted_elements(*p))
+            add(i->first, i->second);
+        } else {
+          for(auto &&[key, value] : *p)
+            add(key, value);
+        }
+        text_ += u8'e';
+      } else {
+        encode_to(std::back_inserter(text_), node);
+      }
+    }
+
+    // Write the fragment before hole `i` (starting at offset `done`),
+    // followed by `value`.
+    template<typename Iter, typename T>
+    Iter fill(Iter iter, std::size_t i, std::size_t &done,
+              const T &value) const {
+      const auto &h = holes_[i];
+      iter = detail::write_chars(iter, text_.data() + done,
+                                 text_.data() + h.offset);
+      done = h.offset;
+      return encode_to(iter, value);
+    }
+
+    template<typename T>
+    static void check_kind(hole_kind kind) {
+      bool ok;
+      if constexpr(std::integral<T>)
+        ok = kind != hole_kind::string;
+      else if constexpr(detail::stringish<T> ||
+                        std::convertible_to<T, std::string_view>)
+        ok = kind != hole_kind::integer;
+      else
+        ok = kind == hole_kind::value;
+      if(!ok)
+        throw std::invalid_argument("wrong type of value for template hole");
+    }
+
+    std::string text_;
+    std::vector<hole> holes_;
+  };
+
+  // An index of where the values at chosen depths of an encoded document
+  // are, so that they can be decoded one at a time instead of decoding the
+  // whole document. The index can be saved alongside the document, and
+  // records the document's size and checksum so that it can be checked
+  // against the document when it's loaded again.
+  class offset_index {
+  public:
+    struct entry {
+      // The path (see `detail::parse_path`) to the value, with no wildcards
+      // or ranges.
+      std::string path;
+      std::size_t offset;
+      std::size_t length;
+
+      friend bool operator ==(const entry &, const entry &) = default;
+    };
+
+    // Index the values in `buf` at each of `depths`, where the document
+    // itself is at depth 0, the elements of a top-level dict or list are at
+    // depth 1, and so on. This reads `buf` once, skipping over anything
+    // deeper than the largest depth. Throws a `decode_error` if `buf` is
+    // malformed.
+    static offset_index
+    build(std::string_view buf, std::vector<std::size_t> depths) {
+      std::sort(depths.begin(), depths.end());
+      offset_index result;
+      result.size_ = buf.size();
+      result.checksum_ = detail::hash_bytes64(buf.data(), buf.size());
+
+      const char *begin = buf.data(), *end = begin + buf.size();
+      std::string path;
+      auto ec = result.scan(buf.data(), begin, end, 0, path, depths);
+      if(ec == decode_errc::ok && begin != end)
+        ec = decode_errc::extraneous_character;
+      if(ec != decode_errc::ok)
+        throw detail::make_decode_error(ec, begin - buf.data());
+
+      result.sort_entries();
+      return result;
+    }
+
+    // Load an index saved by `serialize`. Throws an `std::invalid_argument`
+    // if `buf` isn't a valid index.
+    static offset_index deserialize(std::string_view buf) {
+      auto invalid = []() -> std::invalid_argument {
+        return std::invalid_argument("invalid offset index");
+      };
+
+      data_view doc;
+      try {
+        doc = basic_decode<data_view>(buf);
+      } catch(const decode_error &) {
+        throw invalid();
+      }
+      auto *dict = std::get_if<dict_view>(&doc.base());
+      if(!dict)
+        throw invalid();
+      auto integer_at = [&](std::string_view key) {
+        auto i = dict->find(key);
+        auto *p = i != dict->end() ?
+                  std::get_if<integer>(&i->second.base()) : nullptr;
+        if(!p)
+          throw invalid();
+        return *p;
+      };
+      auto to_size = [&](integer value) {
+        if(value < 0)
+          throw invalid();
+        return static_cast<std::size_t>(value);
+      };
+
+      if(integer_at("version") != version)
+        throw invalid();
+      offset_index result;
+      result.size_ = to_size(integer_at("size"));
+      result.checksum_ = static_cast<std::uint64_t>(integer_at("checksum"));
+
+      auto i = dict->find("entries");
+      auto *entries = i != dict->end() ?
+                      std::get_if<list_view>(&i->second.base()) : nullptr;
+      if(!entries)
+        throw invalid();
+      result.entries_.reserve(entries->size());
+      for(auto &&e : *entries) {
+        auto *fields = std::get_if<list_view>(&e.base());
+        if(!fields || fields->size() != 3)
+          throw invalid();
+        auto *path = std::get_if<string_view>(&(*fields)[0].base());
+        auto *offset = std::get_if<integer>(&(*fields)[1].base());
+        auto *length = std::get_if<integer>(&(*fields)[2].base());
+        if(!path || !offset || !length)
+          throw invalid();
+
+        entry item{std::string(*path), to_size(*offset), to_size(*length)};
+        if(item.offset > result.size_ ||
+           item.length > result.size_ - item.offset)
+          throw invalid();
+        result.entries_.push_back(std::move(item));
+      }
+
+      result.sort_entries();
+      return result;
+    }
+
+    // Save this index as a bencoded dict with the document's size and
+    // checksum, and a list of `[path, offset, length]` entries.
+    std::string serialize() const {
+      std::string result;
+      container_sink sink(result);
+      result += u8'd';
+      encode_to(sink, "checksum");
+      encode_to(sink, static_cast<integer>(checksum_));
+      encode_to(sink, "entries");
+      result += u8'l';
+      for(auto &&e : entries_) {
+        result += u8'l';
+        encode_to(sink, e.path);
+        encode_to(sink, static_cast<integer>(e.offset));
+        encode_to(sink, static_cast<integer>(e.length));
+        result += u8'e';
+      }
+      result += u8'e';
+      encode_to(sink, "size");
+      encode_to(sink, static_cast<integer>(size_));
+      encode_to(sink, "version");
+      encode_to(sink, version);
+      result += u8'e';
+      return result;
+    }
+
+    // Check whether this index was built from `buf`. This reads all of
+    // `buf` to compute its checksum.
+    bool matches(std::string_view buf) const noexcept {
+      return buf.size() == size_ &&
+             detail::hash_bytes64(buf.data(), buf.size()) == checksum_;
+    }
+
+    // The entry for `path`, or null if it isn't in the index.
+    const entry * find(std::string_view path) const {
+      auto i = std::lower_bound(
+        entries_.begin(), entries_.end(), path,
+        [](const entry &e, std::string_view p) { return e.path < p; }
+      );
+      return i != entries_.end() && i->path == path ? &*i : nullptr;
+    }
+
+    // The entries, sorted by path.
+    const std::vector<entry> & entries() const noexcept { return entries_; }
+    std::size_t size() const noexcept { return size_; }
+    std::uint64_t checksum() const noexcept { return checksum_; }
+  private:
+    static constexpr integer version = 1;
+
+    static void append_key(std::string &path, std::string_view key) {
+      path += u8'/';
+      for(char c : key) {
+        if(c == u8'~')
+          path += "~0";
+        else if(c == u8'/')
+          path += "~1";
+        else
+          path += c;
+      }
+    }
+
+    decode_errc scan(const char *base, const char *&begin, const char *end,
+                     std::size_t depth, std::string &path,
+                     const std::vector<std::size_t> &depths) {
+      constexpr auto unlimited = decode_limits::unlimited;
+      const char *start = begin;
+      if(begin == end)
+        return decode_errc::unexpected_end_of_input;
+
+      bool is_dict = *begin == u8'd';
+      if(depths.empty() || depth >= depths.back() ||
+         (!is_dict && *begin != u8'l')) {
+        if(auto ec = detail::skip_value(begin, end, unlimited, unlimited);
+           ec != decode_errc::ok)
+          return ec;
+      } else {
+        ++begin;
+        for(std::size_t index = 0; ; index++) {
+          if(begin == end)
+            return decode_errc::unexpected_end_of_input;
+          if(*begin == u8'e')
+            break;
+
+          auto old_size = path.size();
+          if(is_dict) {
+            if(!std::isdigit(*begin))
+              return decode_errc::expected_string_start_token;
+            std::string_view key;
+            if(auto ec = detail::decode_str(begin, end, key, unlimited);
+               ec != decode_errc::ok)
+              return ec;
+            append_key(path, key);
+          } else {
+            path += u8'/';
+            path += std::to_string(index);
+          }
+
+          if(auto ec = scan(base, begin, end, depth + 1, path, depths);
+             ec != decode_errc::ok)
+            return ec;
+          path.resize(old_size);
+        }
+        ++begin;
+      }
+
+      if(std::binary_search(depths.begin(), depths.end(), depth)) {
+        entries_.push_back({path, static_cast<std::size_t>(start - base),
+                            static_cast<std::size_t>(begin - start)});
+      }
+      return decode_errc::ok;
+    }
+
+    void sort_entries() {
+      std::sort(entries_.begin(), entries_.end(),
+                [](const entry &lhs, const entry &rhs) {
+                  return lhs.path < rhs.path;
+                });
+    }
+
+    std::vector<entry> entries_;
+    std::size_t size_ = 0;
+    std::uint64_t checksum_ = 0;
+  };
+
+  // A document along with an `offset_index` of it, for decoding the indexed
+  // values one at a time. The document isn't copied, so it can be (e.g.) a
+  // memory-mapped file; it must outlive the reader and any views decoded
+  // from it.
+  class indexed_reader {
+  public:
+    // Throws an `std::invalid_argument` if `index` wasn't built from `buf`.
+    // By default, this only checks the document's size, which is free; pass
+    // `verify` to also check its checksum, which reads the whole document.
+    indexed_reader(std::string_view buf, offset_index index,
+                   bool verify = false)
+      : buf_(buf), index_(std::move(index)) {
+      if(buf_.size() != index_.size() || (verify && !index_.matches(buf_)))
+        throw std::invalid_argument("offset index doesn't match document");
+    }
+
+    std::string_view buffer() const noexcept { return buf_; }
+    const offset_index & index() const noexcept { return index_; }
+
+    bool contains(std::string_view path) const {
+      return index_.find(path) != nullptr;
+    }
+
+    // Get the encoded value at `path`. Throws an `std::out_of_range` if
+    // `path` isn't in the index.
+    std::string_view raw(std::string_view path) const {
+      auto *e = index_.find(path);
+      if(!e)
+        throw std::out_of_range("path not in offset index");
+      return buf_.substr(e->offset, e->length);
+    }
+
+    template<typename Data>
+    Data basic_decode(std::string_view path) const {
+      return bencode::basic_decode<Data>(raw(path));
+    }
+
+    data decode(std::string_view path) const {
+      return basic_decode<data>(path);
+    }
+
+    data_view decode_view(std::string_view path) const {
+      return basic_decode<data_view>(path);
+    }
+  private:
+    std::string_view buf_;
+    offset_index index_;
+  };
+
 } // namespace bencode
 
+namespace std {
+  template<template<typename ...> typename Variant, typename I, typename S,
+           template<typename ...> typename L, template<typename ...> typename D,
+           typename ...Raw>
+  struct hash<bencode::basic_data<Variant, I, S, L, D, Raw...>> {
+    std::size_t operator ()(
+      const bencode::basic_data<Variant, I, S, L, D, Raw...> &value
+    ) const {
+      return bencode::hash(value);
+    }
+  };
+} // namespace std
+
 #endif
@@ -0,0 +1,169 @@
+#include <mettle.hpp>
+using namespace mettle;
+
+#include "bencode.hpp"
+
+#ifdef BENCODE_HAS_COROUTINES
+
+// A reader that hands out its input in fixed chunks, one per call to `fill`.
+class chunk_reader {
+public:
+  chunk_reader(std::vector<std::string> chunks) : chunks_(std::move(chunks)) {}
+
+  std::string_view buffer() const {
+    return std::string_view(buf_).substr(begin_);
+  }
+
+  void consume(std::size_t n) {
+    begin_ += n;
+  }
+
+  auto fill() {
+    struct awaiter {
+      chunk_reader &r;
+
+      bool await_ready() { return true; }
+      void await_suspend(std::coroutine_handle<>) {}
+      bool await_resume() {
+        r.fills++;
+        if(r.next_ == r.chunks_.size())
+          return false;
+        r.buf_ += r.chunks_[r.next_++];
+        return true;
+      }
+    };
+    return awaiter{*this};
+  }
+
+  std::size_t fills = 0;
+private:
+  std::vector<std::string> chunks_;
+  std::size_t next_ = 0;
+  std::string buf_;
+  std::size_t begin_ = 0;
+};
+
+template<typename T>
+T run(bencode::task<T> &&t) {
+  t.start();
+  expect(t.done(), equal_to(true));
+  return t.get();
+}
+
+bencode::task<std::vector<std::string>> decode_all(chunk_reader &reader) {
+  std::vector<std::string> result;
+  while(!reader.buffer().empty() || co_await reader.fill())
+    result.push_back(bencode::encode(co_await bencode::async_decode(reader)));
+  co_return result;
+}
+
+suite<> test_async("test async decoder", [](auto &_) {
+  using strings = std::vector<std::string>;
+
+  _.test("chunks", []() {
+    chunk_reader reader({"d3:fo", "o", "l", "i4", "2e4:", "go", "atee"});
+    auto value = run(bencode::async_decode(reader));
+    expect(bencode::encode(value), equal_to("d3:fooli42e4:goatee"));
+    expect(reader.buffer(), equal_to(""));
+    expect(reader.fills, equal_to(7u));
+  });
+
+  _.test("successive objects", []() {
+    chunk_reader reader({"i1ei", "2e3:f", "oo", "le"});
+    expect(run(decode_all(reader)), equal_to(strings{"i1e", "i2e", "3:foo",
+                                                     "le"}));
+  });
+
+  _.test("errors", []() {
+    chunk_reader truncated({"d3:f", "oo"});
+    expect([&]() { run(bencode::async_decode(truncated)); },
+           thrown<bencode::decode_error>(
+             "unexpected end of input, at offset 6"
+           ));
+
+    chunk_reader empty({});
+    expect([&]() { run(bencode::async_decode(empty)); },
+           thrown<bencode::decode_error>(
+             "unexpected end of input, at offset 0"
+           ));
+
+    // Stop reading as soon as the input is known to be invalid.
+    chunk_reader invalid({"li1e", "i1x", "e"});
+    expect([&]() { run(bencode::async_decode(invalid)); },
+           thrown<bencode::decode_error>(
+             "expected 'e' token, at offset 6"
+           ));
+    expect(invalid.fills, equal_to(2u));
+
+    bencode::decode_limits limits;
+    limits.max_bytes = 8;
+    chunk_reader big({"l3:foo", "3:bar", "e"});
+    expect([&]() { run(bencode::async_decode(big, limits)); },
+           thrown<bencode::decode_error>(
+             "maximum input size exceeded, at offset 8"
+           ));
+  });
+
+  _.test("moved tasks", []() {
+    chunk_reader reader({"li1e", "i2ee"});
+    auto t = bencode::async_decode(reader);
+    t.start();
+    auto moved = std::move(t);
+    // Starting again mustn't resume the (finished) coroutine.
+    moved.start();
+    expect(moved.done(), equal_to(true));
+    expect(reader.fills, equal_to(2u));
+
+    chunk_reader other({"i3e"});
+    auto assigned = bencode::async_decode(other);
+    assigned = std::move(moved);
+    assigned.start();
+    expect(assigned.done(), equal_to(true));
+    expect(bencode::encode(assigned.get()), equal_to("li1ei2ee"));
+  });
+
+#ifdef BENCODE_HAS_POSIX
+  _.test("file descriptors", []() {
+    bencode::poll_scheduler scheduler;
+    int a[2], b[2];
+    expect(::pipe(a), equal_to(0));
+    expect(::pipe(b), equal_to(0));
+
+    bencode::fd_async_reader ra(a[0], scheduler), rb(b[0], scheduler);
+    auto ta = bencode::async_decode(ra), tb = bencode::async_decode(rb);
+    ta.start();
+    tb.start();
+    expect(ta.done(), equal_to(false));
+    expect(tb.done(), equal_to(false));
+
+    auto write = [](int fd, std::string_view s) {
+      expect(::write(fd, s.data(), s.size()),
+             equal_to(static_cast<ssize_t>(s.size())));
+    };
+
+    write(a[1], "l3:fo");
+    write(b[1], "i4");
+    scheduler.run_once();
+    expect(ta.done(), equal_to(false));
+    expect(tb.done(), equal_to(false));
+
+    write(b[1], "2ei7e");
+    scheduler.run_once();
+    expect(tb.done(), equal_to(true));
+    expect(bencode::encode(tb.get()), equal_to("i42e"));
+    expect(rb.buffer(), equal_to("i7e"));
+
+    write(a[1], "oe");
+    ::close(a[1]);
+    scheduler.run();
+    expect(ta.done(), equal_to(true));
+    expect(bencode::encode(ta.get()), equal_to("l3:fooe"));
+
+    ::close(a[0]);
+    ::close(b[0]);
+    ::close(b[1]);
+  });
+#endif
+});
+
+#endif
@@ -10,7 +10,8 @@ static const std::string nested_data("d"
   "e");
 
 suite<
-  bencode::data, bencode::boost_data
+  bencode::data, bencode::boost_data, bencode::fast_data,
+  bencode::compact_data, bencode::shared_data, bencode::hash_data
 > test_data("test data", type_only, [](auto &_) {
   using DataType = fixture_type_t<decltype(_)>;
   using boost::get;
@@ -62,4 +63,373 @@ suite<
     });
   });
 
+  _.test("assign after move", []() {
+    using Dict = typename DataType::dict;
+    DataType value = bencode::basic_decode<DataType>(nested_data);
+    DataType moved = std::move(value);
+    value = get<Dict>(moved);
+    expect(get<Dict>(value).size(), equal_to(3u));
+
+    DataType moved_again = std::move(value);
+    value = Dict{};
+    expect(get<Dict>(value).size(), equal_to(0u));
+  });
+
+});
+
+suite<> test_compact_data("test compact data", [](auto &_) {
+  using bencode::get;
+
+  _.test("node size", []() {
+    if constexpr(sizeof(void *) == 8)
+      expect(sizeof(bencode::compact_data), equal_to(16u));
+  });
+
+  _.test("short string", []() {
+    bencode::compact_string s("short");
+    expect(s, equal_to("short"));
+    expect(s.size(), equal_to(5u));
+    expect(s.data(), in_interval(
+      reinterpret_cast<const char *>(&s),
+      reinterpret_cast<const char *>(&s) + sizeof(s), interval::closed
+    ));
+  });
+
+  _.test("long string", []() {
+    std::string value(100, 'x');
+    bencode::compact_string s(value);
+    expect(s, equal_to(value));
+    expect(s.size(), equal_to(100u));
+
+    bencode::compact_string copied(s);
+    expect(copied, equal_to(value));
+    expect(copied.data(), is_not(equal_to(s.data())));
+
+    bencode::compact_string moved(std::move(s));
+    expect(moved, equal_to(value));
+  });
+
+  _.test("copy", []() {
+    auto value = bencode::basic_decode<bencode::compact_data>(nested_data);
+    auto copied = value;
+    copied["three"][0]["bar"] = "a string that won't fit inline";
+    expect(copied, is_not(equal_to(value)));
+    expect(get<long long>(value["three"][0]["bar"]), equal_to(0));
+    expect(get<bencode::compact_string>(copied["three"][0]["bar"]),
+           equal_to("a string that won't fit inline"));
+  });
+
+  _.test("wrong type", []() {
+    bencode::compact_data value = 42;
+    expect([&value]() { get<bencode::compact_string>(value); },
+           thrown<std::bad_variant_access>());
+  });
+});
+
+suite<> test_shared_data("test shared data", [](auto &_) {
+  using bencode::get;
+  using list = bencode::shared_data::list;
+  using dict = bencode::shared_data::dict;
+
+  _.test("node size", []() {
+    if constexpr(sizeof(void *) == 8)
+      expect(sizeof(bencode::shared_data), equal_to(16u));
+  });
+
+  _.test("strings", []() {
+    bencode::shared_string s("short");
+    expect(s, equal_to("short"));
+    expect(s.data(), in_interval(
+      reinterpret_cast<const char *>(&s),
+      reinterpret_cast<const char *>(&s) + sizeof(s), interval::closed
+    ));
+
+    std::string value(100, 'x');
+    bencode::shared_string l(value);
+    expect(l, equal_to(value));
+    bencode::shared_string copied(l);
+    expect(copied, equal_to(value));
+    expect(static_cast<const void *>(copied.data()),
+           equal_to(static_cast<const void *>(l.data())));
+
+    bencode::shared_string moved(std::move(l));
+    expect(moved, equal_to(value));
+    expect(static_cast<const void *>(moved.data()),
+           equal_to(static_cast<const void *>(copied.data())));
+  });
+
+  _.test("copy shares storage", []() {
+    auto value = bencode::basic_decode<bencode::shared_data>(nested_data);
+    const auto copied = value;
+    expect(get<dict>(copied).shares_with(get<dict>(std::as_const(value))),
+           equal_to(true));
+    expect(copied, equal_to(value));
+  });
+
+  _.test("write copies path", []() {
+    auto value = bencode::basic_decode<bencode::shared_data>(nested_data);
+    const auto orig = value;
+    value["three"][0]["bar"] = "a string that won't fit inline";
+
+    expect(get<long long>(orig.at("three").at(0).at("bar")), equal_to(0));
+    expect(get<bencode::shared_string>(value["three"][0]["bar"]),
+           equal_to("a string that won't fit inline"));
+
+    // Only the nodes from the root to the changed value were copied.
+    const auto &v = std::as_const(value);
+    expect(get<dict>(v).shares_with(get<dict>(orig)), equal_to(false));
+    expect(get<list>(v.at("three")).shares_with(get<list>(orig.at("three"))),
+           equal_to(false));
+    expect(get<list>(v.at("two")).shares_with(get<list>(orig.at("two"))),
+           equal_to(true));
+  });
+
+  _.test("references survive copies", []() {
+    auto value = bencode::basic_decode<bencode::shared_data>(nested_data);
+    auto &one = value["one"];
+    const auto snapshot = value;
+    one = 5;
+    expect(get<long long>(snapshot.at("one")), equal_to(1));
+    expect(get<long long>(std::as_const(value).at("one")), equal_to(5));
+
+    auto i = get<list>(value["two"]).begin();
+    const auto snapshot2 = value;
+    *i = 6;
+    expect(get<long long>(snapshot2.at("two").at(0)), equal_to(3));
+    expect(get<long long>(std::as_const(value).at("two").at(0)),
+           equal_to(6));
+
+    // Only the nodes we took references into were copied deeply.
+    expect(get<dict>(snapshot2).shares_with(get<dict>(std::as_const(value))),
+           equal_to(false));
+    expect(get<list>(snapshot2.at("three")).shares_with(
+      get<list>(std::as_const(value).at("three"))
+    ), equal_to(true));
+  });
+
+  _.test("unshared writes don't copy", []() {
+    auto value = bencode::basic_decode<bencode::shared_data>(nested_data);
+    auto *two = &*get<list>(std::as_const(value).at("two"));
+    value["two"][0] = 5;
+    expect(&*get<list>(std::as_const(value).at("two")), equal_to(two));
+    expect(bencode::encode(value["two"]), equal_to("li5e3:fooi4ee"));
+  });
+});
+
+suite<> test_hash_data("test hash data", [](auto &_) {
+  using std::get;
+
+  _.test("encode sorted", []() {
+    auto value = bencode::basic_decode<bencode::hash_data>(nested_data);
+    for(int i = 0; i < 20; i++)
+      value["key" + std::to_string(i)] = i;
+
+    auto copy = bencode::decode(nested_data);
+    for(int i = 0; i < 20; i++)
+      copy["key" + std::to_string(i)] = i;
+    expect(bencode::encode(value), equal_to(bencode::encode(copy)));
+  });
+
+  _.test("lookup", []() {
+    auto value = bencode::basic_decode<bencode::hash_data>(nested_data);
+    auto &dict = get<bencode::hash_data::dict>(value);
+    expect(dict.contains("one"), equal_to(true));
+    expect(dict.contains(std::string_view("four")), equal_to(false));
+    expect(get<long long>(dict.at("one")), equal_to(1));
+    expect([&dict]() { dict.at("four"); }, thrown<std::out_of_range>());
+  });
+
+  _.test("memory usage", []() {
+    using dict = bencode::hash_data::dict;
+    auto value = bencode::hash_data(dict{{"a", 1}, {"b", 2}});
+    auto usage = bencode::memory_usage(value);
+    expect(usage.node_storage, equal_to(3 * sizeof(bencode::hash_data)));
+    expect(usage.container_overhead,
+           greater(sizeof(typename dict::map_type)));
+    expect(usage.dict_node_overhead,
+           greater_equal(2 * sizeof(typename dict::key_type)));
+
+#ifdef __GLIBCXX__
+    // libstdc++ doesn't cache the hashes of our keys, so each node is just a
+    // link and the key/value pair.
+    using value_type = typename dict::value_type;
+    expect(usage.dict_node_overhead, equal_to(
+      2 * (sizeof(void *) + sizeof(value_type) - sizeof(bencode::hash_data))
+    ));
+#endif
+  });
+
+  _.test("message template", []() {
+    bencode::hash_data msg = bencode::hash_data::dict{
+      {"z", 0}, {"a", ""}, {"m", "fixed"}
+    };
+    bencode::message_template tmpl(msg, {"/a", "/z"});
+    expect(tmpl.render("x", 1), equal_to("d1:a1:x1:m5:fixed1:zi1ee"));
+  });
+});
+
+suite<> test_view_conversion("test view conversion", [](auto &_) {
+  using std::get;
+
+  _.test("materialize", []() {
+    std::string buf = nested_data;
+    auto view = bencode::decode_view(buf);
+    auto result = bencode::materialize(view["three"]);
+    buf.assign(buf.size(), 'x');
+
+    expect(bencode::encode(result.value),
+           equal_to("ld3:bari0e3:fooi0eee"));
+    auto &dict = get<bencode::dict_view>(result.value[0]);
+    const void *first = dict.begin()->first.data(),
+               *second = dict.rbegin()->first.data();
+    expect(first, equal_to<const void *>(result.buffer.get()));
+    expect(second, equal_to<const void *>(result.buffer.get() + 3));
+  });
+
+  _.test("materialize scalars", []() {
+    auto str = bencode::materialize(bencode::data_view("foo"));
+    expect(get<std::string_view>(str.value), equal_to("foo"));
+    expect(static_cast<const void *>(get<std::string_view>(str.value).data()),
+           equal_to(static_cast<const void *>(str.buffer.get())));
+
+    auto num = bencode::materialize(bencode::data_view(42));
+    expect(get<long long>(num.value), equal_to(42));
+  });
+
+  _.test("materialize after move", []() {
+    auto result = bencode::materialize(bencode::decode_view(nested_data));
+    auto moved = std::move(result);
+    expect(bencode::encode(moved.value), equal_to(nested_data));
+  });
+
+  _.test("to_view", []() {
+    auto value = bencode::decode(nested_data);
+    auto view = bencode::to_view(value);
+    expect(bencode::encode(view), equal_to(nested_data));
+    const void *data = get<std::string>(value["two"][1]).data();
+    const void *view_data = get<std::string_view>(view["two"][1]).data();
+    expect(view_data, equal_to(data));
+
+    auto fast = bencode::fast_decode(nested_data);
+    expect(bencode::encode(bencode::to_view(fast)), equal_to(nested_data));
+
+    auto compact = bencode::basic_decode<bencode::compact_data>(nested_data);
+    auto compact_view = bencode::basic_to_view<bencode::data_view>(compact);
+    expect(bencode::encode(compact_view), equal_to(nested_data));
+  });
+});
+
+suite<
+  bencode::data, bencode::data_view, bencode::boost_data
+> test_memory_usage("test memory usage", type_only, [](auto &_) {
+  using DataType = fixture_type_t<decltype(_)>;
+  constexpr bool is_view = std::ranges::view<typename DataType::string>;
+
+  _.test("scalars", []() {
+    for(DataType value : {DataType(42), DataType("foo")}) {
+      auto usage = bencode::memory_usage(value);
+      expect(usage.node_storage, equal_to(sizeof(DataType)));
+      expect(usage.string_payload, equal_to(0u));
+      expect(usage.container_overhead, equal_to(0u));
+      expect(usage.dict_node_overhead, equal_to(0u));
+      expect(usage.allocator_slack, equal_to(0u));
+      expect(usage.total(), equal_to(sizeof(DataType)));
+    }
+  });
+
+  _.test("long string", []() {
+    std::string s(100, 'x');
+    auto usage = bencode::memory_usage(DataType(typename DataType::string(s)));
+    expect(usage.node_storage, equal_to(sizeof(DataType)));
+    if constexpr(is_view) {
+      expect(usage.string_payload, equal_to(0u));
+      expect(usage.allocator_slack, equal_to(0u));
+    } else {
+      expect(usage.string_payload, greater_equal(101u));
+      expect(usage.allocator_slack, greater(0u));
+    }
+  });
+
+  _.test("list", []() {
+    typename DataType::list list;
+    list.reserve(4);
+    list.push_back(1);
+    list.push_back(2);
+    auto usage = bencode::memory_usage(DataType(std::move(list)));
+    expect(usage.node_storage, equal_to(3 * sizeof(DataType)));
+    expect(usage.container_overhead, equal_to(2 * sizeof(DataType)));
+    expect(usage.dict_node_overhead, equal_to(0u));
+  });
+
+  _.test("dict", []() {
+    using dict = typename DataType::dict;
+    auto usage = bencode::memory_usage(DataType(dict{{"a", 1}, {"b", 2}}));
+    expect(usage.node_storage, equal_to(3 * sizeof(DataType)));
+    expect(usage.string_payload, equal_to(0u));
+    expect(usage.container_overhead,
+           equal_to(sizeof(typename dict::map_type)));
+    expect(usage.dict_node_overhead,
+           greater_equal(2 * sizeof(typename dict::key_type)));
+    expect(usage.allocator_slack, greater(0u));
+  });
+
+  _.test("nested", []() {
+    auto value = bencode::basic_decode<DataType>(nested_data);
+    auto usage = bencode::memory_usage(value);
+    expect(usage.node_storage, equal_to(10 * sizeof(DataType)));
+    expect(usage.total(), greater(usage.node_storage));
+
+    value["four"] = typename DataType::list{1, 2, 3};
+    expect(bencode::memory_usage(value).total(), greater(usage.total()));
+  });
+});
+
+suite<> test_variant("test variant", [](auto &_) {
+  using bencode::get;
+  using Variant = bencode::fast_data::base_type;
+
+  _.test("index", []() {
+    expect(Variant().index(), equal_to(0));
+    expect(Variant(42).index(), equal_to(0));
+    expect(Variant("foo").index(), equal_to(1));
+    expect(Variant(bencode::fast_data::list{}).index(), equal_to(2));
+    expect(Variant(bencode::fast_data::dict{}).index(), equal_to(3));
+  });
+
+  _.test("assign", []() {
+    Variant v = 42;
+    v = "foo";
+    expect(get<std::string>(v), equal_to("foo"));
+    v = "bar";
+    expect(get<std::string>(v), equal_to("bar"));
+    v = 1;
+    expect(get<long long>(v), equal_to(1));
+  });
+
+  _.test("move", []() {
+    Variant v = "foo";
+    Variant moved = std::move(v);
+    expect(get<std::string>(moved), equal_to("foo"));
+    expect(v.index(), equal_to(1));
+  });
+
+  _.test("visit", []() {
+    auto index_of = [](const auto &value) -> int {
+      using T = std::remove_cvref_t<decltype(value)>;
+      if constexpr(std::is_same_v<T, long long>)
+        return 0;
+      else if constexpr(std::is_same_v<T, std::string>)
+        return 1;
+      else if constexpr(std::is_same_v<T, bencode::fast_data::list>)
+        return 2;
+      else
+        return 3;
+    };
+
+    auto value = bencode::basic_decode<bencode::fast_data>(nested_data);
+    expect(visit(index_of, value.base()), equal_to(3));
+    expect(visit(index_of, value["one"].base()), equal_to(0));
+    expect(visit(index_of, value["two"].base()), equal_to(2));
+    expect(visit(index_of, value["two"][1].base()), equal_to(1));
+  });
 });
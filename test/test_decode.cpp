@@ -12,7 +12,11 @@ std::enable_if_t<std::is_constructible_v<T, const char *>, T> {
 template<typename T>
 auto make_data(const char *data) ->
 std::enable_if_t<!std::is_constructible_v<T, const char *>, T> {
-  return T(data, data + std::strlen(data));
+  using Char = typename T::value_type;
+  T result;
+  for(const char *i = data; *i; i++)
+    result.push_back(static_cast<Char>(*i));
+  return result;
 }
 
 struct at_eof : matcher_tag {
@@ -37,7 +41,8 @@ auto within_memory(const T &) {
 
 template<bencode::detail::iterable T>
 auto within_memory(const T &t) {
-  return in_interval(&*std::begin(t), &*std::end(t), interval::closed);
+  auto begin = reinterpret_cast<const char *>(std::to_address(std::begin(t)));
+  return in_interval(begin, begin + std::size(t), interval::closed);
 }
 
 template<typename T>
@@ -130,6 +135,16 @@ auto decode_tests(Builder &_, Callable &&decode) {
     }
   });
 
+  _.test("unsorted dict", [decode]() {
+    auto data = make_data<InType>("d3:fooi1e3:bari2e3:bazi3ee");
+    auto value = decode(data);
+    auto dict = get<Dict>(value);
+    expect(dict.size(), equal_to(3u));
+    expect(get<Integer>(dict["foo"]), equal_to(1));
+    expect(get<Integer>(dict["bar"]), equal_to(2));
+    expect(get<Integer>(dict["baz"]), equal_to(3));
+  });
+
   _.test("nested", [decode]() {
     auto data = make_data<InType>(
       "d"
@@ -149,12 +164,14 @@ auto decode_tests(Builder &_, Callable &&decode) {
 
 suite<> test_decode("test decoder", [](auto &_) {
   subsuite<
-    const char *, std::string, std::vector<char>, std::istringstream
+    const char *, std::string, std::vector<char>, std::vector<unsigned char>,
+    std::vector<std::byte>, std::istringstream
   >(_, "decode", type_only, [](auto &_) {
     using InType = fixture_type_t<decltype(_)>;
 
     subsuite<
-      bencode::data, bencode::boost_data
+      bencode::data, bencode::boost_data, bencode::fast_data,
+      bencode::compact_data, bencode::shared_data, bencode::hash_data
     >(_, "decode to", type_only, [](auto &_) {
       using OutType = fixture_type_t<decltype(_)>;
       decode_tests<InType>(_, [](auto &&data) {
@@ -179,13 +196,15 @@ suite<> test_decode("test decoder", [](auto &_) {
   });
 
   subsuite<
-    std::string, std::vector<char>
+    std::string, std::vector<char>, std::vector<unsigned char>,
+    std::vector<std::byte>
   >(_, "decode iterator pair", type_only, [](auto &_) {
     using InType = fixture_type_t<decltype(_)>;
 
     subsuite<
-      bencode::data, bencode::boost_data, bencode::data_view,
-      bencode::boost_data_view
+      bencode::data, bencode::boost_data, bencode::compact_data,
+      bencode::data_view, bencode::boost_data_view, bencode::fast_data_view,
+      bencode::hash_data_view
     >(_, "decode to", type_only, [](auto &_) {
       using OutType = fixture_type_t<decltype(_)>;
       decode_tests<InType>(_, [](auto &&data) {
@@ -196,8 +215,8 @@ suite<> test_decode("test decoder", [](auto &_) {
 
   subsuite<>(_, "decode pointer/length", [](auto &_) {
     subsuite<
-      bencode::data, bencode::boost_data, bencode::data_view,
-      bencode::boost_data_view
+      bencode::data, bencode::boost_data, bencode::compact_data,
+      bencode::data_view, bencode::boost_data_view, bencode::fast_data_view
     >(_, "decode to", type_only, [](auto &_) {
       using OutType = fixture_type_t<decltype(_)>;
       decode_tests<const char *>(_, [](const char *data) {
@@ -212,7 +231,8 @@ suite<> test_decode("test decoder", [](auto &_) {
     using InType = fixture_type_t<decltype(_)>;
 
     subsuite<
-      bencode::data, bencode::boost_data
+      bencode::data, bencode::boost_data, bencode::fast_data,
+      bencode::compact_data
     >(_, "decode to", type_only, [](auto &_) {
       using OutType = fixture_type_t<decltype(_)>;
       decode_tests<InType>(_, [](auto &&data) {
@@ -249,13 +269,14 @@ suite<> test_decode("test decoder", [](auto &_) {
   });
 
   subsuite<
-    std::string, std::vector<char>
+    std::string, std::vector<char>, std::vector<unsigned char>,
+    std::vector<std::byte>
   >(_, "decode_some iterator pair", type_only, [](auto &_) {
     using InType = fixture_type_t<decltype(_)>;
 
     subsuite<
-      bencode::data, bencode::boost_data, bencode::data_view,
-      bencode::boost_data_view
+      bencode::data, bencode::boost_data, bencode::compact_data,
+      bencode::data_view, bencode::boost_data_view, bencode::fast_data_view
     >(_, "decode to", type_only, [](auto &_) {
       using OutType = fixture_type_t<decltype(_)>;
       decode_tests<InType>(_, [](auto &&data) {
@@ -282,8 +303,8 @@ suite<> test_decode("test decoder", [](auto &_) {
 
   subsuite<>(_, "decode_some pointer/length", [](auto &_) {
     subsuite<
-      bencode::data, bencode::boost_data, bencode::data_view,
-      bencode::boost_data_view
+      bencode::data, bencode::boost_data, bencode::compact_data,
+      bencode::data_view, bencode::boost_data_view, bencode::fast_data_view
     >(_, "decode to", type_only, [](auto &_) {
       using OutType = fixture_type_t<decltype(_)>;
       decode_tests<const char *>(_, [](const char *data) {
@@ -296,6 +317,187 @@ suite<> test_decode("test decoder", [](auto &_) {
     });
   });
 
+  subsuite<>(_, "decode byte buffers", [](auto &_) {
+    _.test("span", []() {
+      auto bytes = make_data<std::vector<std::byte>>("d3:foo3:bare");
+      std::span<const std::byte> span(bytes);
+
+      auto value = bencode::decode_view(span);
+      auto str = std::get<bencode::string_view>(
+        std::get<bencode::dict_view>(value)["foo"]
+      );
+      expect(str, equal_to("bar"));
+      expect(str.data(), within_memory(bytes));
+    });
+
+    _.test("successive objects", []() {
+      auto bytes = make_data<std::vector<unsigned char>>("i42e4:goat");
+      const unsigned char *begin = bytes.data(), *end = begin + bytes.size();
+
+      auto first = bencode::decode_view_some(begin, end);
+      expect(std::get<bencode::integer>(first), equal_to(42));
+      expect(begin, equal_to(bytes.data() + 4));
+
+      auto second = bencode::decode_view_some(begin, end);
+      expect(std::get<bencode::string_view>(second), equal_to("goat"));
+      expect(begin, equal_to(end));
+    });
+
+    _.test("errors", []() {
+      auto bytes = make_data<std::vector<std::byte>>("i42ex");
+      expect([&bytes]() { bencode::decode(bytes); },
+             decode_error<bencode::syntax_error>(
+               "extraneous character", 4
+             ));
+
+      auto begin = bytes.begin();
+      auto result = bencode::try_decode_some(begin, bytes.end());
+      expect(result.has_value(), equal_to(true));
+      expect(begin, equal_to(bytes.begin() + 4));
+    });
+  });
+
+  subsuite<>(_, "decode segments", [](auto &_) {
+    using segments = std::vector<std::string_view>;
+
+    _.test("strings within segments", []() {
+      std::string a = "d3:foo", b = "3:bar", c = "e";
+      auto result = bencode::decode_view_segments(segments{a, b, c});
+      auto &dict = std::get<bencode::dict_view>(result.value);
+      auto str = std::get<bencode::string_view>(dict["foo"]);
+      expect(str, equal_to("bar"));
+      expect(str.data(), within_memory(b));
+      expect(dict.begin()->first.data(), within_memory(a));
+      expect(result.arena.size(), equal_to(0u));
+    });
+
+    _.test("strings straddling segments", []() {
+      std::string a = "d3:fo", b = "", c = "o3:b", d = "are";
+      auto result = bencode::decode_view_segments(segments{a, b, c, d});
+      expect(bencode::encode(result.value), equal_to("d3:foo3:bare"));
+      expect(result.arena.size(), equal_to(6u));
+
+      // The copies stay valid after moving the result.
+      auto moved = std::move(result);
+      auto &dict = std::get<bencode::dict_view>(moved.value);
+      expect(std::get<bencode::string_view>(dict["foo"]), equal_to("bar"));
+    });
+
+    _.test("long strings", []() {
+      std::string body(10000, 'x');
+      std::string a = "l10000:" + body.substr(0, 5000),
+                  b = body.substr(5000) + "4:spam", c = "e";
+      auto result = bencode::decode_view_segments(segments{a, b, c});
+      auto &list = std::get<bencode::list_view>(result.value);
+      expect(std::get<bencode::string_view>(list[0]), equal_to(body));
+      expect(std::get<bencode::string_view>(list[1]), equal_to("spam"));
+      expect(result.arena.size(), equal_to(10000u));
+    });
+
+    _.test("byte segments", []() {
+      auto a = make_data<std::vector<std::byte>>("li1e3:f"),
+           b = make_data<std::vector<std::byte>>("ooe");
+      std::vector<std::span<const std::byte>> segs = {a, b};
+      auto result = bencode::decode_view_segments(segs);
+      expect(bencode::encode(result.value), equal_to("li1e3:fooe"));
+    });
+
+    _.test("owning data", []() {
+      auto result = bencode::decode_segments(segments{"d3:fo", "o3:bare"});
+      auto &dict = std::get<bencode::dict>(result.value);
+      expect(std::get<bencode::string>(dict["foo"]), equal_to("bar"));
+      expect(result.arena.size(), equal_to(0u));
+    });
+
+    _.test("successive objects", []() {
+      segments segs = {"i42e4:go", "at", "i1e"};
+      bencode::segment_position pos;
+
+      auto first = bencode::decode_view_segments_some(segs, pos);
+      expect(std::get<bencode::integer>(first.value), equal_to(42));
+      expect(pos, equal_to(bencode::segment_position{0, 4}));
+
+      auto second = bencode::decode_view_segments_some(segs, pos);
+      expect(std::get<bencode::string_view>(second.value), equal_to("goat"));
+      expect(pos, equal_to(bencode::segment_position{2, 0}));
+
+      auto third = bencode::decode_view_segments_some(segs, pos);
+      expect(std::get<bencode::integer>(third.value), equal_to(1));
+      expect(pos, equal_to(bencode::segment_position{3, 0}));
+    });
+
+    _.test("errors", []() {
+      expect([]() { bencode::decode_view_segments(segments{"d3:f", "oo"}); },
+             decode_error<bencode::end_of_input_error>(
+               "unexpected end of input", 6
+             ));
+      expect([]() { bencode::decode_view_segments(segments{"i1", "ei"}); },
+             decode_error<bencode::syntax_error>(
+               "extraneous character", 3
+             ));
+
+      bencode::decode_limits limits;
+      limits.max_bytes = 4;
+      expect([&limits]() {
+        bencode::decode_view_segments(segments{"3:", "foo"}, limits);
+      }, decode_error<bencode::limit_error>(
+        "maximum input size exceeded", 4
+      ));
+
+      bencode::segment_position pos{0, 5};
+      expect([&pos]() {
+        bencode::decode_view_segments_some(segments{"i1e"}, pos);
+      }, thrown<std::out_of_range>());
+    });
+  });
+
+  subsuite<
+    const char *, std::string, std::istringstream
+  >(_, "try_decode", type_only, [](auto &_) {
+    using InType = fixture_type_t<decltype(_)>;
+
+    subsuite<
+      bencode::data, bencode::fast_data
+    >(_, "decode to", type_only, [](auto &_) {
+      using OutType = fixture_type_t<decltype(_)>;
+      decode_tests<InType>(_, [](auto &&data) {
+        auto result = bencode::basic_try_decode<OutType>(data);
+        expect(result.has_value(), equal_to(true));
+        return *std::move(result);
+      });
+    });
+
+    if constexpr(!std::is_same_v<InType, std::istringstream>) {
+      subsuite<
+        bencode::data_view, bencode::fast_data_view
+      >(_, "decode to", type_only, [](auto &_) {
+        using OutType = fixture_type_t<decltype(_)>;
+        decode_tests<InType>(_, [](auto &&data) {
+          return bencode::basic_try_decode<OutType>(data).value();
+        });
+      });
+    }
+  });
+
+  subsuite<>(_, "try_decode_some", [](auto &_) {
+    _.test("successive objects", []() {
+      const char *data = "i42e4:goat";
+
+      auto first = bencode::try_decode_some(data);
+      expect(std::get<bencode::integer>(first.value()), equal_to(42));
+      expect(data, is_not(at_eof()));
+
+      auto second = bencode::try_decode_some(data);
+      expect(std::get<bencode::string>(second.value()), equal_to("goat"));
+      expect(data, at_eof());
+
+      auto third = bencode::try_decode_some(data);
+      expect(third.has_value(), equal_to(false));
+      expect(third.error().code(),
+             equal_to(bencode::decode_errc::unexpected_end_of_input));
+    });
+  });
+
   subsuite<>(_, "decoding integers", [](auto &_) {
     using udata = bencode::basic_data<
       std::variant, unsigned long long, std::string, std::vector,
@@ -416,7 +618,793 @@ suite<> test_decode("test decoder", [](auto &_) {
         []() { bencode::decode("d3:fooi1e3:fooi1ee"); },
         decode_error<bencode::syntax_error>("duplicated key in dict: foo", 17)
       );
+      expect(
+        []() { bencode::decode("d3:fooi1e3:bari2e3:fooi3ee"); },
+        decode_error<bencode::syntax_error>("duplicated key in dict: foo", 25)
+      );
+    });
+  });
+
+  subsuite<>(_, "try_decode error handling", [](auto &_) {
+    using bencode::decode_errc;
+
+    auto failed = [](decode_errc code, std::size_t offset) {
+      return basic_matcher([code, offset](const auto &result) {
+        return !result && result.error().code() == code &&
+               result.error().offset() == offset;
+      }, "failed with error");
+    };
+
+    _.test("errors", [failed]() {
+      expect(bencode::try_decode(""),
+             failed(decode_errc::unexpected_end_of_input, 0));
+      expect(bencode::try_decode("d1:ai1e"),
+             failed(decode_errc::unexpected_end_of_input, 7));
+      expect(bencode::try_decode("x"),
+             failed(decode_errc::unexpected_type_token, 0));
+      expect(bencode::try_decode("i123ei"),
+             failed(decode_errc::extraneous_character, 5));
+      expect(bencode::try_decode("i123i"),
+             failed(decode_errc::expected_e_token, 4));
+      expect(bencode::try_decode("e"),
+             failed(decode_errc::unexpected_e_token, 0));
+      expect(bencode::try_decode("1abc"),
+             failed(decode_errc::expected_colon_token, 1));
+      expect(bencode::try_decode("di123ee"),
+             failed(decode_errc::expected_string_start_token, 1));
+      expect(bencode::try_decode("d3:fooi1e3:fooi1ee"),
+             failed(decode_errc::duplicated_key, 17));
+      expect(bencode::try_decode("i9223372036854775808e"),
+             failed(decode_errc::integer_overflow, 20));
+      expect(bencode::try_decode("i-9223372036854775809e"),
+             failed(decode_errc::integer_underflow, 21));
+    });
+
+    _.test("message", []() {
+      auto result = bencode::try_decode("i123i");
+      expect(result.error().message(),
+             equal_to("expected 'e' token, at offset 4"));
+    });
+
+    _.test("value()", []() {
+      expect([]() { bencode::try_decode("i123").value(); },
+             decode_error<bencode::end_of_input_error>(
+               "unexpected end of input", 4
+             ));
+      expect([]() { bencode::try_decode("i123i").value(); },
+             decode_error<bencode::syntax_error>("expected 'e' token", 4));
+    });
+  });
+
+  subsuite<>(_, "decode limits", [](auto &_) {
+    auto limit = [](const std::string &what, std::size_t offset) {
+      return decode_error<bencode::limit_error>(what, offset);
+    };
+
+    _.test("within limits", []() {
+      bencode::decode_limits limits{
+        .max_depth = 2, .max_string_length = 3, .max_nodes = 4,
+        .max_bytes = 18, .max_dict_size = 2
+      };
+      auto value = bencode::decode("d1:ali1ee1:b3:fooe", limits);
+      expect(std::get<bencode::string>(value["b"]), equal_to("foo"));
+    });
+
+    _.test("max_depth", [limit]() {
+      bencode::decode_limits limits{.max_depth = 2};
+      expect([limits]() { bencode::decode("llli1eeee", limits); },
+             limit("maximum nesting depth exceeded", 2));
+      expect([limits]() { bencode::decode("d1:ad1:bdeee", limits); },
+             limit("maximum nesting depth exceeded", 8));
+    });
+
+    _.test("max_string_length", [limit]() {
+      bencode::decode_limits limits{.max_string_length = 4};
+      expect([limits]() { bencode::decode("5:hello", limits); },
+             limit("maximum string length exceeded", 1));
+      expect([limits]() { bencode::decode("d5:helloi1ee", limits); },
+             limit("maximum string length exceeded", 2));
+    });
+
+    _.test("max_nodes", [limit]() {
+      bencode::decode_limits limits{.max_nodes = 3};
+      expect([limits]() { bencode::decode("li1ei2ei3ee", limits); },
+             limit("maximum number of nodes exceeded", 7));
+    });
+
+    _.test("max_bytes", [limit]() {
+      bencode::decode_limits limits{.max_bytes = 4};
+      expect([limits]() { bencode::decode("3:abc", limits); },
+             limit("maximum input size exceeded", 4));
+      expect([limits]() { bencode::decode("i1234e", limits); },
+             limit("maximum input size exceeded", 4));
+      expect([limits]() {
+        std::istringstream ss("3:abc");
+        bencode::decode(ss, limits);
+      }, limit("maximum input size exceeded", 4));
+      expect([limits]() { bencode::decode("i1ei2e", limits); },
+             decode_error<bencode::syntax_error>("extraneous character", 3));
+
+      const char *data = "i1ei2e";
+      expect(std::get<bencode::integer>(bencode::decode_some(data, limits)),
+             equal_to(1));
+    });
+
+    _.test("max_dict_size", [limit]() {
+      bencode::decode_limits limits{.max_dict_size = 1};
+      expect([limits]() { bencode::decode("d1:ai1e1:bi2ee", limits); },
+             limit("maximum dict size exceeded", 7));
+    });
+
+    _.test("try_decode", []() {
+      bencode::decode_limits limits{.max_depth = 1};
+      auto result = bencode::try_decode("lli1eee", limits);
+      expect(result.has_value(), equal_to(false));
+      expect(result.error().code(),
+             equal_to(bencode::decode_errc::depth_limit_exceeded));
+      expect(result.error().offset(), equal_to(1u));
+    });
+
+    _.test("deep nesting", []() {
+      std::string data = std::string(100, 'l') + std::string(100, 'e');
+      auto value = bencode::decode(data);
+      expect(bencode::encode(value), equal_to(data));
+    });
+
+    _.test("stream offsets", []() {
+      std::istringstream ss("999999999999:abc");
+      expect([&ss]() { bencode::decode(ss); },
+             decode_error<bencode::end_of_input_error>(
+               "unexpected end of input", 16
+             ));
+    });
+  });
+
+  subsuite<>(_, "decode_projected", [](auto &_) {
+    using bencode::encode;
+    static const std::string torrent(
+      "d"
+      "8:announce" "3:url"
+      "4:info" "d"
+        "5:files" "l"
+          "d" "6:length" "i1e" "4:path" "l" "1:a" "e" "e"
+          "d" "6:length" "i2e" "4:path" "l" "1:b" "e" "e"
+        "e"
+        "4:name" "4:test"
+        "6:pieces" "3:xyz"
+      "e"
+      "e"
+    );
+
+    _.test("keys", []() {
+      auto value = bencode::decode_projected(torrent, {
+        "/announce", "/info/name", "/info/missing"
+      });
+      expect(encode(value), equal_to("d8:announce3:url4:infod4:name4:testee"));
+    });
+
+    _.test("wildcards", []() {
+      auto value = bencode::decode_projected(torrent, {
+        "/info/files/*/length"
+      });
+      expect(encode(value), equal_to(
+        "d4:infod5:filesld6:lengthi1eed6:lengthi2eeeee"
+      ));
+
+      value = bencode::decode_projected(torrent, {"/info/*", "/info/files/1"});
+      expect(encode(value), equal_to(
+        "d4:infod5:filesld6:lengthi1e4:pathl1:aeed6:lengthi2e4:pathl1:beee"
+        "4:name4:test6:pieces3:xyzee"
+      ));
+    });
+
+    _.test("list indices", []() {
+      auto value = bencode::decode_projected(torrent, {
+        "/info/files/1/path/0", "/info/files/*/length"
+      });
+      expect(encode(value), equal_to(
+        "d4:infod5:filesld6:lengthi1eed6:lengthi2e4:pathl1:beeeee"
+      ));
+    });
+
+    _.test("whole document", []() {
+      expect(encode(bencode::decode_projected(torrent, {""})),
+             equal_to(torrent));
+      expect(encode(bencode::decode_projected(torrent, {})), equal_to("de"));
+    });
+
+    _.test("escapes", []() {
+      auto value = bencode::decode_projected(std::string("d3:a/bi1e3:a~bi2ee"),
+                                             {"/a~1b", "/a~0b"});
+      expect(encode(value), equal_to("d3:a/bi1e3:a~bi2ee"));
+
+      expect([]() { bencode::projection{"no/slash"}; },
+             thrown<std::invalid_argument>());
+      expect([]() { bencode::projection{"/bad~escape"}; },
+             thrown<std::invalid_argument>());
+    });
+
+    _.test("views and streams", []() {
+      auto view = bencode::decode_view_projected(torrent, {"/info/name"});
+      auto name = std::get<bencode::string_view>(view["info"]["name"]);
+      expect(name, equal_to("test"));
+      expect(&*name.begin(), within_memory(torrent));
+
+      std::istringstream ss(torrent);
+      auto value = bencode::decode_projected(ss, {"/announce"});
+      expect(encode(value), equal_to("d8:announce3:urle"));
+    });
+
+    _.test("other data types", []() {
+      auto compact = bencode::basic_decode_projected<bencode::compact_data>(
+        torrent, {"/info/name", "/info/files/*/length"}
+      );
+      expect(encode(compact), equal_to(
+        "d4:infod5:filesld6:lengthi1eed6:lengthi2eee4:name4:testee"
+      ));
+
+      auto boost = bencode::basic_decode_projected<bencode::boost_data>(
+        torrent, {"/announce"}
+      );
+      expect(encode(boost), equal_to("d8:announce3:urle"));
+    });
+
+    _.test("errors in skipped data", []() {
+      expect([]() {
+        bencode::decode_projected(std::string("d1:ai1e1:bli1ee"), {"/a"});
+      }, decode_error<bencode::end_of_input_error>(
+        "unexpected end of input", 15
+      ));
+      expect([]() {
+        bencode::decode_projected(std::string("d1:ai1e1:bli1x"), {"/a"});
+      }, decode_error<bencode::syntax_error>("expected 'e' token", 13));
+      expect([]() {
+        bencode::decode_projected(std::string("d1:alleee"), {"/b"},
+                                  {.max_depth = 2});
+      }, decode_error<bencode::limit_error>(
+        "maximum nesting depth exceeded", 5
+      ));
+    });
+  });
+
+  subsuite<>(_, "decoder", [](auto &_) {
+    using dict = bencode::data::dict;
+    using list = bencode::data::list;
+    using bencode::encode;
+
+    _.test("decode", []() {
+      bencode::decoder<bencode::data> d;
+      expect(std::get<bencode::integer>(d.decode(std::string("i42e"))),
+             equal_to(42));
+      expect(std::get<bencode::string>(d.decode(std::string("3:foo"))),
+             equal_to("foo"));
+      expect(encode(d.decode(std::string("li1ee"))), equal_to("li1ee"));
+
+      std::string data = "i1ei2e";
+      auto begin = data.begin();
+      expect(std::get<bencode::integer>(d.decode_some(begin, data.end())),
+             equal_to(1));
+      expect(std::get<bencode::integer>(d.decode_some(begin, data.end())),
+             equal_to(2));
+    });
+
+    _.test("decode_into reuses storage", []() {
+      bencode::decoder<bencode::data> d;
+      bencode::data value;
+      d.decode_into(value, std::string(
+        "d4:listl20:aaaaaaaaaaaaaaaaaaaai1ee3:str20:bbbbbbbbbbbbbbbbbbbbe"
+      ));
+
+      auto &old_list = std::get<list>(std::get<dict>(value)["list"]);
+      const auto *list_data = old_list.data();
+      const auto *list_str = std::get<std::string>(old_list[0]).data();
+      const auto *str = std::get<std::string>(
+        std::get<dict>(value)["str"]
+      ).data();
+
+      d.decode_into(value, std::string(
+        "d4:listl20:cccccccccccccccccccci2ee3:str20:dddddddddddddddddddde"
+      ));
+      expect(encode(value), equal_to(
+        "d4:listl20:cccccccccccccccccccci2ee3:str20:dddddddddddddddddddde"
+      ));
+
+      auto &new_list = std::get<list>(std::get<dict>(value)["list"]);
+      expect(new_list.data(), equal_to(list_data));
+      expect(std::get<std::string>(new_list[0]).data(), equal_to(list_str));
+      expect(std::get<std::string>(std::get<dict>(value)["str"]).data(),
+             equal_to(str));
+    });
+
+    _.test("decode_into different shapes", []() {
+      bencode::decoder<bencode::data> d;
+      bencode::data value;
+      d.decode_into(value, std::string("d1:ai1e1:bli1ei2ee1:cd1:xi1eee"));
+
+      d.decode_into(value, std::string("d1:a3:foo1:bli3ee1:zi1ee"));
+      expect(encode(value), equal_to("d1:a3:foo1:bli3ee1:zi1ee"));
+
+      d.decode_into(value, std::string("d1:ali1ei2ei3ee1:bd1:yi2eee"));
+      expect(encode(value), equal_to("d1:ali1ei2ei3ee1:bd1:yi2eee"));
+
+      d.decode_into(value, std::string("de"));
+      expect(encode(value), equal_to("de"));
+
+      d.decode_into(value, std::string("l3:fooe"));
+      expect(encode(value), equal_to("l3:fooe"));
+    });
+
+    _.test("decode_into compact_data", []() {
+      bencode::decoder<bencode::compact_data> d;
+      bencode::compact_data value;
+      d.decode_into(value, std::string("d1:ali1ei2ee1:b3:fooe"));
+      d.decode_into(value, std::string("d1:ali3ee1:b3:bare"));
+      expect(encode(value), equal_to("d1:ali3ee1:b3:bare"));
+    });
+
+    _.test("decode_into hash_data", []() {
+      bencode::decoder<bencode::hash_data> d;
+      bencode::hash_data value;
+      d.decode_into(value, std::string("d1:ali1ei2ee1:b3:foo1:ci1ee"));
+      d.decode_into(value, std::string("d1:ali3ee1:b3:bare"));
+      expect(encode(value), equal_to("d1:ali3ee1:b3:bare"));
+
+      expect([&]() {
+        d.decode_into(value, std::string("d1:bi1e1:ai2e1:bi3ee"));
+      }, decode_error<bencode::syntax_error>("duplicated key in dict: b",
+                                             19));
+    });
+
+    _.test("errors", []() {
+      bencode::decoder<bencode::data> d;
+      bencode::data value;
+      d.decode_into(value, std::string("d3:fooi1ee"));
+      expect([&]() {
+        d.decode_into(value, std::string("d3:fooi1e3:fooi2ee"));
+      }, decode_error<bencode::syntax_error>("duplicated key in dict: foo",
+                                             17));
+
+      d.decode_into(value, std::string("d1:ai1e1:bi2ee"));
+      expect([&]() {
+        d.decode_into(value, std::string("d1:ai1e1:ai2ee"));
+      }, decode_error<bencode::syntax_error>("duplicated key in dict: a",
+                                             13));
+
+      auto error = d.try_decode_into(value, std::string("li1e"));
+      expect(error.has_value(), equal_to(true));
+      expect(error->code(),
+             equal_to(bencode::decode_errc::unexpected_end_of_input));
+      expect(error->offset(), equal_to(4u));
+
+      expect(d.try_decode_into(value, std::string("li1ee")).has_value(),
+             equal_to(false));
+      expect(encode(value), equal_to("li1ee"));
+    });
+
+    _.test("reserve_lists", []() {
+      bencode::decoder<bencode::data> d;
+      expect(d.reserve_lists(), equal_to(false));
+      d.set_reserve_lists(true);
+      expect(d.reserve_lists(), equal_to(true));
+
+      auto value = d.decode(std::string("li1eli1ei2eed1:ali1ei2ei3eee3:fooe"));
+      expect(encode(value), equal_to("li1eli1ei2eed1:ali1ei2ei3eee3:fooe"));
+      auto &outer = std::get<list>(value);
+      expect(outer.capacity(), equal_to(4u));
+      expect(std::get<list>(outer[1]).capacity(), equal_to(2u));
+      expect(std::get<list>(std::get<dict>(outer[2])["a"]).capacity(),
+             equal_to(3u));
+
+      std::istringstream ss("li1ei2ee");
+      std::istreambuf_iterator<char> begin(ss), end;
+      expect(encode(d.decode(begin, end)), equal_to("li1ei2ee"));
+
+      expect([&d]() { d.decode(std::string("li1eli1ee")); },
+             decode_error<bencode::end_of_input_error>(
+               "unexpected end of input", 9
+             ));
+    });
+
+    _.test("limits", []() {
+      bencode::decoder<bencode::data> d({.max_depth = 1});
+      expect(d.limits().max_depth, equal_to(1u));
+      expect([&d]() { d.decode(std::string("llee")); },
+             decode_error<bencode::limit_error>(
+               "maximum nesting depth exceeded", 1
+             ));
+
+      d.set_limits({});
+      expect(encode(d.decode(std::string("llee"))), equal_to("llee"));
+    });
+  });
+
+  subsuite<>(_, "observers", [](auto &_) {
+    using bencode::node_kind;
+
+    _.test("null_observer", []() {
+      expect(std::is_empty_v<bencode::null_observer>, equal_to(true));
+      expect(bencode::observer<bencode::null_observer>, equal_to(true));
+      expect(bencode::observer<bencode::stats_observer>, equal_to(true));
+      expect(bencode::observer<int>, equal_to(false));
+    });
+
+    _.test("stats_observer", []() {
+      bencode::decoder<bencode::data, bencode::stats_observer> d;
+      d.decode(std::string("d3:fooli1e3:bare4:spami2ee"));
+
+      auto &last = d.observer().last();
+      expect(last.messages, equal_to(1u));
+      expect(last.errors, equal_to(0u));
+      expect(last.bytes, equal_to(26u));
+      expect(last.node_count(node_kind::integer), equal_to(2u));
+      expect(last.node_count(node_kind::string), equal_to(1u));
+      expect(last.node_count(node_kind::list), equal_to(1u));
+      expect(last.node_count(node_kind::dict), equal_to(1u));
+      expect(last.node_count(), equal_to(5u));
+      expect(last.max_depth, equal_to(2u));
+      expect(last.string_bytes_copied, equal_to(10u));
+      expect(last.string_bytes_viewed, equal_to(0u));
+      expect(last.dict_inserts, equal_to(2u));
+
+      d.decode(std::string("l3:fooe"));
+      expect(d.observer().last().node_count(), equal_to(2u));
+      expect(d.observer().last().max_depth, equal_to(1u));
+
+      auto &total = d.observer().total();
+      expect(total.messages, equal_to(2u));
+      expect(total.bytes, equal_to(33u));
+      expect(total.node_count(), equal_to(7u));
+      expect(total.max_depth, equal_to(2u));
+      expect(total.string_bytes_copied, equal_to(13u));
+      expect(d.observer().message_bytes().count(), equal_to(2u));
+      expect(d.observer().message_bytes().max(), equal_to(26u));
+      expect(d.observer().message_nodes().sum(), equal_to(7u));
+    });
+
+    _.test("phases", []() {
+      struct phase_observer : bencode::null_observer {
+        void phase(bencode::decode_phase p) { phases.push_back(p); }
+        std::vector<bencode::decode_phase> phases;
+      };
+      using phases = std::vector<bencode::decode_phase>;
+      using bencode::decode_phase;
+
+      bencode::decoder<bencode::data, phase_observer> d;
+      d.decode(std::string("li1ei2ee"));
+      expect(d.observer().phases, equal_to(phases{decode_phase::build}));
+
+      d.observer().phases.clear();
+      d.set_reserve_lists(true);
+      d.decode(std::string("li1ei2ee"));
+      expect(d.observer().phases, equal_to(phases{
+        decode_phase::prescan, decode_phase::build
+      }));
+
+      bencode::decoder<bencode::data, bencode::stats_observer> stats;
+      stats.decode(std::string("li1ei2ee"));
+      auto &last = stats.observer().last();
+      expect(last.phase_time(decode_phase::prescan).count(), equal_to(0));
+      expect(last.phase_time(decode_phase::build).count(),
+             less_equal(last.decode_time.count()));
+    });
+
+    _.test("allocations", []() {
+      bencode::decoder<bencode::data, bencode::stats_observer> d;
+      bencode::data value;
+      std::string msg = "d3:fooli1e3:bare4:spami2ee";
+      d.decode_into(value, msg);
+      // Two dict nodes, and growing the list twice.
+      expect(d.observer().last().allocations, equal_to(4u));
+      expect(d.observer().last().allocated_bytes, greater(0u));
+
+      // Decoding the same shape again reuses everything.
+      d.decode_into(value, msg);
+      expect(d.observer().last().allocations, equal_to(0u));
+
+      std::string big(100, 'x');
+      d.decode_into(value, bencode::encode(big));
+      expect(d.observer().last().allocations, equal_to(1u));
+      expect(d.observer().last().allocated_bytes, greater_equal(101u));
+      expect(d.observer().total().allocations, equal_to(5u));
+    });
+
+    _.test("views", []() {
+      bencode::decoder<bencode::data_view, bencode::stats_observer> d;
+      d.decode(std::string_view("d3:fooli1e3:bare4:spami2ee"));
+      expect(d.observer().last().string_bytes_copied, equal_to(0u));
+      expect(d.observer().last().string_bytes_viewed, equal_to(10u));
+    });
+
+    _.test("errors", []() {
+      bencode::decoder<bencode::data, bencode::stats_observer> d;
+      bencode::data value;
+      d.decode_into(value, std::string("li1ei2ee"));
+      expect(d.try_decode_into(value, std::string("li1e")).has_value(),
+             equal_to(true));
+
+      expect(d.observer().last().errors, equal_to(1u));
+      expect(d.observer().last().bytes, equal_to(4u));
+      expect(d.observer().total().messages, equal_to(2u));
+      expect(d.observer().total().errors, equal_to(1u));
+
+      d.observer().reset();
+      expect(d.observer().total().messages, equal_to(0u));
+      expect(d.observer().message_bytes().count(), equal_to(0u));
+    });
+
+    _.test("histogram", []() {
+      bencode::histogram h;
+      for(std::uint64_t i : {0, 1, 2, 3, 5, 6, 7, 100})
+        h.record(i);
+      expect(h.count(), equal_to(8u));
+      expect(h.sum(), equal_to(124u));
+      expect(h.max(), equal_to(100u));
+      expect(h.bucket(0), equal_to(1u));
+      expect(h.bucket(1), equal_to(1u));
+      expect(h.bucket(2), equal_to(2u));
+      expect(h.bucket(3), equal_to(3u));
+      expect(h.bucket(7), equal_to(1u));
+      expect(h.quantile(0.5), equal_to(7u));
+      expect(h.quantile(1.0), equal_to(100u));
+
+      std::ostringstream ss;
+      ss << h;
+      expect(ss.str(), equal_to(
+        "[0, 1): 1\n[1, 2): 1\n[2, 4): 2\n[4, 8): 3\n[64, 128): 1\n"
+      ));
+    });
+  });
+
+  subsuite<
+    const char *, std::string, std::vector<char>, std::vector<std::byte>
+  >(_, "decode trusted", type_only, [](auto &_) {
+    using InType = fixture_type_t<decltype(_)>;
+
+    subsuite<
+      bencode::data, bencode::data_view, bencode::compact_data,
+      bencode::hash_data
+    >(_, "decode to", type_only, [](auto &_) {
+      using OutType = fixture_type_t<decltype(_)>;
+      decode_tests<InType>(_, [](auto &&data) {
+        return bencode::basic_decode<OutType>(bencode::trusted, data);
+      });
+    });
+  });
+
+  subsuite<>(_, "decode trusted", [](auto &_) {
+    _.test("decode_some", []() {
+      std::string data = "i1e3:foo";
+      auto begin = data.begin();
+      expect(bencode::encode(bencode::basic_decode_some<bencode::data>(
+        bencode::trusted, begin, data.end()
+      )), equal_to("i1e"));
+      expect(bencode::encode(bencode::basic_decode_some<bencode::data>(
+        bencode::trusted, begin, data.end()
+      )), equal_to("3:foo"));
+      expect(begin, equal_to(data.end()));
+    });
+
+    _.test("unchecked input", []() {
+      // Duplicate keys keep the last value.
+      expect(bencode::encode(bencode::decode(bencode::trusted,
+                                             "d1:ai1e1:ai2ee")),
+             equal_to("d1:ai2ee"));
+      // Overflow wraps around instead of being reported.
+      expect(bencode::encode(bencode::decode(bencode::trusted,
+                                             "i18446744073709551617e")),
+             equal_to("i1e"));
+    });
+
+    _.test("duplicate keys with containers", []() {
+      expect(bencode::encode(bencode::decode(bencode::trusted,
+                                             "d1:ai1e1:ali2eee")),
+             equal_to("d1:ali2eee"));
+      expect(bencode::encode(bencode::decode(bencode::trusted,
+                                             "d1:ai1e1:ad1:bi2eee")),
+             equal_to("d1:ad1:bi2eee"));
+      expect(bencode::encode(bencode::basic_decode<bencode::hash_data>(
+        bencode::trusted, "d1:ali1ee1:ad1:bi2ee1:ci3ee"
+      )), equal_to("d1:ad1:bi2ee1:ci3ee"));
+
+      // Reusing an existing value's dict nodes takes a different path.
+      auto value = bencode::decode("d1:ai1e1:bi2ee");
+      std::string_view msg = "d1:ai1e1:ali2ee1:ad1:bi3eee";
+      const char *begin = msg.data();
+      bencode::detail::decode_state<bencode::data> state;
+      auto ec = bencode::detail::decode_value<true>(
+        value, begin, msg.data() + msg.size(), bencode::decode_limits{}, state
+      );
+      expect(ec, equal_to(bencode::decode_errc::ok));
+      expect(bencode::encode(value), equal_to("d1:ad1:bi3eee"));
+    });
+
+    _.test("stays in bounds", []() {
+      expect([]() { bencode::decode(bencode::trusted, "d3:foo"); },
+             thrown<bencode::decode_error>(
+               "unexpected end of input, at offset 6"
+             ));
+      expect([]() { bencode::decode(bencode::trusted, "4:foo"); },
+             thrown<bencode::decode_error>(
+               "unexpected end of input, at offset 5"
+             ));
+      expect([]() { bencode::decode(bencode::trusted, "li1"); },
+             thrown<bencode::decode_error>(
+               "unexpected end of input, at offset 3"
+             ));
+      expect([]() { bencode::decode(bencode::trusted, "i1ei2e"); },
+             thrown<bencode::decode_error>(
+               "extraneous character, at offset 3"
+             ));
+    });
+  });
+
+  subsuite<>(_, "decode_each", [](auto &_) {
+    using strings = std::vector<std::string>;
+    static const std::string messages = "i42e4:goatd3:fooli1eee";
+
+    auto encode_each = [](auto &&range) {
+      strings result;
+      for(auto &&i : range)
+        result.push_back(bencode::encode(i));
+      return result;
+    };
+
+    // A reader that only returns one character at a time.
+    struct trickle_reader {
+      std::string_view data;
+
+      std::size_t read(char *buf, std::size_t n) {
+        if(data.empty() || n == 0)
+          return 0;
+        *buf = data[0];
+        data.remove_prefix(1);
+        return 1;
+      }
+    };
+
+    _.test("buffer", [encode_each]() {
+      expect(encode_each(bencode::decode_each(messages)),
+             equal_to(strings{"i42e", "4:goat", "d3:fooli1eee"}));
+      expect(encode_each(bencode::decode_each("")), equal_to(strings{}));
+
+      auto range = bencode::decode_view_each(messages);
+      auto i = range.begin();
+      auto str = std::get<bencode::string_view>(*++i);
+      expect(str, equal_to("goat"));
+      expect(str.data(), within_memory(messages));
+    });
+
+    _.test("stream", [encode_each]() {
+      std::istringstream ss(messages);
+      expect(encode_each(bencode::decode_each(ss)),
+             equal_to(strings{"i42e", "4:goat", "d3:fooli1eee"}));
+      expect(ss, at_eof());
+
+      std::istringstream ss2(messages);
+      expect(encode_each(bencode::decode_view_each(ss2)),
+             equal_to(strings{"i42e", "4:goat", "d3:fooli1eee"}));
+    });
+
+    _.test("reader", [encode_each]() {
+      expect(encode_each(bencode::decode_each(trickle_reader{messages})),
+             equal_to(strings{"i42e", "4:goat", "d3:fooli1eee"}));
+
+      std::string big = "l10000:" + std::string(10000, 'x') + "e";
+      expect(encode_each(bencode::decode_view_each(trickle_reader{big})),
+             equal_to(strings{big}));
+    });
+
+    _.test("large message in small reads", []() {
+      struct chunk_reader {
+        std::string_view data;
+
+        std::size_t read(char *buf, std::size_t n) {
+          n = (std::min)({n, data.size(), std::size_t(4096)});
+          std::copy_n(data.data(), n, buf);
+          data.remove_prefix(n);
+          return n;
+        }
+      };
+      struct counting_observer : bencode::null_observer {
+        std::size_t passes = 0;
+        void begin_decode() noexcept { passes++; }
+      };
+
+      std::string big = "l4000000:" + std::string(4000000, 'x') + "i1ee";
+      bencode::detail::reader_source source(chunk_reader{big});
+      bencode::detail::decode_state<bencode::data, counting_observer> state;
+      bencode::data value;
+      expect(source.next(value, {}, state), equal_to(true));
+      expect(bencode::encode(value), equal_to(big));
+      expect(state.observer.passes, equal_to(1u));
+      expect(source.next(value, {}, state), equal_to(false));
+      expect(state.observer.passes, equal_to(1u));
+    });
+
+    _.test("many small messages", []() {
+      struct chunk_reader {
+        std::string_view data;
+
+        std::size_t read(char *buf, std::size_t n) {
+          n = (std::min)({n, data.size(), std::size_t(1000)});
+          std::copy_n(data.data(), n, buf);
+          data.remove_prefix(n);
+          return n;
+        }
+      };
+
+      std::string input;
+      for(int i = 0; i != 10000; i++)
+        input += "3:" + std::to_string(100 + i % 900);
+      bencode::detail::reader_source source(chunk_reader{input});
+      bencode::detail::decode_state<bencode::data_view> state;
+      bencode::data_view value;
+
+      // Messages already in the buffer are decoded in place, not moved to
+      // the front first.
+      expect(source.next(value, {}, state), equal_to(true));
+      const char *first = std::get<std::string_view>(value).data();
+      expect(source.next(value, {}, state), equal_to(true));
+      expect(std::get<std::string_view>(value).data(),
+             equal_to<const void *>(first + 5));
+
+      // Messages straddling the end of the buffer are still decoded whole.
+      std::size_t count = 2;
+      while(source.next(value, {}, state)) {
+        expect(std::get<std::string_view>(value),
+               equal_to(std::to_string(100 + count % 900)));
+        count++;
+      }
+      expect(count, equal_to(10000u));
+    });
+
+    _.test("range adaptors", []() {
+      auto range = bencode::decode_each(messages);
+      std::vector<std::size_t> types;
+      std::ranges::copy(range | std::views::transform([](const auto &i) {
+        return i.index();
+      }), std::back_inserter(types));
+      expect(types, array(0u, 1u, 3u));
+    });
+
+    _.test("errors", []() {
+      expect([]() {
+        for(auto &&i : bencode::decode_each(trickle_reader{"i1ei2"}))
+          (void)i;
+      }, decode_error<bencode::end_of_input_error>(
+        "unexpected end of input", 2
+      ));
+      expect([]() {
+        std::string data = "i1ex";
+        for(auto &&i : bencode::decode_each(data))
+          (void)i;
+      }, decode_error<bencode::syntax_error>("unexpected type token", 0));
+
+      bencode::decode_limits limits;
+      limits.max_bytes = 8;
+      expect([&limits]() {
+        auto reader = trickle_reader{"i1e10:xxxxxxxxxx"};
+        for(auto &&i : bencode::decode_each(reader, limits))
+          (void)i;
+      }, decode_error<bencode::limit_error>(
+        "maximum input size exceeded", 8
+      ));
+    });
+
+#ifdef BENCODE_HAS_POSIX
+    _.test("file descriptor", [encode_each]() {
+      int fds[2];
+      expect(::pipe(fds), equal_to(0));
+      expect(::write(fds[1], messages.data(), messages.size()),
+             equal_to(static_cast<ssize_t>(messages.size())));
+      ::close(fds[1]);
+
+      auto reader = bencode::fd_reader(fds[0]);
+      auto result = encode_each(bencode::decode_each(reader));
+      ::close(fds[0]);
+      expect(result, equal_to(strings{"i42e", "4:goat", "d3:fooli1eee"}));
     });
+#endif
   });
 
 });
@@ -74,6 +74,18 @@ suite<> test_encode("test encoder", [](auto &_) {
       expect(bencode::encode(m), equal_to("d1:ai1e1:bi2e1:ci3ee"));
     });
 
+    _.test("unordered_map<string, int>", []() {
+      std::unordered_map<std::string, int> m;
+      std::string expected = "d";
+      for(char c = 'a'; c <= 'z'; c++) {
+        m[std::string(1, c)] = c - 'a';
+        expected += "1:" + std::string(1, c) + "i" +
+                    std::to_string(c - 'a') + "e";
+      }
+      expected += "e";
+      expect(bencode::encode(m), equal_to(expected));
+    });
+
     _.test("map<string, string>", []() {
       std::map<std::string, std::string> m = {
         {"a", "cat"}, {"b", "dog"}, {"c", "goat"}
@@ -94,7 +106,8 @@ suite<> test_encode("test encoder", [](auto &_) {
   });
 
   subsuite<
-    bencode::data, bencode::boost_data
+    bencode::data, bencode::boost_data, bencode::fast_data,
+    bencode::compact_data, bencode::shared_data, bencode::hash_data
   >(_, "data", type_only, [](auto &_) {
     using DataType = fixture_type_t<decltype(_)>;
 
@@ -191,4 +204,136 @@ suite<> test_encode("test encoder", [](auto &_) {
     });
   });
 
+  subsuite<>(_, "to sinks", [](auto &_) {
+    // A sink that records the size of each write.
+    struct recording_sink {
+      std::string data;
+      std::vector<std::size_t> writes;
+
+      void write(const char *d, std::size_t n) {
+        data.append(d, n);
+        writes.push_back(n);
+      }
+    };
+
+    _.test("std::string", []() {
+      std::string s = "prefix";
+      bencode::encode_to(bencode::container_sink(s), bencode::list{1, "foo"});
+      expect(s, equal_to("prefixli1e3:fooe"));
+    });
+
+    _.test("std::vector<char>", []() {
+      std::vector<char> v;
+      bencode::encode_to(bencode::container_sink(v), 42);
+      expect(v, array('i', '4', '2', 'e'));
+    });
+
+    _.test("custom sink", []() {
+      recording_sink sink;
+      bencode::encode_to(sink, bencode::dict{{"one", 1}, {"two", "foo"}});
+      expect(sink.data, equal_to("d3:onei1e3:two3:fooe"));
+      // Small writes are staged and passed on all at once.
+      expect(sink.writes, array(20u));
+    });
+
+    _.test("large strings", []() {
+      std::string big(10000, 'x');
+      recording_sink sink;
+      bencode::encode_to(sink, bencode::list{big, 1});
+      expect(sink.data, equal_to("l10000:" + big + "i1ee"));
+      // The large string bypasses the staging buffer.
+      expect(sink.writes, array(7u, 10000u, 4u));
+    });
+
+    _.test("observed", []() {
+      bencode::stats_observer obs;
+      std::string s;
+      bencode::encode_to(obs, bencode::container_sink(s),
+                         bencode::list{1, "foo"});
+      expect(s, equal_to("li1e3:fooe"));
+      bencode::encode_to(obs, bencode::container_sink(s), 42);
+      expect(s, equal_to("li1e3:fooei42e"));
+
+      expect(obs.last().encodes, equal_to(1u));
+      expect(obs.last().encoded_bytes, equal_to(4u));
+      expect(obs.total().encodes, equal_to(2u));
+      expect(obs.total().encoded_bytes, equal_to(14u));
+      expect(obs.encode_ns().count(), equal_to(2u));
+    });
+
+    _.test("observed iterator", []() {
+      bencode::stats_observer obs;
+      std::vector<char> v;
+      bencode::encode_to(obs, std::back_inserter(v), bencode::list{1, "foo"});
+      expect(std::string(v.begin(), v.end()), equal_to("li1e3:fooe"));
+      expect(obs.last().encoded_bytes, equal_to(10u));
+
+      char buf[16];
+      char *end = bencode::encode_to(obs, buf, 42);
+      expect(std::string(buf, end), equal_to("i42e"));
+      expect(obs.last().encoded_bytes, equal_to(4u));
+      expect(obs.total().encodes, equal_to(2u));
+    });
+
+    _.test("bad stream", []() {
+      std::ostream os(nullptr);
+      bencode::encode_to(os, 42);
+      expect(os.bad(), equal_to(true));
+    });
+
+#ifdef BENCODE_HAS_POSIX
+    _.test("file descriptor", []() {
+      int fds[2];
+      expect(::pipe(fds), equal_to(0));
+      bencode::encode_to(bencode::fd_sink(fds[1]), bencode::list{1, "foo"});
+      ::close(fds[1]);
+
+      char buf[64];
+      auto n = ::read(fds[0], buf, sizeof(buf));
+      ::close(fds[0]);
+      expect(std::string(buf, n), equal_to("li1e3:fooe"));
+    });
+#endif
+  });
+
+  subsuite<>(_, "to byte buffers", [](auto &_) {
+    auto to_string = [](const auto &bytes) {
+      std::string result;
+      for(auto i : bytes)
+        result.push_back(static_cast<char>(i));
+      return result;
+    };
+
+    _.test("std::vector<std::byte>", [to_string]() {
+      std::vector<std::byte> v;
+      bencode::encode_to(std::back_inserter(v), bencode::data{
+        bencode::dict{{"one", 1}, {"two", bencode::list{"foo"}}}
+      });
+      expect(to_string(v), equal_to("d3:onei1e3:twol3:fooee"));
+    });
+
+    _.test("std::vector<unsigned char>", [to_string]() {
+      std::vector<unsigned char> v;
+      bencode::encode_to(std::back_inserter(v), bencode::list{1, "foo"});
+      expect(to_string(v), equal_to("li1e3:fooe"));
+    });
+
+    _.test("pointer", [to_string]() {
+      std::byte buf[32];
+      auto end = bencode::encode_to(buf, bencode::dict{
+        {"one", 1}, {"two", bencode::list{"foo"}}
+      });
+      expect(end - buf, equal_to(22));
+      expect(to_string(std::span(buf, end)),
+             equal_to("d3:onei1e3:twol3:fooee"));
+    });
+
+    _.test("byte strings", [to_string]() {
+      std::vector<std::byte> payload = {std::byte{'h'}, std::byte{'i'}};
+      expect(bencode::encode(payload), equal_to("2:hi"));
+      expect(bencode::encode(std::span<const std::byte>(payload)),
+             equal_to("2:hi"));
+    });
+  });
+
 });
@@ -0,0 +1,209 @@
+#include <mettle.hpp>
+using namespace mettle;
+
+#include <unordered_set>
+
+#include "bencode.hpp"
+
+static const std::string nested_data("d"
+    "3:one" "i1e"
+    "5:three" "l" "d" "3:bar" "i0e" "3:foo" "i0e" "e" "e"
+    "3:two" "l" "i3e" "3:foo" "i4e" "e"
+  "e");
+
+suite<> test_hash_bytes("test hash_bytes", [](auto &_) {
+  _.test("equal input", []() {
+    std::string a = nested_data, b = nested_data;
+    expect(bencode::hash_bytes(a), equal_to(bencode::hash_bytes(b)));
+    expect(bencode::hash_bytes(a.data(), a.size()),
+           equal_to(bencode::hash_bytes(a)));
+  });
+
+  _.test("different input", []() {
+    std::unordered_set<std::size_t> hashes;
+    std::string s;
+    for(int i = 0; i != 100; i++) {
+      hashes.insert(bencode::hash_bytes(s));
+      s += 'x';
+    }
+    expect(hashes.size(), equal_to(100u));
+
+    expect(bencode::hash_bytes("i1e"), not_equal_to(
+      bencode::hash_bytes("i2e")
+    ));
+    expect(bencode::hash_bytes(std::string_view("\0", 1)), not_equal_to(
+      bencode::hash_bytes("")
+    ));
+  });
+});
+
+suite<
+  bencode::data, bencode::boost_data, bencode::fast_data,
+  bencode::compact_data, bencode::shared_data, bencode::hash_data
+> test_hash("test hash", type_only, [](auto &_) {
+  using DataType = fixture_type_t<decltype(_)>;
+  using list = typename DataType::list;
+  using dict = typename DataType::dict;
+
+  _.test("equal values", []() {
+    auto a = bencode::basic_decode<DataType>(nested_data);
+    auto b = bencode::basic_decode<DataType>(nested_data);
+    expect(bencode::hash(a), equal_to(bencode::hash(b)));
+    expect(std::hash<DataType>{}(a), equal_to(bencode::hash(a)));
+  });
+
+  _.test("different values", []() {
+    auto a = bencode::basic_decode<DataType>(nested_data);
+    auto b = a;
+    b["two"][0] = 5;
+    expect(bencode::hash(a), not_equal_to(bencode::hash(b)));
+
+    expect(bencode::hash(DataType(1)),
+           not_equal_to(bencode::hash(DataType("1"))));
+    expect(bencode::hash(DataType(list{1, 2})),
+           not_equal_to(bencode::hash(DataType(list{2, 1}))));
+    expect(bencode::hash(DataType(list{})),
+           not_equal_to(bencode::hash(DataType(dict{}))));
+    expect(bencode::hash(DataType(dict{{"a", 1}})),
+           not_equal_to(bencode::hash(DataType(dict{{"a", 2}}))));
+  });
+
+  _.test("unordered_set", []() {
+    // Nested `boost::variant`s can't be compared with `==`, so compare the
+    // encoded forms instead.
+    auto equal = [](const DataType &lhs, const DataType &rhs) {
+      return bencode::encode(lhs) == bencode::encode(rhs);
+    };
+    std::unordered_set<DataType, std::hash<DataType>, decltype(equal)> set;
+    set.insert(bencode::basic_decode<DataType>(nested_data));
+    set.insert(bencode::basic_decode<DataType>(nested_data));
+    set.insert(DataType(42));
+    expect(set.size(), equal_to(2u));
+    expect(set.count(DataType(42)), equal_to(1u));
+  });
+});
+
+suite<> test_hash_unordered("test hash unordered dicts", [](auto &_) {
+  _.test("insertion order", []() {
+    using dict = bencode::hash_data::dict;
+    bencode::hash_data a = dict{}, b = dict{};
+    for(int i = 0; i != 20; i++) {
+      a["key" + std::to_string(i)] = i;
+      b["key" + std::to_string(19 - i)] = 19 - i;
+    }
+    expect(a == b, equal_to(true));
+    expect(bencode::hash(a), equal_to(bencode::hash(b)));
+  });
+});
+
+suite<> test_hash_raw("test hash raw values", [](auto &_) {
+  _.test("raw_data", []() {
+    bencode::projection proj{"/one"};
+    auto a = bencode::basic_decode_projected<bencode::raw_data>(nested_data,
+                                                                proj);
+    auto b = a;
+    expect(bencode::hash(a), equal_to(bencode::hash(b)));
+
+    b["two"] = bencode::decode_raw("li3e3:fooi5ee");
+    expect(bencode::hash(a), not_equal_to(bencode::hash(b)));
+    expect(bencode::hash(bencode::raw_data(bencode::decode_raw("3:foo"))),
+           not_equal_to(bencode::hash(bencode::raw_data("foo"))));
+  });
+});
+
+suite<> test_decode_cache("test decode cache", [](auto &_) {
+  _.test("hits", []() {
+    bencode::decode_cache<bencode::data> cache(16);
+    auto a = cache.decode(nested_data);
+    auto b = cache.decode(std::string(nested_data));
+    expect(a.get(), equal_to(b.get()));
+    expect(bencode::encode(*a), equal_to(nested_data));
+
+    auto c = cache.decode("i42e");
+    expect(std::get<bencode::integer>(*c), equal_to(42));
+    expect(cache.size(), equal_to(2u));
+
+    auto stats = cache.stats();
+    expect(stats.hits, equal_to(1u));
+    expect(stats.misses, equal_to(2u));
+    expect(stats.evictions, equal_to(0u));
+    expect(stats.hit_rate(), equal_to(1.0 / 3));
+  });
+
+  _.test("eviction", []() {
+    bencode::decode_cache<bencode::data> cache(2, 1);
+    expect(cache.capacity(), equal_to(2u));
+
+    auto a = cache.decode("i1e");
+    cache.decode("i2e");
+    expect(cache.decode("i1e").get(), equal_to(a.get()));
+    cache.decode("i3e");
+    expect(cache.size(), equal_to(2u));
+    expect(cache.stats().evictions, equal_to(1u));
+
+    // "i2e" was least-recently used, so it was evicted.
+    expect(cache.decode("i1e").get(), equal_to(a.get()));
+    cache.decode("i2e");
+    expect(cache.stats().hits, equal_to(2u));
+    expect(cache.stats().misses, equal_to(4u));
+    expect(cache.stats().evictions, equal_to(2u));
+
+    // Evicted results are still valid.
+    cache.decode("i4e");
+    expect(std::get<bencode::integer>(*a), equal_to(1));
+  });
+
+  _.test("capacity", []() {
+    bencode::decode_cache<bencode::data> one(1, 16);
+    expect(one.capacity(), equal_to(1u));
+    for(int i = 0; i != 100; i++)
+      one.decode("i" + std::to_string(i) + "e");
+    expect(one.size(), less_equal(1u));
+
+    bencode::decode_cache<bencode::data> uneven(10, 4);
+    expect(uneven.capacity(), equal_to(10u));
+    for(int i = 0; i != 1000; i++)
+      uneven.decode("i" + std::to_string(i) + "e");
+    expect(uneven.size(), equal_to(10u));
+
+    bencode::decode_cache<bencode::data> empty(0, 4);
+    expect(empty.capacity(), equal_to(0u));
+    empty.decode("i1e");
+    expect(empty.size(), equal_to(0u));
+  });
+
+  _.test("clear", []() {
+    bencode::decode_cache<bencode::data> cache(16, 4);
+    auto a = cache.decode(nested_data);
+    cache.clear();
+    expect(cache.size(), equal_to(0u));
+    expect(bencode::encode(*a), equal_to(nested_data));
+    expect(cache.decode(nested_data).get(), not_equal_to(a.get()));
+  });
+
+  _.test("views", []() {
+    bencode::decode_cache<bencode::data_view> cache(16);
+    std::string input = nested_data;
+    auto value = cache.decode(input);
+    input.assign(input.size(), 'x');
+    cache.clear();
+    expect(bencode::encode(*value), equal_to(nested_data));
+  });
+
+  _.test("errors", []() {
+    bencode::decode_cache<bencode::data> cache(16);
+    expect([&cache]() { cache.decode("i1"); },
+           thrown<bencode::decode_error>(
+             "unexpected end of input, at offset 2"
+           ));
+    expect(cache.size(), equal_to(0u));
+
+    bencode::decode_cache<bencode::data> limited(16, 16, {.max_depth = 1});
+    expect([&limited]() { limited.decode("llee"); },
+           thrown<bencode::decode_error>(
+             "maximum nesting depth exceeded, at offset 1"
+           ));
+    expect([]() { bencode::decode_cache<bencode::data>(16, 0); },
+           thrown<std::invalid_argument>());
+  });
+});
@@ -0,0 +1,140 @@
+#include <mettle.hpp>
+using namespace mettle;
+
+#include "bencode.hpp"
+
+static const std::string doc("d"
+    "4:info" "d" "6:length" "i10e" "4:name" "3:foo" "e"
+    "5:peers" "l" "1:a" "1:b" "e"
+    "3:x/y" "i1e"
+  "e");
+
+suite<> test_index("test offset index", [](auto &_) {
+  using entry = bencode::offset_index::entry;
+  using entries = std::vector<entry>;
+
+  auto at = [](std::string_view value) {
+    auto offset = doc.find(value);
+    expect(offset, not_equal_to(doc.npos));
+    return entry{"", offset, value.size()};
+  };
+  auto named = [at](std::string path, std::string_view value) {
+    auto e = at(value);
+    e.path = std::move(path);
+    return e;
+  };
+
+  _.test("build", [named]() {
+    auto index = bencode::offset_index::build(doc, {1});
+    expect(index.size(), equal_to(doc.size()));
+    expect(index.entries(), equal_to(entries{
+      named("/info", "d6:lengthi10e4:name3:fooe"),
+      named("/peers", "l1:a1:be"),
+      named("/x~1y", "i1e"),
+    }));
+  });
+
+  _.test("build multiple depths", [named]() {
+    auto index = bencode::offset_index::build(doc, {2, 0});
+    expect(index.entries(), equal_to(entries{
+      named("", doc),
+      named("/info/length", "i10e"),
+      named("/info/name", "3:foo"),
+      named("/peers/0", "1:a"),
+      named("/peers/1", "1:b"),
+    }));
+  });
+
+  _.test("find", [named]() {
+    auto index = bencode::offset_index::build(doc, {1, 2});
+    auto *e = index.find("/info/name");
+    expect(e, not_equal_to(nullptr));
+    expect(*e, equal_to(named("/info/name", "3:foo")));
+    expect(index.find("/info/nope"), equal_to(nullptr));
+    expect(index.find("/x/y"), equal_to(nullptr));
+  });
+
+  _.test("build errors", []() {
+    expect([]() { bencode::offset_index::build("d1:ai1e", {1}); },
+           thrown<bencode::decode_error>(
+             "unexpected end of input, at offset 7"
+           ));
+    expect([]() { bencode::offset_index::build("di1ei1ee", {1}); },
+           thrown<bencode::decode_error>(
+             "expected string start token for dict key, at offset 1"
+           ));
+    expect([]() { bencode::offset_index::build("i1ei2e", {1}); },
+           thrown<bencode::decode_error>(
+             "extraneous character, at offset 3"
+           ));
+  });
+
+  _.test("serialize", []() {
+    auto index = bencode::offset_index::build(doc, {1, 2});
+    auto loaded = bencode::offset_index::deserialize(index.serialize());
+    expect(loaded.entries(), equal_to(index.entries()));
+    expect(loaded.size(), equal_to(index.size()));
+    expect(loaded.checksum(), equal_to(index.checksum()));
+    expect(loaded.matches(doc), equal_to(true));
+  });
+
+  _.test("deserialize errors", []() {
+    auto invalid = thrown<std::invalid_argument>("invalid offset index");
+    expect([]() { bencode::offset_index::deserialize("d"); }, invalid);
+    expect([]() { bencode::offset_index::deserialize("le"); }, invalid);
+    expect([]() {
+      bencode::offset_index::deserialize(
+        "d8:checksumi0e7:entriesle4:sizei10e7:versioni2ee"
+      );
+    }, invalid);
+    expect([]() {
+      bencode::offset_index::deserialize(
+        "d8:checksumi0e7:entriesll1:ai8ei4eee4:sizei10e7:versioni1ee"
+      );
+    }, invalid);
+    expect([]() {
+      bencode::offset_index::deserialize(
+        "d8:checksumi0e7:entriesll1:ai0eee4:sizei10e7:versioni1ee"
+      );
+    }, invalid);
+  });
+
+  _.test("reader", []() {
+    auto index = bencode::offset_index::build(doc, {1, 2});
+    bencode::indexed_reader reader(doc, std::move(index));
+    expect(reader.contains("/info"), equal_to(true));
+    expect(reader.contains("/nope"), equal_to(false));
+    expect(reader.raw("/peers"), equal_to("l1:a1:be"));
+    expect(bencode::encode(reader.decode("/info")),
+           equal_to("d6:lengthi10e4:name3:fooe"));
+    expect(std::get<bencode::integer>(reader.decode("/x~1y")), equal_to(1));
+
+    auto name = reader.decode_view("/info/name");
+    const void *data = std::get<bencode::string_view>(name).data();
+    expect(data, equal_to<const void *>(doc.data() + doc.find("foo")));
+
+    expect([&reader]() { reader.raw("/nope"); },
+           thrown<std::out_of_range>("path not in offset index"));
+  });
+
+  _.test("reader validation", []() {
+    auto index = bencode::offset_index::build(doc, {1});
+    auto mismatch = thrown<std::invalid_argument>(
+      "offset index doesn't match document"
+    );
+
+    expect([&]() { bencode::indexed_reader(doc + "x", index); }, mismatch);
+    expect([&]() { bencode::indexed_reader(doc, index); }, not_thrown());
+    expect([&]() { bencode::indexed_reader(doc, index, true); },
+           not_thrown());
+
+    // Changing the contents is only caught when verifying the checksum.
+    std::string changed = doc;
+    changed[changed.find("foo")] = 'g';
+    expect([&]() { bencode::indexed_reader(changed, index); }, not_thrown());
+    expect([&]() { bencode::indexed_reader(changed, index, true); },
+           mismatch);
+    expect([&]() { bencode::indexed_reader(doc + "x", index, true); },
+           mismatch);
+  });
+});
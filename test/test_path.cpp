@@ -0,0 +1,260 @@
+#include <mettle.hpp>
+using namespace mettle;
+
+#include "bencode.hpp"
+
+static const std::string torrent("d"
+    "8:announce" "3:url"
+    "4:info" "d"
+      "5:files" "l"
+        "d" "6:length" "i1e" "4:path" "l" "1:a" "e" "e"
+        "d" "6:length" "i2e" "4:path" "l" "1:b" "e" "e"
+        "d" "6:length" "i3e" "4:path" "l" "1:c" "e" "e"
+      "e"
+      "4:name" "4:test"
+    "e"
+  "e");
+
+template<typename Data>
+std::vector<std::string> encode_all(const std::vector<Data *> &values) {
+  std::vector<std::string> result;
+  for(auto *i : values)
+    result.push_back(bencode::encode(*i));
+  return result;
+}
+
+template<typename T>
+std::vector<std::string> to_strings(const std::vector<T> &values) {
+  return std::vector<std::string>(values.begin(), values.end());
+}
+
+suite<> test_path("test path", [](auto &_) {
+  using strings = std::vector<std::string>;
+
+  subsuite<
+    bencode::data, bencode::fast_data, bencode::compact_data
+  >(_, "find_all in data", type_only, [](auto &_) {
+    using DataType = fixture_type_t<decltype(_)>;
+
+    _.test("keys", []() {
+      auto value = bencode::basic_decode<DataType>(torrent);
+      expect(encode_all(bencode::path("/info/name").find_all(value)),
+             equal_to(strings{"4:test"}));
+      expect(encode_all(bencode::path("/info/missing").find_all(value)),
+             equal_to(strings{}));
+      expect(encode_all(bencode::path("/announce/x").find_all(value)),
+             equal_to(strings{}));
+      expect(encode_all(bencode::path("").find_all(value)),
+             equal_to(strings{torrent}));
+    });
+
+    _.test("indices", []() {
+      const auto value = bencode::basic_decode<DataType>(torrent);
+      expect(encode_all(bencode::path("/info/files/1/length").find_all(value)),
+             equal_to(strings{"i2e"}));
+      expect(encode_all(bencode::path("/info/files/5/length").find_all(value)),
+             equal_to(strings{}));
+    });
+
+    _.test("wildcards and ranges", []() {
+      auto value = bencode::basic_decode<DataType>(torrent);
+      expect(encode_all(bencode::path("/info/files/*/length").find_all(value)),
+             equal_to(strings{"i1e", "i2e", "i3e"}));
+      expect(encode_all(bencode::path("/info/files/1:/path/0")
+                        .find_all(value)),
+             equal_to(strings{"1:b", "1:c"}));
+      expect(encode_all(bencode::path("/info/files/:2/length")
+                        .find_all(value)),
+             equal_to(strings{"i1e", "i2e"}));
+      expect(encode_all(bencode::path("/*/name").find_all(value)),
+             equal_to(strings{"4:test"}));
+    });
+
+    _.test("find", []() {
+      auto value = bencode::basic_decode<DataType>(torrent);
+      auto found = bencode::path("/info/files/*/length").find(value);
+      expect(found, is_not(nullptr));
+      expect(bencode::encode(*found), equal_to("i1e"));
+      expect(bencode::path("/info/nope").find(value), equal_to(nullptr));
+
+      *found = 42;
+      expect(bencode::encode(*bencode::path("/info/files/0/length")
+                             .find(value)),
+             equal_to("i42e"));
+    });
+  });
+
+  subsuite<>(_, "find_all in buffer", [](auto &_) {
+    _.test("keys", []() {
+      expect(to_strings(bencode::path("/info/name").find_all(torrent)),
+             equal_to(strings{"4:test"}));
+      expect(to_strings(bencode::path("/info/missing").find_all(torrent)),
+             equal_to(strings{}));
+      expect(to_strings(bencode::path("").find_all(torrent)),
+             equal_to(strings{torrent}));
+    });
+
+    _.test("wildcards and ranges", []() {
+      expect(to_strings(bencode::path("/info/files/*/path").find_all(torrent)),
+             equal_to(strings{"l1:ae", "l1:be", "l1:ce"}));
+      expect(to_strings(bencode::path("/info/files/1:/length")
+                        .find_all(torrent)),
+             equal_to(strings{"i2e", "i3e"}));
+      expect(to_strings(bencode::path("/info/files/2").find_all(torrent)),
+             equal_to(strings{"d6:lengthi3e4:pathl1:cee"}));
+    });
+
+    _.test("points into buffer", []() {
+      auto found = bencode::path("/info/name").find_all(torrent);
+      expect(found.size(), equal_to(1u));
+      expect(found[0].data(), equal_to(torrent.data() + torrent.find("4:t")));
+    });
+
+    _.test("find", []() {
+      auto found = bencode::path("/info/files/*/length").find(torrent);
+      expect(found.has_value(), equal_to(true));
+      expect(*found, equal_to("i1e"));
+      expect(bencode::path("/info/nope").find(torrent).has_value(),
+             equal_to(false));
+
+      // `find` stops reading as soon as it finds a match.
+      found = bencode::path("/a").find(std::string_view("d1:ai1e1:b"));
+      expect(found.has_value(), equal_to(true));
+      expect(*found, equal_to("i1e"));
+    });
+
+    _.test("malformed input", []() {
+      expect([]() { bencode::path("/a").find_all(std::string_view("d1:a")); },
+             thrown<bencode::decode_error>(
+               "unexpected end of input, at offset 4"
+             ));
+      expect([]() { bencode::path("/a").find_all(std::string_view("i1ei2e")); },
+             thrown<bencode::decode_error>(
+               "extraneous character, at offset 3"
+             ));
+      expect([]() { bencode::path("/a").find_all(std::string_view("di1ee")); },
+             thrown<bencode::decode_error>(
+               "expected string start token for dict key, at offset 1"
+             ));
+    });
+  });
+
+  subsuite<>(_, "patch", [](auto &_) {
+    _.test("same size", []() {
+      std::string buf = "d4:infod4:name3:foo6:lengthi1ee3:url3:abce";
+      auto data = buf.data();
+      bencode::patch(buf, bencode::path("/url"), "xyz");
+      expect(buf, equal_to("d4:infod4:name3:foo6:lengthi1ee3:url3:xyze"));
+      expect(buf.data(), equal_to(data));
+    });
+
+    _.test("different size", []() {
+      std::string buf = "d4:infod6:lengthi1e4:name3:fooe3:url3:abce";
+      bencode::patch(buf, bencode::path("/info/length"), 1234);
+      expect(buf, equal_to("d4:infod6:lengthi1234e4:name3:fooe3:url3:abce"));
+      bencode::patch(buf, bencode::path("/info/name"), "");
+      expect(buf, equal_to("d4:infod6:lengthi1234e4:name0:e3:url3:abce"));
+      bencode::patch(buf, bencode::path("/url"), bencode::list{1, 2});
+      expect(buf, equal_to("d4:infod6:lengthi1234e4:name0:e3:urlli1ei2eee"));
+    });
+
+    _.test("lists", []() {
+      std::vector<char> buf = {'l', 'i', '1', 'e', 'l', '1', ':', 'a', 'e',
+                               'e'};
+      bencode::patch(buf, bencode::path("/1/0"), "bc");
+      expect(std::string(buf.begin(), buf.end()), equal_to("li1el2:bcee"));
+      bencode::patch(buf, bencode::path("/0:1"), 7);
+      expect(std::string(buf.begin(), buf.end()), equal_to("li7el2:bcee"));
+    });
+
+    _.test("fixed-size buffer", []() {
+      std::string storage = "d1:ai1e1:b3:fooe";
+      std::span<char> buf(storage);
+      bencode::patch(buf, bencode::path("/b"), "bar");
+      expect(storage, equal_to("d1:ai1e1:b3:bare"));
+
+      std::array<std::byte, 3> bytes = {std::byte{'i'}, std::byte{'1'},
+                                        std::byte{'e'}};
+      bencode::patch(bytes, bencode::path(""), 2);
+      expect(static_cast<char>(bytes[1]), equal_to('2'));
+
+      expect([&buf]() { bencode::patch(buf, bencode::path("/a"), 10); },
+             thrown<std::length_error>("buffer can't be resized"));
+      expect([&buf]() { bencode::patch(buf, bencode::path("/c"), 1); },
+             thrown<std::length_error>("buffer can't be resized"));
+      expect(storage, equal_to("d1:ai1e1:b3:bare"));
+    });
+
+    _.test("insert key", []() {
+      std::string buf = "d1:bi2e1:di4ee";
+      bencode::patch(buf, bencode::path("/c"), 3);
+      expect(buf, equal_to("d1:bi2e1:ci3e1:di4ee"));
+      bencode::patch(buf, bencode::path("/a"), 1);
+      expect(buf, equal_to("d1:ai1e1:bi2e1:ci3e1:di4ee"));
+      bencode::patch(buf, bencode::path("/e"), 5);
+      expect(buf, equal_to("d1:ai1e1:bi2e1:ci3e1:di4e1:ei5ee"));
+
+      std::string empty = "de";
+      bencode::patch(empty, bencode::path("/a"), "b");
+      expect(empty, equal_to("d1:a1:be"));
+    });
+
+    _.test("whole document", []() {
+      std::string buf = "i1e";
+      bencode::patch(buf, bencode::path(""), bencode::dict{{"a", 1}});
+      expect(buf, equal_to("d1:ai1ee"));
+    });
+
+    _.test("only scans up to the value", []() {
+      std::string buf = "d1:ai1e1:b";
+      bencode::patch(buf, bencode::path("/a"), 2);
+      expect(buf, equal_to("d1:ai2e1:b"));
+    });
+
+    _.test("errors", []() {
+      std::string buf = "d1:ali1eee";
+      expect([&buf]() { bencode::patch(buf, bencode::path("/b/c"), 1); },
+             thrown<std::out_of_range>("no value at path"));
+      expect([&buf]() { bencode::patch(buf, bencode::path("/a/1"), 1); },
+             thrown<std::out_of_range>("no value at path"));
+      expect([&buf]() { bencode::patch(buf, bencode::path("/a/0/x"), 1); },
+             thrown<std::out_of_range>("no value at path"));
+      expect([&buf]() { bencode::patch(buf, bencode::path("/a/*"), 1); },
+             thrown<std::invalid_argument>());
+      expect([&buf]() { bencode::patch(buf, bencode::path("/a/0:2"), 1); },
+             thrown<std::invalid_argument>());
+      expect(buf, equal_to("d1:ali1eee"));
+
+      std::string bad = "di1ee";
+      expect([&bad]() { bencode::patch(bad, bencode::path("/a"), 1); },
+             thrown<bencode::decode_error>(
+               "expected string start token for dict key, at offset 1"
+             ));
+      bad = "d1:b";
+      expect([&bad]() { bencode::patch(bad, bencode::path("/c"), 1); },
+             thrown<bencode::decode_error>(
+               "unexpected end of input, at offset 4"
+             ));
+    });
+  });
+
+  subsuite<>(_, "parsing", [](auto &_) {
+    _.test("escapes", []() {
+      auto value = bencode::decode("d3:a/bi1e3:a~bi2e3:1:2i3ee");
+      expect(encode_all(bencode::path("/a~1b").find_all(value)),
+             equal_to(strings{"i1e"}));
+      expect(encode_all(bencode::path("/a~0b").find_all(value)),
+             equal_to(strings{"i2e"}));
+      // Ranges still match dict keys literally.
+      expect(encode_all(bencode::path("/1:2").find_all(value)),
+             equal_to(strings{"i3e"}));
+    });
+
+    _.test("invalid paths", []() {
+      expect([]() { bencode::path("no/slash"); },
+             thrown<std::invalid_argument>());
+      expect([]() { bencode::path("/bad~escape"); },
+             thrown<std::invalid_argument>());
+    });
+  });
+});
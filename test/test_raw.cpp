@@ -0,0 +1,192 @@
+#include <mettle.hpp>
+using namespace mettle;
+
+#include "bencode.hpp"
+
+suite<> test_raw("test raw values", [](auto &_) {
+  auto msg = "d3:fooli1e3:bare4:goatd1:xi2eee";
+
+  _.test("decode_raw_view", [msg]() {
+    std::string buf = msg;
+    auto value = bencode::decode_raw_view(buf);
+    expect(value.data(), equal_to(msg));
+    expect(value.data().data(), equal_to(buf.data()));
+
+    expect(bencode::decode_raw_view("i42e").data(), equal_to("i42e"));
+  });
+
+  _.test("decode_raw_view_some", []() {
+    std::string buf = "i1e3:fooi2e";
+    const char *begin = buf.data(), *end = begin + buf.size();
+    expect(bencode::decode_raw_view_some(begin, end).data(), equal_to("i1e"));
+    expect(bencode::decode_raw_view_some(begin, end).data(),
+           equal_to("3:foo"));
+    expect(bencode::decode_raw_view_some(begin, end).data(), equal_to("i2e"));
+    expect(begin, equal_to(end));
+  });
+
+  _.test("decode_raw", [msg]() {
+    bencode::raw value;
+    {
+      std::string buf = msg;
+      value = bencode::decode_raw(buf);
+    }
+    expect(value.data(), equal_to(msg));
+    expect(bencode::encode(value), equal_to(msg));
+  });
+
+  _.test("decode_raw_dict_view", [msg]() {
+    auto value = bencode::decode_raw_dict_view(msg);
+    expect(value.size(), equal_to(2u));
+    expect(value["foo"].data(), equal_to("li1e3:bare"));
+    expect(value["goat"].data(), equal_to("d1:xi2ee"));
+
+    // Replace one field and forward the rest untouched.
+    auto replacement = bencode::encode(bencode::list{"new"});
+    value["foo"] = bencode::raw_view(replacement);
+    expect(bencode::encode(value), equal_to("d3:fool3:newe4:goatd1:xi2eee"));
+  });
+
+  _.test("encode", [msg]() {
+    auto value = bencode::decode_raw_view(msg);
+    expect(bencode::encode(value), equal_to(msg));
+    expect(bencode::encode(bencode::list{bencode::encode(value), 1}),
+           equal_to(std::string("l31:") + msg + "i1ee"));
+
+    std::vector<bencode::raw_view> v = {bencode::decode_raw_view("i1e"),
+                                        bencode::decode_raw_view("3:foo")};
+    expect(bencode::encode(v), equal_to("li1e3:fooe"));
+
+    std::stringstream ss;
+    bencode::encode_to(ss, value);
+    expect(ss.str(), equal_to(msg));
+  });
+
+  _.test("encode to sink", []() {
+    struct recording_sink {
+      std::vector<std::size_t> writes;
+      void write(const char *, std::size_t n) { writes.push_back(n); }
+    };
+
+    std::string big = "l" + bencode::encode(std::string(10000, 'x')) + "e";
+    recording_sink sink;
+    bencode::encode_to(sink, bencode::decode_raw_view(big));
+    expect(sink.writes, array(big.size()));
+  });
+
+  _.test("raw_data", []() {
+    auto msg = "d4:infod6:lengthi10e4:name3:fooe5:peersl1:a1:be3:seqi1ee";
+    auto value = bencode::basic_decode_projected<bencode::raw_data>(
+      msg, bencode::projection{"/info/name", "/seq"}
+    );
+    expect(std::get<bencode::raw>(value["info"]["length"]).data(),
+           equal_to("i10e"));
+    expect(std::get<bencode::raw>(value["peers"]).data(),
+           equal_to("l1:a1:be"));
+    expect(std::get<bencode::string>(value["info"]["name"]),
+           equal_to("foo"));
+    expect(bencode::encode(value), equal_to(msg));
+
+    // Edit the decoded fields and forward the rest untouched.
+    value["info"]["name"] = "bar";
+    value["seq"] = 2;
+    expect(bencode::encode(value), equal_to(
+      "d4:infod6:lengthi10e4:name3:bare5:peersl1:a1:be3:seqi2ee"
+    ));
+  });
+
+  _.test("raw_data lists", []() {
+    auto msg = "ld1:ai1e1:bi2eeli3ei4eei5ee";
+    auto value = bencode::basic_decode_projected<bencode::raw_data>(
+      msg, bencode::projection{"/0/b", "/2"}
+    );
+    auto &list = std::get<bencode::raw_data::list>(value);
+    expect(list.size(), equal_to(3u));
+    expect(std::get<bencode::raw>(list[0]["a"]).data(), equal_to("i1e"));
+    expect(std::get<bencode::integer>(list[0]["b"]), equal_to(2));
+    expect(std::get<bencode::raw>(list[1]).data(), equal_to("li3ei4ee"));
+    expect(std::get<bencode::integer>(list[2]), equal_to(5));
+    expect(bencode::encode(value), equal_to(msg));
+
+    auto view = bencode::to_view(value);
+    expect(std::get<bencode::raw_view>(view[1]).data(), equal_to("li3ei4ee"));
+
+    list.push_back(bencode::decode_raw("3:new"));
+    expect(bencode::encode(value),
+           equal_to("ld1:ai1e1:bi2eeli3ei4eei5e3:newe"));
+  });
+
+  _.test("raw_data_view", []() {
+    std::string buf = "d1:ad1:xi1ee1:bi2ee";
+    auto value = bencode::basic_decode_projected<bencode::raw_data_view>(
+      buf, bencode::projection{"/b"}
+    );
+    auto raw = std::get<bencode::raw_view>(value["a"]).data();
+    expect(raw, equal_to("d1:xi1ee"));
+    expect(raw.data(), equal_to<const void *>(buf.data() + 4));
+    expect(bencode::encode(value), equal_to(buf));
+
+    auto copy = bencode::materialize(value);
+    buf.assign(buf.size(), 'x');
+    expect(std::get<bencode::raw_view>(copy.value["a"]).data(),
+           equal_to("d1:xi1ee"));
+    expect(bencode::encode(copy.value), equal_to("d1:ad1:xi1ee1:bi2ee"));
+  });
+
+  _.test("raw_data errors", []() {
+    expect([]() {
+      bencode::basic_decode_projected<bencode::raw_data>(
+        "d1:ali1e1:ai2e", bencode::projection{"/b"}
+      );
+    }, thrown<bencode::decode_error>(
+      "unexpected end of input, at offset 14"
+    ));
+    expect([]() {
+      bencode::basic_decode_projected<bencode::raw_data>(
+        "d1:ai1e1:ai2ee", bencode::projection{"/b"}
+      );
+    }, thrown<bencode::decode_error>(
+      "duplicated key in dict: a, at offset 13"
+    ));
+  });
+
+  _.test("errors", []() {
+    expect([]() { bencode::decode_raw_view("l3:foo"); },
+           thrown<bencode::decode_error>(
+             "unexpected end of input, at offset 6"
+           ));
+    expect([]() { bencode::decode_raw_view("i1ei2e"); },
+           thrown<bencode::decode_error>(
+             "extraneous character, at offset 3"
+           ));
+
+    expect([]() { bencode::decode_raw_dict_view("li1ee"); },
+           thrown<bencode::decode_error>(
+             "unexpected type token, at offset 0"
+           ));
+    expect([]() { bencode::decode_raw_dict_view("di1ei2ee"); },
+           thrown<bencode::decode_error>(
+             "expected string start token for dict key, at offset 1"
+           ));
+    expect([]() { bencode::decode_raw_dict_view("d1:ai1e1:ai2ee"); },
+           thrown<bencode::decode_error>(
+             "duplicated key in dict: a, at offset 13"
+           ));
+
+    bencode::decode_limits limits;
+    limits.max_depth = 1;
+    expect(bencode::decode_raw_dict_view("d1:ai1ee", limits).size(),
+           equal_to(1u));
+    expect([limits]() { bencode::decode_raw_dict_view("d1:alee", limits); },
+           thrown<bencode::decode_error>(
+             "maximum nesting depth exceeded, at offset 4"
+           ));
+
+    limits = {};
+    limits.max_bytes = 4;
+    expect([limits]() { bencode::decode_raw_view("3:foo", limits); },
+           thrown<bencode::decode_error>(
+             "maximum input size exceeded, at offset 4"
+           ));
+  });
+});
@@ -0,0 +1,119 @@
+#include <mettle.hpp>
+using namespace mettle;
+
+#include "bencode.hpp"
+
+suite<> test_template("test message templates", [](auto &_) {
+  using kind = bencode::message_template::hole_kind;
+
+  bencode::data response = bencode::dict{
+    {"t", ""},
+    {"y", "r"},
+    {"r", bencode::dict{
+      {"id", "abcdefghij0123456789"},
+      {"token", ""},
+      {"values", bencode::list{}},
+      {"port", 0}
+    }}
+  };
+
+  _.test("compile", [response]() {
+    bencode::message_template tmpl(response, {"/r/port", "/r/token",
+                                              "/r/values", "/t"});
+    expect(tmpl.holes(), equal_to(4u));
+    expect(tmpl.kind(0), equal_to(kind::integer));
+    expect(tmpl.kind(1), equal_to(kind::string));
+    expect(tmpl.kind(2), equal_to(kind::value));
+    expect(tmpl.kind(3), equal_to(kind::string));
+  });
+
+  _.test("render", [response]() {
+    bencode::message_template tmpl(response, {"/r/port", "/r/token",
+                                              "/r/values", "/t"});
+    std::vector<std::string> peers = {"peer1", "peer2"};
+    auto result = tmpl.render(6881, "tok", peers, std::string("aa"));
+
+    auto expected = response;
+    expected["t"] = "aa";
+    expected["r"]["port"] = 6881;
+    expected["r"]["token"] = "tok";
+    expected["r"]["values"] = bencode::list{"peer1", "peer2"};
+    expect(result, equal_to(bencode::encode(expected)));
+
+    // Render again with different values.
+    expect(tmpl.render(1, "", bencode::list{}, "bb"),
+           equal_to("d1:rd2:id20:abcdefghij01234567894:porti1e5:token0:"
+                    "6:valuesle" "e1:t2:bb1:y1:re"));
+  });
+
+  _.test("render_to", []() {
+    bencode::message_template tmpl(bencode::data{bencode::list{1, 0, 3}},
+                                   {"/1"});
+    std::vector<char> v;
+    tmpl.render_to(std::back_inserter(v), 2);
+    expect(std::string(v.begin(), v.end()), equal_to("li1ei2ei3ee"));
+
+    std::string s;
+    tmpl.render_to(bencode::container_sink(s), 42);
+    expect(s, equal_to("li1ei42ei3ee"));
+
+    std::stringstream ss;
+    tmpl.render_to(bencode::ostream_sink(ss), -1);
+    expect(ss.str(), equal_to("li1ei-1ei3ee"));
+  });
+
+  _.test("no holes", [response]() {
+    bencode::message_template tmpl(response, {});
+    expect(tmpl.holes(), equal_to(0u));
+    expect(tmpl.render(), equal_to(bencode::encode(response)));
+  });
+
+  _.test("invalid holes", [response]() {
+    expect([&response]() {
+      bencode::message_template(response, {"/nope"});
+    }, thrown<std::invalid_argument>());
+    expect([&response]() {
+      bencode::message_template(response, {"/*"});
+    }, thrown<std::invalid_argument>());
+    expect([&response]() {
+      bencode::message_template(response, {"/t", "/r/port"});
+    }, thrown<std::invalid_argument>(
+      "template holes must be in message order"
+    ));
+  });
+
+  _.test("invalid values", [response]() {
+    bencode::message_template tmpl(response, {"/r/port", "/t"});
+    expect([&tmpl]() { tmpl.render(1); },
+           thrown<std::invalid_argument>(
+             "wrong number of values for template"
+           ));
+    expect([&tmpl]() { tmpl.render("1", "t"); },
+           thrown<std::invalid_argument>(
+             "wrong type of value for template hole"
+           ));
+    expect([&tmpl]() { tmpl.render(1, 2); },
+           thrown<std::invalid_argument>(
+             "wrong type of value for template hole"
+           ));
+    expect([&tmpl]() { tmpl.render(1, bencode::list{}); },
+           thrown<std::invalid_argument>(
+             "wrong type of value for template hole"
+           ));
+
+    // Nothing is written if any value is the wrong type.
+    std::string out;
+    expect([&]() { tmpl.render_to(std::back_inserter(out), 1, 2); },
+           thrown<std::invalid_argument>(
+             "wrong type of value for template hole"
+           ));
+    expect(out, equal_to(""));
+
+    std::stringstream ss;
+    expect([&]() { tmpl.render_to(bencode::ostream_sink(ss), 1, 2); },
+           thrown<std::invalid_argument>(
+             "wrong type of value for template hole"
+           ));
+    expect(ss.str(), equal_to(""));
+  });
+});